@@ -0,0 +1,325 @@
+/*** interleave.c --- Interleaving the blocks of bytes  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>            /* for pthread_once () */
+#include <stddef.h>             /* for size_t */
+#include <string.h>             /* for memcpy () */
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "interleave.h"
+
+/* NB: the shuffle kernels take up to this many planes */
+#define SIMD_PLANES 4
+/* NB: the bytes in a SIMD register */
+#define SIMD_BYTES 16
+
+/* NB: copy the blocks of SIZE bytes each, from SRC to DST, the given
+   strides apart; the common sizes are copied with the sizes known at
+   compile time */
+#define COPY_LOOP(sz) \
+    for (cs_j = 0; cs_j < cs_n; \
+         cs_j++, cs_d += cs_ds, cs_s += cs_ss) { \
+      memcpy (cs_d, cs_s, (sz)); \
+    }
+#define COPY_STRIDED(dst, d_stride, src, s_stride, size, count) \
+    { \
+      char *cs_d = (char *)(dst); \
+      const char *cs_s = (const char *)(src); \
+      const size_t cs_ds = (d_stride), cs_ss = (s_stride); \
+      const size_t cs_sz = (size), cs_n = (count); \
+      size_t cs_j; \
+      switch (cs_sz) { \
+      case 1:  COPY_LOOP (1); break; \
+      case 2:  COPY_LOOP (2); break; \
+      case 4:  COPY_LOOP (4); break; \
+      case 8:  COPY_LOOP (8); break; \
+      default: COPY_LOOP (cs_sz); \
+      } \
+    }
+
+/*** Shuffle kernels */
+
+#ifdef HAVE_X86_DISPATCH
+
+#define SSSE3 __attribute__ ((target ("ssse3")))
+
+/* NB: a SIMD register of each of the N planes (of the blocks of SIZE
+   bytes) makes N registers of the output; the byte J of the output
+   register R is taken from the plane P with MASKS[R][P][J], while
+   the other planes' masks are -128 (i. e., zero) there */
+static void
+interleave_masks (signed char masks[][SIMD_PLANES][SIMD_BYTES],
+                  size_t n, size_t size)
+{
+  size_t r, p, j;
+
+  for (r = 0; r < n; r++) {
+    for (j = 0; j < SIMD_BYTES; j++) {
+      const size_t o = r * SIMD_BYTES + j;
+      const size_t e = o / size, b = o % size;
+      for (p = 0; p < n; p++) {
+        masks[r][p][j] = (e % n != p ? -128
+                          : (signed char)(e / n * size + b));
+      }
+    }
+  }
+}
+
+/* NB: the other way around: the byte J of the output register of the
+   plane P is taken from the input register R with MASKS[P][R][J] */
+static void
+deinterleave_masks (signed char masks[][SIMD_PLANES][SIMD_BYTES],
+                    size_t n, size_t size)
+{
+  size_t p, r, j;
+
+  for (p = 0; p < n; p++) {
+    for (j = 0; j < SIMD_BYTES; j++) {
+      const size_t o = (j / size * n + p) * size + j % size;
+      for (r = 0; r < n; r++) {
+        masks[p][r][j] = (o / SIMD_BYTES != r ? -128
+                          : (signed char)(o % SIMD_BYTES));
+      }
+    }
+  }
+}
+
+/* NB: N is a constant in the callers below, so that the loops over
+   the registers are unrolled */
+static inline __attribute__ ((always_inline)) SSSE3 size_t
+interleave_ssse3_n (char *dst, const char *const *src, size_t n,
+                    size_t size, size_t count)
+{
+  const size_t step = SIMD_BYTES / size;
+  signed char masks[SIMD_PLANES][SIMD_PLANES][SIMD_BYTES];
+  __m128i m[SIMD_PLANES][SIMD_PLANES];
+  size_t i, r, p;
+
+  interleave_masks (masks, n, size);
+  for (r = 0; r < n; r++) {
+    for (p = 0; p < n; p++) {
+      m[r][p] = _mm_loadu_si128 ((const __m128i *)masks[r][p]);
+    }
+  }
+
+  for (i = 0; i + step <= count; i += step) {
+    char *d = dst + i * n * size;
+    __m128i x[SIMD_PLANES];
+    for (p = 0; p < n; p++) {
+      x[p] = _mm_loadu_si128 ((const __m128i *)(src[p] + i * size));
+    }
+    for (r = 0; r < n; r++) {
+      __m128i o = _mm_shuffle_epi8 (x[0], m[r][0]);
+      for (p = 1; p < n; p++) {
+        o = _mm_or_si128 (o, _mm_shuffle_epi8 (x[p], m[r][p]));
+      }
+      _mm_storeu_si128 ((__m128i *)(d + r * SIMD_BYTES), o);
+    }
+  }
+
+  /* . */
+  return i;
+}
+
+static inline __attribute__ ((always_inline)) SSSE3 size_t
+deinterleave_ssse3_n (char *const *dst, const char *src, size_t n,
+                      size_t size, size_t count)
+{
+  const size_t step = SIMD_BYTES / size;
+  signed char masks[SIMD_PLANES][SIMD_PLANES][SIMD_BYTES];
+  __m128i m[SIMD_PLANES][SIMD_PLANES];
+  size_t i, r, p;
+
+  deinterleave_masks (masks, n, size);
+  for (p = 0; p < n; p++) {
+    for (r = 0; r < n; r++) {
+      m[p][r] = _mm_loadu_si128 ((const __m128i *)masks[p][r]);
+    }
+  }
+
+  for (i = 0; i + step <= count; i += step) {
+    const char *s = src + i * n * size;
+    __m128i x[SIMD_PLANES];
+    for (r = 0; r < n; r++) {
+      x[r] = _mm_loadu_si128 ((const __m128i *)(s + r * SIMD_BYTES));
+    }
+    for (p = 0; p < n; p++) {
+      __m128i o = _mm_shuffle_epi8 (x[0], m[p][0]);
+      for (r = 1; r < n; r++) {
+        o = _mm_or_si128 (o, _mm_shuffle_epi8 (x[r], m[p][r]));
+      }
+      _mm_storeu_si128 ((__m128i *)(dst[p] + i * size), o);
+    }
+  }
+
+  /* . */
+  return i;
+}
+
+/* NB: return the count of the cycles done, a multiple of the blocks
+   in a register; the rest is left to the generic code */
+static SSSE3 size_t
+interleave_ssse3 (char *dst, const char *const *src, size_t n,
+                  size_t size, size_t count)
+{
+  switch (n) {
+  case 2:
+    /* . */
+    return interleave_ssse3_n (dst, src, 2, size, count);
+  case 3:
+    /* . */
+    return interleave_ssse3_n (dst, src, 3, size, count);
+  default:
+    /* . */
+    return interleave_ssse3_n (dst, src, 4, size, count);
+  }
+}
+
+static SSSE3 size_t
+deinterleave_ssse3 (char *const *dst, const char *src, size_t n,
+                    size_t size, size_t count)
+{
+  switch (n) {
+  case 2:
+    /* . */
+    return deinterleave_ssse3_n (dst, src, 2, size, count);
+  case 3:
+    /* . */
+    return deinterleave_ssse3_n (dst, src, 3, size, count);
+  default:
+    /* . */
+    return deinterleave_ssse3_n (dst, src, 4, size, count);
+  }
+}
+
+#define CPU_HAS(feature) (__builtin_cpu_init (), \
+                          __builtin_cpu_supports (feature))
+
+/* NB: the CPU is checked once, on the first call, which may well be
+   made by several threads at once */
+static int have_ssse3_p;
+static pthread_once_t ssse3_once = PTHREAD_ONCE_INIT;
+
+static void
+check_ssse3 (void)
+{
+  have_ssse3_p = CPU_HAS ("ssse3");
+}
+
+/* NB: whether the shuffle kernels apply */
+static int
+simd_p (size_t n, const size_t *sizes)
+{
+  size_t i;
+
+  if (n < 2 || n > SIMD_PLANES) {
+    /* . */
+    return 0;
+  }
+  switch (sizes[0]) {
+  case 1: case 2: case 4: case 8:
+    break;
+  default:
+    /* . */
+    return 0;
+  }
+  for (i = 1; i < n; i++) {
+    if (sizes[i] != sizes[0]) {
+      /* . */
+      return 0;
+    }
+  }
+  pthread_once (&ssse3_once, check_ssse3);
+
+  /* . */
+  return have_ssse3_p;
+}
+
+#endif
+
+/*** Interface */
+
+void
+ilv_interleave (void *dst, const void *const *src, size_t n,
+                const size_t *sizes, size_t count)
+{
+  const char *const *s = (const char *const *)src;
+  size_t cycle, offset, done = 0, i;
+
+  for (cycle = 0, i = 0; i < n; i++) {
+    cycle += sizes[i];
+  }
+
+#ifdef HAVE_X86_DISPATCH
+  if (simd_p (n, sizes)) {
+    done = interleave_ssse3 (dst, s, n, sizes[0], count);
+  }
+#endif
+
+  /* NB: the rest of the cycles, a plane at a time */
+  for (offset = 0, i = 0; i < n; offset += sizes[i++]) {
+    COPY_STRIDED ((char *)dst + done * cycle + offset, cycle,
+                  s[i] + done * sizes[i], sizes[i],
+                  sizes[i], count - done);
+  }
+}
+
+void
+ilv_deinterleave (void *const *dst, const void *src, size_t n,
+                  const size_t *sizes, size_t count)
+{
+  char *const *d = (char *const *)dst;
+  size_t cycle, offset, done = 0, i;
+
+  for (cycle = 0, i = 0; i < n; i++) {
+    cycle += sizes[i];
+  }
+
+#ifdef HAVE_X86_DISPATCH
+  if (simd_p (n, sizes)) {
+    done = deinterleave_ssse3 (d, src, n, sizes[0], count);
+  }
+#endif
+
+  for (offset = 0, i = 0; i < n; offset += sizes[i++]) {
+    COPY_STRIDED (d[i] + done * sizes[i], sizes[i],
+                  (const char *)src + done * cycle + offset, cycle,
+                  sizes[i], count - done);
+  }
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** interleave.c ends here */
@@ -0,0 +1,48 @@
+/*** interleave.h --- Interleaving the blocks of bytes  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#include <stddef.h>             /* for size_t */
+
+/* NB: the COUNT cycles of the blocks of the N planes, the blocks of
+   the plane I being SIZES[I] bytes, are interleaved (or, the other
+   way around, de-interleaved.)  For 2 to 4 planes of the blocks of
+   the same size of 1, 2, 4 or 8 bytes, the bytes are shuffled in the
+   SIMD registers, where available; otherwise, the blocks are copied
+   one by one */
+void ilv_interleave (void *dst, const void *const *src, size_t n,
+                     const size_t *sizes, size_t count);
+void ilv_deinterleave (void *const *dst, const void *src, size_t n,
+                       const size_t *sizes, size_t count);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** interleave.h ends here */
@@ -21,9 +21,16 @@
  */
 
 /*** Code: */
-#include <math.h>               /* for isnan (), NAN */
+#include <math.h>               /* for isnan (), NAN, nearbyint () */
 #include <stddef.h>             /* for size_t */
 #include <stdint.h>
+#include <string.h>             /* for memcmp () */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "numconv.h"
 
 #define NUM_COERCE(fn, to_type, from_type) \
     void \
@@ -124,6 +131,509 @@ NUM_COERCE_NAN_FROM (nconv_nan_float_from_uint64_t,  float,  uint64_t)
 NUM_COERCE_NAN_FROM (nconv_nan_float_from_float,     float,  float)
 NUM_COERCE_NAN_FROM (nconv_nan_float_from_double,    float,  double)
 
+/** Saturating coercion to integers, with rounding */
+
+/* NB: rounding is done before the range check, so that the bounds are
+   always compared against integral values; the comparisons are done
+   in double, which is exact for the bounds up to 32 bits, and rounds
+   the 64-bit ones up to the first value out of range */
+#define NUM_SAT_ROUND(fn, to_type, from_type, lo, hi, round_fn) \
+    static void \
+    fn (to_type *dst, const from_type *src, size_t size, \
+        to_type nan_v) { \
+      size_t rest; \
+      to_type *dp; \
+      const from_type *sp; \
+      for (rest = size, dp = dst, sp = src; \
+           rest > 0; \
+           rest--, dp++, sp++) { \
+        const double r = round_fn ((double)*sp); \
+        *dp = (isnan (r) ? nan_v \
+               : r <= (double)(lo) ? (lo) \
+               : r >= (double)(hi) ? (hi) \
+               : (to_type)r); \
+      } \
+    }
+
+#define NUM_SAT(fn, to_type, from_type, lo, hi, simd, kernel) \
+    NUM_SAT_ROUND (fn ## _nearest, to_type, from_type, lo, hi, \
+                   nearbyint) \
+    NUM_SAT_ROUND (fn ## _trunc,   to_type, from_type, lo, hi, trunc) \
+    NUM_SAT_ROUND (fn ## _floor,   to_type, from_type, lo, hi, floor) \
+    void \
+    fn (to_type *dst, const from_type *src, size_t size, \
+        enum nconv_rounding rounding, \
+        const to_type *map_from_nan) { \
+      const to_type nan_v = (map_from_nan != 0 ? *map_from_nan : 0); \
+      const size_t done \
+        = simd (kernel, dst, src, size, rounding, nan_v); \
+      switch (rounding) { \
+      case NCONV_ROUND_TRUNC: \
+        fn ## _trunc   (dst + done, src + done, size - done, nan_v); \
+        break; \
+      case NCONV_ROUND_FLOOR: \
+        fn ## _floor   (dst + done, src + done, size - done, nan_v); \
+        break; \
+      default: \
+        fn ## _nearest (dst + done, src + done, size - done, nan_v); \
+        break; \
+      } \
+    }
+
+#ifdef __SSE2__
+
+/* NB: the SSE2 kernels below cover the 8- and 16-bit destinations:
+   the values are clamped in the floating-point domain (where all the
+   bounds are exact), rounded, converted to 32-bit integers, and then
+   narrowed with the packed saturating instructions; NaN is replaced
+   with the mapped value before clamping.  The ``nearest'' rounding
+   relies on MXCSR being in its default (round to nearest) mode */
+
+static inline __m128d
+sat_prep_pd (__m128d x, __m128d lo, __m128d hi, __m128d nan_v,
+             int rounding)
+{
+  const __m128d nan_p = _mm_cmpunord_pd (x, x);
+  x = _mm_or_pd (_mm_andnot_pd (nan_p, x), _mm_and_pd (nan_p, nan_v));
+  x = _mm_min_pd (_mm_max_pd (x, lo), hi);
+  if (rounding == NCONV_ROUND_FLOOR) {
+    const __m128d t = _mm_cvtepi32_pd (_mm_cvttpd_epi32 (x));
+    x = _mm_sub_pd (t, _mm_and_pd (_mm_cmpgt_pd (t, x),
+                                   _mm_set1_pd (1.)));
+  }
+  /* . */
+  return x;
+}
+
+/* convert 4 doubles to 4 clamped 32-bit integers */
+static inline __m128i
+sat_cvt4_pd (const double *src, __m128d lo, __m128d hi, __m128d nan_v,
+             int rounding)
+{
+  const __m128d
+    a = sat_prep_pd (_mm_loadu_pd (src),     lo, hi, nan_v, rounding),
+    b = sat_prep_pd (_mm_loadu_pd (src + 2), lo, hi, nan_v, rounding);
+  const __m128i
+    ia = (rounding == NCONV_ROUND_NEAREST
+          ? _mm_cvtpd_epi32 (a) : _mm_cvttpd_epi32 (a)),
+    ib = (rounding == NCONV_ROUND_NEAREST
+          ? _mm_cvtpd_epi32 (b) : _mm_cvttpd_epi32 (b));
+  /* . */
+  return _mm_unpacklo_epi64 (ia, ib);
+}
+
+/* convert 4 floats to 4 clamped 32-bit integers */
+static inline __m128i
+sat_cvt4_ps (const float *src, __m128 lo, __m128 hi, __m128 nan_v,
+             int rounding)
+{
+  __m128 x = _mm_loadu_ps (src);
+  const __m128 nan_p = _mm_cmpunord_ps (x, x);
+  x = _mm_or_ps (_mm_andnot_ps (nan_p, x), _mm_and_ps (nan_p, nan_v));
+  x = _mm_min_ps (_mm_max_ps (x, lo), hi);
+  if (rounding == NCONV_ROUND_FLOOR) {
+    const __m128 t = _mm_cvtepi32_ps (_mm_cvttps_epi32 (x));
+    x = _mm_sub_ps (t, _mm_and_ps (_mm_cmpgt_ps (t, x),
+                                   _mm_set1_ps (1.f)));
+  }
+  /* . */
+  return (rounding == NCONV_ROUND_NEAREST
+          ? _mm_cvtps_epi32 (x) : _mm_cvttps_epi32 (x));
+}
+
+#define NUM_SAT_SIMD_KERNEL(fn, to_type, from_type, vtype, sfx, \
+                            lo, hi, pack) \
+    static size_t \
+    fn (to_type *dst, const from_type *src, size_t size, \
+        int rounding, to_type nan_v) { \
+      const vtype \
+        l_v = _mm_set1_ ## sfx (lo), \
+        h_v = _mm_set1_ ## sfx (hi), \
+        n_v = _mm_set1_ ## sfx (nan_v); \
+      size_t done; \
+      for (done = 0; done + 16 <= size; done += 16) { \
+        const from_type *sp = src + done; \
+        const __m128i \
+          q0 = sat_cvt4_ ## sfx (sp,      l_v, h_v, n_v, rounding), \
+          q1 = sat_cvt4_ ## sfx (sp + 4,  l_v, h_v, n_v, rounding), \
+          q2 = sat_cvt4_ ## sfx (sp + 8,  l_v, h_v, n_v, rounding), \
+          q3 = sat_cvt4_ ## sfx (sp + 12, l_v, h_v, n_v, rounding); \
+        pack (dst + done, q0, q1, q2, q3); \
+      } \
+      /* . */ \
+      return done; \
+    }
+
+static inline void
+sat_pack_int8 (int8_t *dst,
+               __m128i q0, __m128i q1, __m128i q2, __m128i q3)
+{
+  _mm_storeu_si128 ((__m128i *)dst,
+                    _mm_packs_epi16 (_mm_packs_epi32 (q0, q1),
+                                     _mm_packs_epi32 (q2, q3)));
+}
+
+static inline void
+sat_pack_uint8 (uint8_t *dst,
+                __m128i q0, __m128i q1, __m128i q2, __m128i q3)
+{
+  _mm_storeu_si128 ((__m128i *)dst,
+                    _mm_packus_epi16 (_mm_packs_epi32 (q0, q1),
+                                      _mm_packs_epi32 (q2, q3)));
+}
+
+static inline void
+sat_pack_int16 (int16_t *dst,
+                __m128i q0, __m128i q1, __m128i q2, __m128i q3)
+{
+  _mm_storeu_si128 ((__m128i *)dst,       _mm_packs_epi32 (q0, q1));
+  _mm_storeu_si128 ((__m128i *)(dst + 8), _mm_packs_epi32 (q2, q3));
+}
+
+/* NB: SSE2 has no unsigned 32 -> 16 pack; bias into the signed range */
+static inline void
+sat_pack_uint16 (uint16_t *dst,
+                 __m128i q0, __m128i q1, __m128i q2, __m128i q3)
+{
+  const __m128i
+    b32 = _mm_set1_epi32 (0x8000),
+    b16 = _mm_set1_epi16 ((short)0x8000);
+  _mm_storeu_si128 ((__m128i *)dst,
+                    _mm_xor_si128 (_mm_packs_epi32
+                                   (_mm_sub_epi32 (q0, b32),
+                                    _mm_sub_epi32 (q1, b32)),
+                                   b16));
+  _mm_storeu_si128 ((__m128i *)(dst + 8),
+                    _mm_xor_si128 (_mm_packs_epi32
+                                   (_mm_sub_epi32 (q2, b32),
+                                    _mm_sub_epi32 (q3, b32)),
+                                   b16));
+}
+
+NUM_SAT_SIMD_KERNEL (sat_simd_int8_t_from_double,    int8_t,   double,
+                     __m128d, pd, INT8_MIN,  INT8_MAX,
+                     sat_pack_int8)
+NUM_SAT_SIMD_KERNEL (sat_simd_int16_t_from_double,   int16_t,  double,
+                     __m128d, pd, INT16_MIN, INT16_MAX,
+                     sat_pack_int16)
+NUM_SAT_SIMD_KERNEL (sat_simd_uint8_t_from_double,   uint8_t,  double,
+                     __m128d, pd, 0,         UINT8_MAX,
+                     sat_pack_uint8)
+NUM_SAT_SIMD_KERNEL (sat_simd_uint16_t_from_double,  uint16_t, double,
+                     __m128d, pd, 0,         UINT16_MAX,
+                     sat_pack_uint16)
+NUM_SAT_SIMD_KERNEL (sat_simd_int8_t_from_float,     int8_t,   float,
+                     __m128,  ps, INT8_MIN,  INT8_MAX,
+                     sat_pack_int8)
+NUM_SAT_SIMD_KERNEL (sat_simd_int16_t_from_float,    int16_t,  float,
+                     __m128,  ps, INT16_MIN, INT16_MAX,
+                     sat_pack_int16)
+NUM_SAT_SIMD_KERNEL (sat_simd_uint8_t_from_float,    uint8_t,  float,
+                     __m128,  ps, 0,         UINT8_MAX,
+                     sat_pack_uint8)
+NUM_SAT_SIMD_KERNEL (sat_simd_uint16_t_from_float,   uint16_t, float,
+                     __m128,  ps, 0,         UINT16_MAX,
+                     sat_pack_uint16)
+
+#define SAT_SIMD(kernel, dst, src, size, rounding, nan_v) \
+    kernel (dst, src, size, rounding, nan_v)
+#else
+#define SAT_SIMD(kernel, dst, src, size, rounding, nan_v) 0
+#endif
+
+/* NB: no SIMD kernels for the 32- and 64-bit destinations */
+#define SAT_NO_SIMD(kernel, dst, src, size, rounding, nan_v) 0
+
+NUM_SAT (nconv_sat_int8_t_from_double,   int8_t,   double,
+         INT8_MIN,  INT8_MAX,   SAT_SIMD, sat_simd_int8_t_from_double)
+NUM_SAT (nconv_sat_int16_t_from_double,  int16_t,  double,
+         INT16_MIN, INT16_MAX,  SAT_SIMD, sat_simd_int16_t_from_double)
+NUM_SAT (nconv_sat_int32_t_from_double,  int32_t,  double,
+         INT32_MIN, INT32_MAX,  SAT_NO_SIMD, 0)
+NUM_SAT (nconv_sat_int64_t_from_double,  int64_t,  double,
+         INT64_MIN, INT64_MAX,  SAT_NO_SIMD, 0)
+NUM_SAT (nconv_sat_uint8_t_from_double,  uint8_t,  double,
+         0,         UINT8_MAX,  SAT_SIMD, sat_simd_uint8_t_from_double)
+NUM_SAT (nconv_sat_uint16_t_from_double, uint16_t, double,
+         0,         UINT16_MAX, SAT_SIMD, sat_simd_uint16_t_from_double)
+NUM_SAT (nconv_sat_uint32_t_from_double, uint32_t, double,
+         0,         UINT32_MAX, SAT_NO_SIMD, 0)
+NUM_SAT (nconv_sat_uint64_t_from_double, uint64_t, double,
+         0,         UINT64_MAX, SAT_NO_SIMD, 0)
+
+NUM_SAT (nconv_sat_int8_t_from_float,    int8_t,   float,
+         INT8_MIN,  INT8_MAX,   SAT_SIMD, sat_simd_int8_t_from_float)
+NUM_SAT (nconv_sat_int16_t_from_float,   int16_t,  float,
+         INT16_MIN, INT16_MAX,  SAT_SIMD, sat_simd_int16_t_from_float)
+NUM_SAT (nconv_sat_int32_t_from_float,   int32_t,  float,
+         INT32_MIN, INT32_MAX,  SAT_NO_SIMD, 0)
+NUM_SAT (nconv_sat_int64_t_from_float,   int64_t,  float,
+         INT64_MIN, INT64_MAX,  SAT_NO_SIMD, 0)
+NUM_SAT (nconv_sat_uint8_t_from_float,   uint8_t,  float,
+         0,         UINT8_MAX,  SAT_SIMD, sat_simd_uint8_t_from_float)
+NUM_SAT (nconv_sat_uint16_t_from_float,  uint16_t, float,
+         0,         UINT16_MAX, SAT_SIMD, sat_simd_uint16_t_from_float)
+NUM_SAT (nconv_sat_uint32_t_from_float,  uint32_t, float,
+         0,         UINT32_MAX, SAT_NO_SIMD, 0)
+NUM_SAT (nconv_sat_uint64_t_from_float,  uint64_t, float,
+         0,         UINT64_MAX, SAT_NO_SIMD, 0)
+
+/** Packed integers (scale factor and add offset) */
+
+#define NUM_UNPACK(fn, to_type, from_type, simd, kernel) \
+    void \
+    fn (to_type *dst, const from_type *src, size_t size, \
+        double scale, double offset, const from_type *fill) { \
+      const to_type s = scale, o = offset; \
+      const int fill_p = (fill != 0); \
+      const from_type f = (fill_p ? *fill : 0); \
+      size_t rest; \
+      to_type *dp; \
+      const from_type *sp; \
+      const size_t done \
+        = simd (kernel, dst, src, size, s, o, fill_p, f); \
+      for (rest = size - done, dp = dst + done, sp = src + done; \
+           rest > 0; \
+           rest--, dp++, sp++) { \
+        const to_type v = s * (to_type)*sp + o; \
+        *dp = (fill_p && *sp == f) ? NAN : v; \
+      } \
+    }
+
+/* NB: (VALUE - OFFSET) / SCALE is computed into a small buffer, which
+   is then handed to the saturating coercion; a value is never packed
+   to the fill DN (which would be read back as NaN), but to the next
+   DN towards the value (inwards, at the bounds of the type) */
+#define NUM_PACK(fn, to_type, from_type, lo, hi) \
+    void \
+    fn (to_type *dst, const from_type *src, size_t size, \
+        double scale, double offset, enum nconv_rounding rounding, \
+        const to_type *fill) { \
+      double buf[PACK_BUF_SZ]; \
+      size_t rest; \
+      to_type *dp; \
+      const from_type *sp; \
+      for (rest = size, dp = dst, sp = src; rest > 0; ) { \
+        const size_t n = (rest < PACK_BUF_SZ ? rest : PACK_BUF_SZ); \
+        size_t i; \
+        for (i = 0; i < n; i++) { \
+          buf[i] = ((double)sp[i] - offset) / scale; \
+        } \
+        nconv_sat_ ## to_type ## _from_double (dp, buf, n, \
+                                               rounding, fill); \
+        for (i = 0; fill != 0 && i < n; i++) { \
+          if (dp[i] == *fill && ! isnan (buf[i])) { \
+            dp[i] = ((*fill == (hi) \
+                      || (*fill != (lo) && buf[i] < (double)*fill)) \
+                     ? (to_type)(*fill - 1) : (to_type)(*fill + 1)); \
+          } \
+        } \
+        rest -= n, dp += n, sp += n; \
+      } \
+    }
+
+#define PACK_BUF_SZ 512
+
+#ifdef __SSE2__
+
+/* NB: the SSE2 kernels below cover the 8- and 16-bit sources: 8 DN's
+   are widened to two vectors of 32-bit integers, converted, and then
+   scaled; the fill mask is computed on the widened values */
+
+static inline void
+unpack_widen_int16 (const int16_t *src, __m128i *lo, __m128i *hi)
+{
+  const __m128i x = _mm_loadu_si128 ((const __m128i *)src);
+  *lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (x, x), 16);
+  *hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (x, x), 16);
+}
+
+static inline void
+unpack_widen_uint16 (const uint16_t *src, __m128i *lo, __m128i *hi)
+{
+  const __m128i x = _mm_loadu_si128 ((const __m128i *)src);
+  *lo = _mm_unpacklo_epi16 (x, _mm_setzero_si128 ());
+  *hi = _mm_unpackhi_epi16 (x, _mm_setzero_si128 ());
+}
+
+static inline void
+unpack_widen_int8 (const int8_t *src, __m128i *lo, __m128i *hi)
+{
+  const __m128i
+    x = _mm_loadl_epi64 ((const __m128i *)src),
+    w = _mm_srai_epi16 (_mm_unpacklo_epi8 (x, x), 8);
+  *lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (w, w), 16);
+  *hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (w, w), 16);
+}
+
+static inline void
+unpack_widen_uint8 (const uint8_t *src, __m128i *lo, __m128i *hi)
+{
+  const __m128i
+    x = _mm_loadl_epi64 ((const __m128i *)src),
+    w = _mm_unpacklo_epi8 (x, _mm_setzero_si128 ());
+  *lo = _mm_unpacklo_epi16 (w, _mm_setzero_si128 ());
+  *hi = _mm_unpackhi_epi16 (w, _mm_setzero_si128 ());
+}
+
+/* store 4 unpacked values, masked with NaN */
+static inline void
+unpack_emit_ps (float *dst, __m128i v, __m128i m,
+                __m128 s, __m128 o, __m128 nan_v)
+{
+  const __m128
+    x = _mm_add_ps (_mm_mul_ps (_mm_cvtepi32_ps (v), s), o),
+    mf = _mm_castsi128_ps (m);
+  _mm_storeu_ps (dst, _mm_or_ps (_mm_andnot_ps (mf, x),
+                                 _mm_and_ps (mf, nan_v)));
+}
+
+static inline void
+unpack_emit_pd (double *dst, __m128i v, __m128i m,
+                __m128d s, __m128d o, __m128d nan_v)
+{
+  const __m128i
+    v_hi = _mm_shuffle_epi32 (v, _MM_SHUFFLE (3, 2, 3, 2));
+  const __m128d
+    a  = _mm_add_pd (_mm_mul_pd (_mm_cvtepi32_pd (v),    s), o),
+    b  = _mm_add_pd (_mm_mul_pd (_mm_cvtepi32_pd (v_hi), s), o),
+    ma = _mm_castsi128_pd (_mm_unpacklo_epi32 (m, m)),
+    mb = _mm_castsi128_pd (_mm_unpackhi_epi32 (m, m));
+  _mm_storeu_pd (dst,     _mm_or_pd (_mm_andnot_pd (ma, a),
+                                     _mm_and_pd (ma, nan_v)));
+  _mm_storeu_pd (dst + 2, _mm_or_pd (_mm_andnot_pd (mb, b),
+                                     _mm_and_pd (mb, nan_v)));
+}
+
+#define NUM_UNPACK_SIMD_KERNEL(fn, to_type, from_type, vtype, sfx, \
+                               widen) \
+    static size_t \
+    fn (to_type *dst, const from_type *src, size_t size, \
+        to_type scale, to_type offset, int fill_p, from_type fill) { \
+      const vtype \
+        s_v = _mm_set1_ ## sfx (scale), \
+        o_v = _mm_set1_ ## sfx (offset), \
+        n_v = _mm_set1_ ## sfx (NAN); \
+      const __m128i f_v = _mm_set1_epi32 (fill); \
+      size_t done; \
+      for (done = 0; done + 8 <= size; done += 8) { \
+        __m128i lo, hi, m_lo, m_hi; \
+        widen (src + done, &lo, &hi); \
+        if (fill_p) { \
+          m_lo = _mm_cmpeq_epi32 (lo, f_v); \
+          m_hi = _mm_cmpeq_epi32 (hi, f_v); \
+        } else { \
+          m_lo = m_hi = _mm_setzero_si128 (); \
+        } \
+        unpack_emit_ ## sfx (dst + done,     lo, m_lo, s_v, o_v, n_v); \
+        unpack_emit_ ## sfx (dst + done + 4, hi, m_hi, s_v, o_v, n_v); \
+      } \
+      /* . */ \
+      return done; \
+    }
+
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_double_from_int8_t,
+                        double, int8_t,
+                        __m128d, pd, unpack_widen_int8)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_double_from_int16_t,
+                        double, int16_t,
+                        __m128d, pd, unpack_widen_int16)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_double_from_uint8_t,
+                        double, uint8_t,
+                        __m128d, pd, unpack_widen_uint8)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_double_from_uint16_t,
+                        double, uint16_t,
+                        __m128d, pd, unpack_widen_uint16)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_float_from_int8_t,
+                        float, int8_t,
+                        __m128, ps, unpack_widen_int8)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_float_from_int16_t,
+                        float, int16_t,
+                        __m128, ps, unpack_widen_int16)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_float_from_uint8_t,
+                        float, uint8_t,
+                        __m128, ps, unpack_widen_uint8)
+NUM_UNPACK_SIMD_KERNEL (unpack_simd_float_from_uint16_t,
+                        float, uint16_t,
+                        __m128, ps, unpack_widen_uint16)
+
+#define UNPACK_SIMD(kernel, dst, src, size, s, o, fill_p, f) \
+    kernel (dst, src, size, s, o, fill_p, f)
+#else
+#define UNPACK_SIMD(kernel, dst, src, size, s, o, fill_p, f) 0
+#endif
+
+/* NB: no SIMD kernels for the 32- and 64-bit sources */
+#define UNPACK_NO_SIMD(kernel, dst, src, size, s, o, fill_p, f) 0
+
+NUM_UNPACK (nconv_unpack_double_from_int8_t, double, int8_t,
+            UNPACK_SIMD, unpack_simd_double_from_int8_t)
+NUM_UNPACK (nconv_unpack_double_from_int16_t, double, int16_t,
+            UNPACK_SIMD, unpack_simd_double_from_int16_t)
+NUM_UNPACK (nconv_unpack_double_from_int32_t, double, int32_t,
+            UNPACK_NO_SIMD, 0)
+NUM_UNPACK (nconv_unpack_double_from_int64_t, double, int64_t,
+            UNPACK_NO_SIMD, 0)
+NUM_UNPACK (nconv_unpack_double_from_uint8_t, double, uint8_t,
+            UNPACK_SIMD, unpack_simd_double_from_uint8_t)
+NUM_UNPACK (nconv_unpack_double_from_uint16_t, double, uint16_t,
+            UNPACK_SIMD, unpack_simd_double_from_uint16_t)
+NUM_UNPACK (nconv_unpack_double_from_uint32_t, double, uint32_t,
+            UNPACK_NO_SIMD, 0)
+NUM_UNPACK (nconv_unpack_double_from_uint64_t, double, uint64_t,
+            UNPACK_NO_SIMD, 0)
+
+NUM_UNPACK (nconv_unpack_float_from_int8_t, float, int8_t,
+            UNPACK_SIMD, unpack_simd_float_from_int8_t)
+NUM_UNPACK (nconv_unpack_float_from_int16_t, float, int16_t,
+            UNPACK_SIMD, unpack_simd_float_from_int16_t)
+NUM_UNPACK (nconv_unpack_float_from_int32_t, float, int32_t,
+            UNPACK_NO_SIMD, 0)
+NUM_UNPACK (nconv_unpack_float_from_int64_t, float, int64_t,
+            UNPACK_NO_SIMD, 0)
+NUM_UNPACK (nconv_unpack_float_from_uint8_t, float, uint8_t,
+            UNPACK_SIMD, unpack_simd_float_from_uint8_t)
+NUM_UNPACK (nconv_unpack_float_from_uint16_t, float, uint16_t,
+            UNPACK_SIMD, unpack_simd_float_from_uint16_t)
+NUM_UNPACK (nconv_unpack_float_from_uint32_t, float, uint32_t,
+            UNPACK_NO_SIMD, 0)
+NUM_UNPACK (nconv_unpack_float_from_uint64_t, float, uint64_t,
+            UNPACK_NO_SIMD, 0)
+
+NUM_PACK (nconv_pack_int8_t_from_double,   int8_t,   double,
+          INT8_MIN,  INT8_MAX)
+NUM_PACK (nconv_pack_int16_t_from_double,  int16_t,  double,
+          INT16_MIN, INT16_MAX)
+NUM_PACK (nconv_pack_int32_t_from_double,  int32_t,  double,
+          INT32_MIN, INT32_MAX)
+NUM_PACK (nconv_pack_int64_t_from_double,  int64_t,  double,
+          INT64_MIN, INT64_MAX)
+NUM_PACK (nconv_pack_uint8_t_from_double,  uint8_t,  double,
+          0,         UINT8_MAX)
+NUM_PACK (nconv_pack_uint16_t_from_double, uint16_t, double,
+          0,         UINT16_MAX)
+NUM_PACK (nconv_pack_uint32_t_from_double, uint32_t, double,
+          0,         UINT32_MAX)
+NUM_PACK (nconv_pack_uint64_t_from_double, uint64_t, double,
+          0,         UINT64_MAX)
+
+NUM_PACK (nconv_pack_int8_t_from_float,    int8_t,   float,
+          INT8_MIN,  INT8_MAX)
+NUM_PACK (nconv_pack_int16_t_from_float,   int16_t,  float,
+          INT16_MIN, INT16_MAX)
+NUM_PACK (nconv_pack_int32_t_from_float,   int32_t,  float,
+          INT32_MIN, INT32_MAX)
+NUM_PACK (nconv_pack_int64_t_from_float,   int64_t,  float,
+          INT64_MIN, INT64_MAX)
+NUM_PACK (nconv_pack_uint8_t_from_float,   uint8_t,  float,
+          0,         UINT8_MAX)
+NUM_PACK (nconv_pack_uint16_t_from_float,  uint16_t, float,
+          0,         UINT16_MAX)
+NUM_PACK (nconv_pack_uint32_t_from_float,  uint32_t, float,
+          0,         UINT32_MAX)
+NUM_PACK (nconv_pack_uint64_t_from_float,  uint64_t, float,
+          0,         UINT64_MAX)
+
 /*** Emacs stuff */
 /** Local variables: */
 /** fill-column: 72 */
@@ -102,7 +102,7 @@ void nconv_nan_double_from_float    (double *dst, const float *src,
                                      const float *const map_to_nan);
 void nconv_nan_double_from_double   (double *dst, const double *src,
                                      size_t size,
-                                     const float *const map_to_nan);
+                                     const double *const map_to_nan);
 
 void nconv_nan_float_from_int8_t    (float *dst, const int8_t *src,
                                      size_t size,
@@ -137,6 +137,249 @@ void nconv_nan_float_from_float     (float *dst, const float *src,
                                      size_t size,
                                      const float *const map_to_nan);
 
+/** Saturating coercion to integers, with rounding */
+
+enum nconv_rounding {
+  /* round to nearest, ties to even */
+  NCONV_ROUND_NEAREST = 0,
+  /* round towards zero */
+  NCONV_ROUND_TRUNC,
+  /* round towards minus infinity */
+  NCONV_ROUND_FLOOR,
+  NCONV_ROUND_MAX
+};
+
+/* NB: the values out of the range of the destination type are mapped
+   to the nearest bound; NaN is mapped to *map_from_nan, or to 0 if
+   map_from_nan is a null pointer */
+
+void nconv_sat_int8_t_from_double   (int8_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int8_t *map_from_nan);
+void nconv_sat_int16_t_from_double  (int16_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int16_t *map_from_nan);
+void nconv_sat_int32_t_from_double  (int32_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int32_t *map_from_nan);
+void nconv_sat_int64_t_from_double  (int64_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int64_t *map_from_nan);
+void nconv_sat_uint8_t_from_double  (uint8_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint8_t *map_from_nan);
+void nconv_sat_uint16_t_from_double (uint16_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint16_t *map_from_nan);
+void nconv_sat_uint32_t_from_double (uint32_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint32_t *map_from_nan);
+void nconv_sat_uint64_t_from_double (uint64_t *dst, const double *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint64_t *map_from_nan);
+
+void nconv_sat_int8_t_from_float    (int8_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int8_t *map_from_nan);
+void nconv_sat_int16_t_from_float   (int16_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int16_t *map_from_nan);
+void nconv_sat_int32_t_from_float   (int32_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int32_t *map_from_nan);
+void nconv_sat_int64_t_from_float   (int64_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const int64_t *map_from_nan);
+void nconv_sat_uint8_t_from_float   (uint8_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint8_t *map_from_nan);
+void nconv_sat_uint16_t_from_float  (uint16_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint16_t *map_from_nan);
+void nconv_sat_uint32_t_from_float  (uint32_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint32_t *map_from_nan);
+void nconv_sat_uint64_t_from_float  (uint64_t *dst, const float *src,
+                                     size_t size,
+                                     enum nconv_rounding rounding,
+                                     const uint64_t *map_from_nan);
+
+/** Packed integers (scale factor and add offset) */
+
+/* NB: the unpacked value is SCALE * DN + OFFSET; the DN's equal to
+   *fill (unless fill is a null pointer) are unpacked to NaN.  The
+   arithmetic is done in the precision of the destination type */
+
+void nconv_unpack_double_from_int8_t  (double *dst, const int8_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int8_t *fill);
+void nconv_unpack_double_from_int16_t (double *dst, const int16_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int16_t *fill);
+void nconv_unpack_double_from_int32_t (double *dst, const int32_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int32_t *fill);
+void nconv_unpack_double_from_int64_t (double *dst, const int64_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int64_t *fill);
+void nconv_unpack_double_from_uint8_t (double *dst, const uint8_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const uint8_t *fill);
+void nconv_unpack_double_from_uint16_t (double *dst,
+                                        const uint16_t *src,
+                                        size_t size,
+                                        double scale, double offset,
+                                        const uint16_t *fill);
+void nconv_unpack_double_from_uint32_t (double *dst,
+                                        const uint32_t *src,
+                                        size_t size,
+                                        double scale, double offset,
+                                        const uint32_t *fill);
+void nconv_unpack_double_from_uint64_t (double *dst,
+                                        const uint64_t *src,
+                                        size_t size,
+                                        double scale, double offset,
+                                        const uint64_t *fill);
+
+void nconv_unpack_float_from_int8_t   (float *dst, const int8_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int8_t *fill);
+void nconv_unpack_float_from_int16_t  (float *dst, const int16_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int16_t *fill);
+void nconv_unpack_float_from_int32_t  (float *dst, const int32_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int32_t *fill);
+void nconv_unpack_float_from_int64_t  (float *dst, const int64_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const int64_t *fill);
+void nconv_unpack_float_from_uint8_t  (float *dst, const uint8_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const uint8_t *fill);
+void nconv_unpack_float_from_uint16_t (float *dst, const uint16_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const uint16_t *fill);
+void nconv_unpack_float_from_uint32_t (float *dst, const uint32_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const uint32_t *fill);
+void nconv_unpack_float_from_uint64_t (float *dst, const uint64_t *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       const uint64_t *fill);
+
+/* NB: packing is the inverse of the above, i. e., DN is
+   (VALUE - OFFSET) / SCALE, rounded and saturated as for the
+   nconv_sat_* functions, with NaN packed to *fill (or 0) */
+
+void nconv_pack_int8_t_from_double    (int8_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int8_t *fill);
+void nconv_pack_int16_t_from_double   (int16_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int16_t *fill);
+void nconv_pack_int32_t_from_double   (int32_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int32_t *fill);
+void nconv_pack_int64_t_from_double   (int64_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int64_t *fill);
+void nconv_pack_uint8_t_from_double   (uint8_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint8_t *fill);
+void nconv_pack_uint16_t_from_double  (uint16_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint16_t *fill);
+void nconv_pack_uint32_t_from_double  (uint32_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint32_t *fill);
+void nconv_pack_uint64_t_from_double  (uint64_t *dst, const double *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint64_t *fill);
+
+void nconv_pack_int8_t_from_float     (int8_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int8_t *fill);
+void nconv_pack_int16_t_from_float    (int16_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int16_t *fill);
+void nconv_pack_int32_t_from_float    (int32_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int32_t *fill);
+void nconv_pack_int64_t_from_float    (int64_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const int64_t *fill);
+void nconv_pack_uint8_t_from_float    (uint8_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint8_t *fill);
+void nconv_pack_uint16_t_from_float   (uint16_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint16_t *fill);
+void nconv_pack_uint32_t_from_float   (uint32_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint32_t *fill);
+void nconv_pack_uint64_t_from_float   (uint64_t *dst, const float *src,
+                                       size_t size,
+                                       double scale, double offset,
+                                       enum nconv_rounding rounding,
+                                       const uint64_t *fill);
+
 #endif
 /*** Emacs stuff */
 /** Local variables: */
@@ -0,0 +1,439 @@
+/*** numcov.c --- Streaming Covariance  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <float.h>              /* for DBL_EPSILON */
+#include <math.h>               /* for NAN, sqrt () */
+#include <pthread.h>            /* for pthread_once () */
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>             /* for memset () */
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "numcov.h"
+
+/* NB: the vectors are taken by the blocks of this many, so that the
+   elements of a block are contiguous once transposed */
+#define BLOCK_VECTORS 256
+/* NB: the elements (and the vectors of a block) are padded with zeros
+   to a multiple of this */
+#define PAD 4
+#define PADDED(n) (((n) + PAD - 1) / PAD * PAD)
+
+/* NB: X - X is zero for the finite values only */
+#define FINITE_P(x) ((x) - (x) == 0)
+
+/* NB: give up on the rotations if they don't converge in as many
+   sweeps (which they do in ten or so) */
+#define JACOBI_SWEEPS 64
+
+/*** Block kernels */
+
+/* NB: the kernels fill in P[I * N + J], J >= I, with the products of
+   the planes I and J of D, each LENGTH long (a multiple of PAD) and
+   STRIDE apart; the planes from N to PADDED (N) are zeros */
+
+static void
+products_generic (double *p, const double *d, size_t n,
+                  size_t stride, size_t length)
+{
+  size_t i, j, k;
+  for (i = 0; i < n; i++) {
+    const double *a = d + i * stride;
+    for (j = i; j < n; j++) {
+      const double *b = d + j * stride;
+      double s[4] = { 0, 0, 0, 0 };
+      for (k = 0; k < length; k += 4) {
+        s[0] += a[k]     * b[k];
+        s[1] += a[k + 1] * b[k + 1];
+        s[2] += a[k + 2] * b[k + 2];
+        s[3] += a[k + 3] * b[k + 3];
+      }
+      p[i * n + j] = (s[0] + s[1]) + (s[2] + s[3]);
+    }
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+#define AVX2_FMA __attribute__ ((target ("avx2,fma")))
+
+static inline AVX2_FMA double
+hsum_avx2 (__m256d v)
+{
+  const __m128d
+    h = _mm_add_pd (_mm256_castpd256_pd128 (v),
+                    _mm256_extractf128_pd (v, 1));
+
+  /* . */
+  return _mm_cvtsd_f64 (_mm_add_sd (h, _mm_unpackhi_pd (h, h)));
+}
+
+/* NB: the tiles of 2 x 4 products, or 8 accumulators, for 6 loads;
+   the tiles wholly below the diagonal are skipped */
+static AVX2_FMA void
+products_avx2 (double *p, const double *d, size_t n,
+               size_t stride, size_t length)
+{
+  size_t i, j, k, r, q;
+  for (i = 0; i < n; i += 2) {
+    const double *a0 = d + i * stride, *a1 = a0 + stride;
+    for (j = i - i % PAD; j < n; j += 4) {
+      const double
+        *b0 = d + j * stride, *b1 = b0 + stride,
+        *b2 = b1 + stride, *b3 = b2 + stride;
+      __m256d
+        c00 = _mm256_setzero_pd (), c01 = c00, c02 = c00, c03 = c00,
+        c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+      for (k = 0; k < length; k += 4) {
+        const __m256d
+          x0 = _mm256_load_pd (a0 + k), x1 = _mm256_load_pd (a1 + k),
+          y0 = _mm256_load_pd (b0 + k), y1 = _mm256_load_pd (b1 + k),
+          y2 = _mm256_load_pd (b2 + k), y3 = _mm256_load_pd (b3 + k);
+        c00 = _mm256_fmadd_pd (x0, y0, c00);
+        c01 = _mm256_fmadd_pd (x0, y1, c01);
+        c02 = _mm256_fmadd_pd (x0, y2, c02);
+        c03 = _mm256_fmadd_pd (x0, y3, c03);
+        c10 = _mm256_fmadd_pd (x1, y0, c10);
+        c11 = _mm256_fmadd_pd (x1, y1, c11);
+        c12 = _mm256_fmadd_pd (x1, y2, c12);
+        c13 = _mm256_fmadd_pd (x1, y3, c13);
+      }
+      {
+        const __m256d acc[2][4] = {
+          { c00, c01, c02, c03 }, { c10, c11, c12, c13 }
+        };
+        for (r = 0; r < 2 && i + r < n; r++) {
+          for (q = 0; q < 4 && j + q < n; q++) {
+            if (j + q >= i + r) {
+              p[(i + r) * n + j + q] = hsum_avx2 (acc[r][q]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif
+
+/*** Initializing */
+
+int
+ncov_init (struct ncov *cv, size_t size)
+{
+  const size_t block = PADDED (size) * BLOCK_VECTORS;
+
+  cv->size  = size;
+  cv->count = cv->skipped_count = 0;
+  cv->mean  = cv->m2 = cv->block = cv->products = 0;
+  if ((cv->mean = calloc (size, sizeof (*(cv->mean)))) == 0
+      || (cv->m2 = calloc (size * size, sizeof (*(cv->m2)))) == 0
+      || (cv->products
+          = malloc (size * size * sizeof (*(cv->products)))) == 0) {
+    ncov_free (cv);
+    /* . */
+    return -1;
+  }
+  /* NB: aligned for the SIMD loads; the padding stays zero */
+  if (posix_memalign ((void **)&(cv->block), 32,
+                      block * sizeof (*(cv->block)))
+      != 0) {
+    cv->block = 0;
+    ncov_free (cv);
+    errno = ENOMEM;
+    /* . */
+    return -1;
+  }
+  memset (cv->block, 0, block * sizeof (*(cv->block)));
+
+  /* . */
+  return 0;
+}
+
+void
+ncov_free (struct ncov *cv)
+{
+  free (cv->mean);
+  free (cv->m2);
+  free (cv->block);
+  free (cv->products);
+  cv->mean = cv->m2 = cv->block = cv->products = 0;
+}
+
+/*** Accumulating */
+
+/* NB: the moments of COUNT more vectors are merged in (Chan et al.) */
+static void
+merge_moments (struct ncov *cv, const double *mean, const double *m2,
+               uint64_t count)
+{
+  const size_t n = cv->size;
+  const double na = cv->count, nb = count, total = na + nb;
+  double delta[n];
+  size_t i, j;
+
+  for (i = 0; i < n; i++) {
+    delta[i] = mean[i] - cv->mean[i];
+  }
+  for (i = 0; i < n; i++) {
+    const double f = delta[i] * na * nb / total;
+    for (j = i; j < n; j++) {
+      cv->m2[i * n + j] += m2[i * n + j] + f * delta[j];
+    }
+    cv->mean[i] += delta[i] * nb / total;
+  }
+  cv->count += count;
+}
+
+static void
+add_block (struct ncov *cv, const double *vec, size_t count,
+           void (*kernel) (double *, const double *, size_t,
+                           size_t, size_t))
+{
+  const size_t n = cv->size;
+  double *d = cv->block, mean[n];
+  size_t i, k, kept, length;
+
+  /* NB: the vectors with NaN's or infinities are left out */
+  for (k = 0, kept = 0; k < count; k++) {
+    const double *v = vec + k * n;
+    for (i = 0; i < n && FINITE_P (v[i]); i++) {
+      /* do nothing */
+    }
+    if (i < n) {
+      cv->skipped_count++;
+      continue;
+    }
+    for (i = 0; i < n; i++) {
+      d[i * BLOCK_VECTORS + kept] = v[i];
+    }
+    kept++;
+  }
+  if (kept == 0) {
+    /* . */
+    return;
+  }
+
+  /* NB: the deviations from the mean of the block, padded with
+     zeros, which add nothing to the products */
+  length = PADDED (kept);
+  for (i = 0; i < n; i++) {
+    double *dp = d + i * BLOCK_VECTORS, s = 0;
+    for (k = 0; k < kept; k++) {
+      s += dp[k];
+    }
+    mean[i] = s / kept;
+    for (k = 0; k < kept; k++) {
+      dp[k] -= mean[i];
+    }
+    for (; k < length; k++) {
+      dp[k] = 0;
+    }
+  }
+  (*kernel) (cv->products, d, n, BLOCK_VECTORS, length);
+  merge_moments (cv, mean, cv->products, kept);
+}
+
+/* NB: the kernel is chosen once, on the first call, which may well be
+   made by several threads at once (as with rawcov --jobs) */
+static void (*kernel) (double *, const double *, size_t,
+                       size_t, size_t);
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void
+choose_kernel (void)
+{
+#ifdef HAVE_X86_DISPATCH
+  __builtin_cpu_init ();
+  kernel = ((__builtin_cpu_supports ("avx2")
+             && __builtin_cpu_supports ("fma"))
+            ? products_avx2 : products_generic);
+#else
+  kernel = products_generic;
+#endif
+}
+
+void
+ncov_add_doubles (struct ncov *cv, const double *vec, size_t count)
+{
+  size_t rest;
+  const double *p;
+
+  pthread_once (&kernel_once, choose_kernel);
+
+  for (rest = count, p = vec; rest > 0; ) {
+    const size_t blk = rest < BLOCK_VECTORS ? rest : BLOCK_VECTORS;
+    add_block (cv, p, blk, kernel);
+    rest -= blk;
+    p    += blk * cv->size;
+  }
+}
+
+void
+ncov_merge (struct ncov *cv, const struct ncov *other)
+{
+  if (other->count > 0) {
+    merge_moments (cv, other->mean, other->m2, other->count);
+  }
+  cv->skipped_count += other->skipped_count;
+}
+
+/*** Results */
+
+void
+ncov_covariance (double *cov, const struct ncov *cv)
+{
+  const size_t n = cv->size;
+  size_t i, j;
+  for (i = 0; i < n; i++) {
+    for (j = i; j < n; j++) {
+      cov[i * n + j] = cov[j * n + i]
+        = (cv->count > 0 ? cv->m2[i * n + j] / cv->count : NAN);
+    }
+  }
+}
+
+int
+ncov_eigen (double *values, double *vectors,
+            const double *a, size_t n)
+{
+  double *s, *v;
+  size_t sweep, p, q, k;
+
+  if ((s = malloc (n * n * sizeof (*s))) == 0) {
+    /* . */
+    return -1;
+  }
+  if ((v = calloc (n * n, sizeof (*v))) == 0) {
+    free (s);
+    /* . */
+    return -1;
+  }
+  memcpy (s, a, n * n * sizeof (*s));
+  for (k = 0; k < n; k++) {
+    v[k * n + k] = 1;
+  }
+
+  /* NB: each rotation zeroes the element (P, Q), and the rotations
+     are accumulated in the columns of V; the elements negligible
+     next to the diagonal are merely dropped */
+  for (sweep = 0; sweep < JACOBI_SWEEPS; sweep++) {
+    size_t rotations = 0;
+    for (p = 0; p < n; p++) {
+      for (q = p + 1; q < n; q++) {
+        const double
+          apq = s[p * n + q], app = s[p * n + p], aqq = s[q * n + q];
+        double theta, t, c, sn;
+        if (fabs (apq) <= DBL_EPSILON / 4 * sqrt (fabs (app * aqq))) {
+          s[p * n + q] = s[q * n + p] = 0;
+          continue;
+        }
+        theta = (aqq - app) / (2 * apq);
+        t = (fabs (theta) > 1e150 ? 1 / (2 * theta)
+             : (theta < 0 ? -1 : 1)
+             / (fabs (theta) + sqrt (theta * theta + 1)));
+        c  = 1 / sqrt (t * t + 1);
+        sn = t * c;
+        for (k = 0; k < n; k++) {
+          const double skp = s[k * n + p], skq = s[k * n + q];
+          s[k * n + p] = c * skp - sn * skq;
+          s[k * n + q] = sn * skp + c * skq;
+        }
+        for (k = 0; k < n; k++) {
+          const double spk = s[p * n + k], sqk = s[q * n + k];
+          s[p * n + k] = c * spk - sn * sqk;
+          s[q * n + k] = sn * spk + c * sqk;
+        }
+        for (k = 0; k < n; k++) {
+          const double vkp = v[k * n + p], vkq = v[k * n + q];
+          v[k * n + p] = c * vkp - sn * vkq;
+          v[k * n + q] = sn * vkp + c * vkq;
+        }
+        rotations++;
+      }
+    }
+    if (rotations == 0) {
+      break;
+    }
+  }
+
+  /* NB: selection sort, in descending order */
+  {
+    double diag[n];
+    size_t order[n], i, j;
+    for (i = 0; i < n; i++) {
+      diag[i]  = s[i * n + i];
+      order[i] = i;
+    }
+    for (i = 0; i < n; i++) {
+      size_t best = i;
+      for (j = i + 1; j < n; j++) {
+        if (diag[order[j]] > diag[order[best]]) {
+          best = j;
+        }
+      }
+      k = order[i];
+      order[i] = order[best];
+      order[best] = k;
+    }
+    for (i = 0; i < n; i++) {
+      const size_t col = order[i];
+      double *row = vectors + i * n, big = 0;
+      values[i] = diag[col];
+      for (j = 0; j < n; j++) {
+        row[j] = v[j * n + col];
+        if (fabs (row[j]) > fabs (big)) {
+          big = row[j];
+        }
+      }
+      if (big < 0) {
+        for (j = 0; j < n; j++) {
+          row[j] = -row[j];
+        }
+      }
+    }
+  }
+  free (s);
+  free (v);
+
+  /* . */
+  return 0;
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numcov.c ends here */
@@ -0,0 +1,73 @@
+/*** numcov.h --- Streaming Covariance  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMCOV_H
+#define NUMCOV_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+/* NB: the mean vector, and the sums of the products of the deviations
+   from it (the upper triangle only, M2[I * SIZE + J] for J >= I), of
+   the vectors of SIZE elements; the vectors with NaN's or infinities
+   are merely counted */
+struct ncov {
+  size_t size;
+  uint64_t count, skipped_count;
+  double *mean, *m2;
+  /* the scratch space for a block of the vectors, and its products */
+  double *block, *products;
+};
+
+/* NB: return -1 and set errno on failure */
+int  ncov_init (struct ncov *cv, size_t size);
+void ncov_free (struct ncov *cv);
+
+/* NB: the COUNT vectors at VEC are processed in blocks: each block is
+   transposed, and centred on its own mean, and the products of the
+   deviations are computed (with the SIMD kernel selected at run time)
+   and merged into the state (Chan et al.), so that there's no loss of
+   precision of the textbook X^T X - N * MEAN MEAN^T formula */
+void ncov_add_doubles (struct ncov *cv, const double *vec, size_t count);
+void ncov_merge (struct ncov *cv, const struct ncov *other);
+
+/* NB: the population covariance, i. e., the one divided by COUNT, in
+   full (SIZE x SIZE) */
+void ncov_covariance (double *cov, const struct ncov *cv);
+
+/* NB: the eigenvalues of the symmetric matrix A of N x N, in
+   descending order, and the (unit) eigenvectors, as the rows of
+   VECTORS, each with its largest element positive; computed with the
+   cyclic Jacobi method.  Return -1 and set errno on failure */
+int  ncov_eigen (double *values, double *vectors,
+                 const double *a, size_t n);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numcov.h ends here */
@@ -0,0 +1,581 @@
+/*** numfix.c --- Multiplying integer vectors in fixed point  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <math.h>               /* for rint () */
+#include <pthread.h>            /* for pthread_once () */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>             /* for memcpy () */
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "numfix.h"
+#include "usemacro.h"
+
+/* NB: the vectors are unpacked into the planes of 16-bit integers,
+   one per element, of up to this many bytes altogether */
+#define CHUNK_BYTES 65536
+#define CHUNK_MAX   1024
+
+/* NB: the fraction bits are chosen from this many down */
+#define SHIFT_MAX 30
+
+/*** Utility */
+
+/* NB: the largest magnitude of the inputs, as they are, and less the
+   offset; return -1 if the type isn't supported */
+static int
+in_range (enum numfmt_type type, double *x_max, double *xo_max,
+          int32_t *offset)
+{
+  switch (type) {
+  case NUMFMT_UINT8:
+    *x_max = *xo_max = 255;    *offset = 0;     break;
+  case NUMFMT_INT8:
+    *x_max = *xo_max = 128;    *offset = 0;     break;
+  case NUMFMT_UINT16:
+    *x_max = 65535; *xo_max = 32768; *offset = 32768; break;
+  case NUMFMT_INT16:
+    *x_max = *xo_max = 32768;  *offset = 0;     break;
+  default:
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+static int
+out_p (enum numfmt_type type)
+{
+  /* . */
+  return (type == NUMFMT_UINT8  || type == NUMFMT_INT8
+          || type == NUMFMT_UINT16 || type == NUMFMT_INT16
+          || type == NUMFMT_UINT32 || type == NUMFMT_INT32
+          || type == NUMFMT_UINT64 || type == NUMFMT_INT64);
+}
+
+/* NB: the sum with SHIFT fraction bits, rounded to an integer; the
+   ties are rounded to even, the same as nconv_ () does */
+static inline int32_t
+round_fix (int32_t acc, int shift, enum nconv_rounding rounding)
+{
+  const int32_t half = (shift > 0) ? (INT32_C (1) << (shift - 1)) : 0;
+  const int32_t mask = (INT32_C (1) << shift) - 1;
+  int32_t r;
+
+  if (shift == 0) {
+    /* . */
+    return acc;
+  }
+  switch (rounding) {
+  case NCONV_ROUND_TRUNC:
+    r = (acc < 0) ? - ((- acc) >> shift) : (acc >> shift);
+    break;
+  case NCONV_ROUND_FLOOR:
+    r = acc >> shift;
+    break;
+  default:
+    r = (acc + half) >> shift;
+    if ((acc & mask) == half) {
+      r &= ~ INT32_C (1);
+    }
+  }
+
+  /* . */
+  return r;
+}
+
+/*** Initializing */
+
+int
+nfix_init (struct nfix *fx, const double *m,
+           size_t rows, size_t columns, int bias_p,
+           enum numfmt_type in_type, enum numfmt_type out_type,
+           enum nconv_rounding rounding)
+{
+  const size_t mc = columns + (bias_p ? 1 : 0);
+  const double limit = (double)INT32_MAX;
+  double x_max, xo_max;
+  int32_t offset;
+  int shift, fit_p = 0;
+  size_t r, c;
+
+  fx->q = 0;
+  fx->bias = 0;
+  if (in_range (in_type, &x_max, &xo_max, &offset) < 0
+      || ! out_p (out_type)) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+
+  /* NB: the most fraction bits with which the elements fit into 16
+     bits, and the sums (and the bias, and the half for rounding) into
+     32 bits */
+  for (shift = SHIFT_MAX; shift >= 0 && ! fit_p; shift--) {
+    const double scale = ldexp (1, shift);
+    fit_p = 1;
+    for (r = 0; r < rows && fit_p; r++) {
+      const double *mp = m + r * mc;
+      double sum = 0, abs_sum = 0;
+      for (c = 0; c < columns; c++) {
+        const double q = rint (mp[c] * scale);
+        fit_p = fit_p && fabs (q) <= INT16_MAX;
+        sum     += q;
+        abs_sum += fabs (q);
+      }
+      fit_p = (fit_p
+               && (fabs (offset * sum
+                         + (bias_p ? rint (mp[columns] * scale) : 0))
+                   + abs_sum * xo_max + scale)
+               < limit);
+    }
+  }
+  if (! fit_p) {
+    errno = EDOM;
+    /* . */
+    return -1;
+  }
+  shift++;
+
+  fx->rows      = rows;
+  fx->columns   = columns;
+  fx->in_type   = in_type;
+  fx->out_type  = out_type;
+  fx->rounding  = rounding;
+  fx->shift     = shift;
+  fx->pairs     = (columns + 1) / 2;
+  fx->in_offset = offset;
+  fx->error     = 0;
+  if (MALLOC_ARY (fx->q, rows * 2 * fx->pairs) == 0
+      || MALLOC_ARY (fx->bias, rows) == 0) {
+    nfix_free (fx);
+    /* . */
+    return -1;
+  }
+  for (r = 0; r < rows; r++) {
+    const double scale = ldexp (1, shift);
+    const double *mp = m + r * mc;
+    int16_t *qp = fx->q + r * 2 * fx->pairs;
+    double b = 0, error = 0;
+    int32_t sum = 0;
+    for (c = 0; c < 2 * fx->pairs; c++) {
+      qp[c] = (c < columns) ? (int16_t)rint (mp[c] * scale) : 0;
+      sum  += qp[c];
+      if (c < columns) {
+        error += fabs (mp[c] - qp[c] / scale) * x_max;
+      }
+    }
+    if (bias_p) {
+      b = rint (mp[columns] * scale);
+      error += fabs (mp[columns] - b / scale);
+    }
+    fx->bias[r] = offset * sum + (int32_t)b;
+    fx->error   = MAX (fx->error, error);
+  }
+
+  /* . */
+  return 0;
+}
+
+void
+nfix_free (struct nfix *fx)
+{
+  free (fx->q);
+  free (fx->bias);
+  fx->q = 0;
+  fx->bias = 0;
+}
+
+/*** Unpacking and storing */
+
+/* NB: the Cth elements of the N records at X are stored in the plane
+   at XS + C * CHUNK, less the offset */
+#define UNPACK(type, expr) \
+    for (c = 0; c < columns; c++) { \
+      const char *p = (const char *)x + c * sizeof (type); \
+      int16_t *d = xs + c * chunk; \
+      for (i = 0; i < n; i++, p += columns * sizeof (type)) { \
+        type v; \
+        memcpy (&v, p, sizeof (type)); \
+        d[i] = (expr); \
+      } \
+    }
+
+static void
+unpack (int16_t *xs, size_t chunk, const void *x, size_t n,
+        const struct nfix *fx)
+{
+  const size_t columns = fx->columns;
+  size_t c, i;
+
+  switch (fx->in_type) {
+  case NUMFMT_UINT8:  UNPACK (uint8_t,  v); break;
+  case NUMFMT_INT8:   UNPACK (int8_t,   v); break;
+  case NUMFMT_UINT16: UNPACK (uint16_t, (int16_t)(v ^ 0x8000)); break;
+  case NUMFMT_INT16:  UNPACK (int16_t,  v); break;
+  default:
+    break;
+  }
+  if (columns % 2 != 0) {
+    memset (xs + columns * chunk, 0, n * sizeof (*xs));
+  }
+}
+
+/* NB: the sums are stored STRIDE bytes apart, saturating */
+#define STORE(type, lo, hi) \
+    for (i = 0; i < n; i++, p += stride) { \
+      const type v = (type)BOUND (acc[i], (lo), (hi)); \
+      memcpy (p, &v, sizeof (type)); \
+    }
+
+static void
+store (void *y, size_t stride, const int32_t *acc, size_t n,
+       enum numfmt_type type)
+{
+  char *p = y;
+  size_t i;
+
+  switch (type) {
+  case NUMFMT_UINT8:  STORE (uint8_t,  0, UINT8_MAX);  break;
+  case NUMFMT_INT8:   STORE (int8_t,   INT8_MIN, INT8_MAX);  break;
+  case NUMFMT_UINT16: STORE (uint16_t, 0, UINT16_MAX); break;
+  case NUMFMT_INT16:  STORE (int16_t,  INT16_MIN, INT16_MAX); break;
+  case NUMFMT_UINT32: STORE (uint32_t, 0, INT32_MAX);  break;
+  case NUMFMT_INT32:  STORE (int32_t,  INT32_MIN, INT32_MAX); break;
+  case NUMFMT_UINT64: STORE (uint64_t, 0, INT32_MAX);  break;
+  case NUMFMT_INT64:  STORE (int64_t,  INT32_MIN, INT32_MAX); break;
+  default:
+    break;
+  }
+}
+
+/*** The kernels */
+
+/* NB: the rounded sums for a row of the matrix, for the N vectors
+   unpacked into the planes at XS */
+typedef void (*row_fn) (int32_t *acc, const int16_t *xs, size_t chunk,
+                        size_t n, const struct nfix *fx, size_t r);
+
+static void
+row_generic (int32_t *acc, const int16_t *xs, size_t chunk,
+             size_t n, const struct nfix *fx, size_t r)
+{
+  const int16_t *q = fx->q + r * 2 * fx->pairs;
+  size_t i, c;
+
+  for (i = 0; i < n; i++) {
+    int32_t a = fx->bias[r];
+    for (c = 0; c < 2 * fx->pairs; c++) {
+      a += (int32_t)q[c] * xs[c * chunk + i];
+    }
+    acc[i] = round_fix (a, fx->shift, fx->rounding);
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+#define AVX2 __attribute__ ((target ("avx2")))
+
+/* NB: the pairs of the elements are multiplied and summed with a
+   single vpmaddwd, for 16 vectors at a time; the sums come out in the
+   order of the 128-bit lanes, and are put back in order when
+   stored */
+static AVX2 void
+row_avx2 (int32_t *acc, const int16_t *xs, size_t chunk,
+          size_t n, const struct nfix *fx, size_t r)
+{
+  const int16_t *q = fx->q + r * 2 * fx->pairs;
+  const int shift = fx->shift;
+  const __m128i count = _mm_cvtsi32_si128 (shift);
+  const __m256i
+    half = _mm256_set1_epi32 (shift > 0 ? 1 << (shift - 1) : 0),
+    mask = _mm256_set1_epi32 ((1 << shift) - 1),
+    one  = _mm256_set1_epi32 (1);
+  __m256i qv[fx->pairs];
+  size_t i, k;
+
+  for (k = 0; k < fx->pairs; k++) {
+    qv[k] = _mm256_set1_epi32 ((int32_t)((uint16_t)q[2 * k]
+                                         | ((uint32_t)(uint16_t)
+                                            q[2 * k + 1] << 16)));
+  }
+  for (i = 0; i + 16 <= n; i += 16) {
+    __m256i lo = _mm256_set1_epi32 (fx->bias[r]), hi = lo;
+    __m256i v[2];
+    int j;
+    for (k = 0; k < fx->pairs; k++) {
+      const int16_t *a = xs + 2 * k * chunk + i;
+      const __m256i
+        va = _mm256_loadu_si256 ((const __m256i *)a),
+        vb = _mm256_loadu_si256 ((const __m256i *)(a + chunk));
+      lo = _mm256_add_epi32 (lo, _mm256_madd_epi16
+                             (_mm256_unpacklo_epi16 (va, vb), qv[k]));
+      hi = _mm256_add_epi32 (hi, _mm256_madd_epi16
+                             (_mm256_unpackhi_epi16 (va, vb), qv[k]));
+    }
+    v[0] = lo;
+    v[1] = hi;
+    for (j = 0; j < 2 && shift > 0; j++) {
+      switch (fx->rounding) {
+      case NCONV_ROUND_TRUNC:
+        v[j] = _mm256_sign_epi32 (_mm256_srl_epi32
+                                  (_mm256_abs_epi32 (v[j]), count),
+                                  v[j]);
+        break;
+      case NCONV_ROUND_FLOOR:
+        v[j] = _mm256_sra_epi32 (v[j], count);
+        break;
+      default:
+        {
+          const __m256i
+            t   = _mm256_sra_epi32 (_mm256_add_epi32 (v[j], half),
+                                    count),
+            tie = _mm256_cmpeq_epi32 (_mm256_and_si256 (v[j], mask),
+                                      half);
+          v[j] = _mm256_sub_epi32 (t, _mm256_and_si256
+                                   (tie, _mm256_and_si256 (t, one)));
+        }
+      }
+    }
+    _mm256_storeu_si256 ((__m256i *)(acc + i),
+                         _mm256_permute2x128_si256 (v[0], v[1], 0x20));
+    _mm256_storeu_si256 ((__m256i *)(acc + i + 8),
+                         _mm256_permute2x128_si256 (v[0], v[1], 0x31));
+  }
+  row_generic (acc + i, xs + i, chunk, n - i, fx, r);
+}
+
+/* NB: the records of up to 4 bytes (as RGB) are gathered whole, one
+   into each 32-bit lane, and are spread into the pairs of 16-bit
+   elements for vpmaddwd right there, with no planes; the result is
+   rounded the same as above, and, for the output of up to 4 elements
+   of uint8, saturated and packed in the registers, too.  Return the
+   number of the vectors done; as the records are read (and written)
+   4 bytes at a time, some are always left for the other kernels */
+static AVX2 size_t
+small_avx2 (void *y, const void *x, size_t count,
+            const struct nfix *fx)
+{
+  const size_t
+    in_esz  = (fx->in_type == NUMFMT_UINT8
+               || fx->in_type == NUMFMT_INT8) ? 1 : 2,
+    in_rec  = in_esz * fx->columns,
+    out_rec = fx->rows,
+    spare   = (4 + in_rec - 1) / in_rec;
+  const int shift = fx->shift;
+  const __m128i count_v = _mm_cvtsi32_si128 (shift);
+  const __m256i
+    half  = _mm256_set1_epi32 (shift > 0 ? 1 << (shift - 1) : 0),
+    mask  = _mm256_set1_epi32 ((1 << shift) - 1),
+    one   = _mm256_set1_epi32 (1),
+    index = _mm256_mullo_epi32 (_mm256_setr_epi32 (0, 1, 2, 3,
+                                                   4, 5, 6, 7),
+                                _mm256_set1_epi32 (in_rec)),
+    /* NB: the bytes into the high halves of the 16-bit lanes */
+    spread_lo = _mm256_setr_epi8 (-1, 0, -1, 1, -1, 4, -1, 5,
+                                  -1, 8, -1, 9, -1, 12, -1, 13,
+                                  -1, 0, -1, 1, -1, 4, -1, 5,
+                                  -1, 8, -1, 9, -1, 12, -1, 13),
+    spread_hi = _mm256_setr_epi8 (-1, 2, -1, 3, -1, 6, -1, 7,
+                                  -1, 10, -1, 11, -1, 14, -1, 15,
+                                  -1, 2, -1, 3, -1, 6, -1, 7,
+                                  -1, 10, -1, 11, -1, 14, -1, 15),
+    flip = _mm256_set1_epi16 ((int16_t)0x8000);
+  __m256i qv[2 * 4], bias[4], pack;
+  size_t i, r;
+
+  if (in_rec > 4 || out_rec > 4 || fx->out_type != NUMFMT_UINT8
+      || count < 8 + spare) {
+    /* . */
+    return 0;
+  }
+  for (r = 0; r < fx->rows; r++) {
+    const int16_t *q = fx->q + r * 2 * fx->pairs;
+    for (i = 0; i < 2; i++) {
+      qv[2 * r + i]
+        = ((i < fx->pairs)
+           ? _mm256_set1_epi32 ((int32_t)((uint16_t)q[2 * i]
+                                          | ((uint32_t)(uint16_t)
+                                             q[2 * i + 1] << 16)))
+           : _mm256_setzero_si256 ());
+    }
+    bias[r] = _mm256_set1_epi32 (fx->bias[r]);
+  }
+  {
+    /* NB: the low OUT_REC bytes of each 32-bit lane, packed */
+    int8_t m[32];
+    size_t k;
+    for (k = 0; k < 16; k++) {
+      m[k] = m[k + 16]
+        = (k < 4 * out_rec) ? (int8_t)(k / out_rec * 4 + k % out_rec)
+        : -1;
+    }
+    pack = _mm256_loadu_si256 ((const __m256i *)m);
+  }
+
+  for (i = 0; i + 8 + spare <= count; i += 8) {
+    const __m256i d
+      = _mm256_i32gather_epi32 ((const int *)((const char *)x
+                                              + i * in_rec),
+                                index, 1);
+    __m256i p0, p1, packed = _mm256_setzero_si256 ();
+    if (in_esz == 1) {
+      p0 = _mm256_shuffle_epi8 (d, spread_lo);
+      p1 = _mm256_shuffle_epi8 (d, spread_hi);
+      if (fx->in_type == NUMFMT_INT8) {
+        p0 = _mm256_srai_epi16 (p0, 8);
+        p1 = _mm256_srai_epi16 (p1, 8);
+      } else {
+        p0 = _mm256_srli_epi16 (p0, 8);
+        p1 = _mm256_srli_epi16 (p1, 8);
+      }
+    } else {
+      p0 = (fx->in_type == NUMFMT_UINT16
+            ? _mm256_xor_si256 (d, flip) : d);
+      p1 = _mm256_setzero_si256 ();
+    }
+    for (r = 0; r < fx->rows; r++) {
+      __m256i v
+        = _mm256_add_epi32 (bias[r],
+                            _mm256_add_epi32
+                            (_mm256_madd_epi16 (p0, qv[2 * r]),
+                             _mm256_madd_epi16 (p1, qv[2 * r + 1])));
+      if (shift > 0) {
+        switch (fx->rounding) {
+        case NCONV_ROUND_TRUNC:
+          v = _mm256_sign_epi32 (_mm256_srl_epi32
+                                 (_mm256_abs_epi32 (v), count_v), v);
+          break;
+        case NCONV_ROUND_FLOOR:
+          v = _mm256_sra_epi32 (v, count_v);
+          break;
+        default:
+          {
+            const __m256i
+              t   = _mm256_sra_epi32 (_mm256_add_epi32 (v, half),
+                                      count_v),
+              tie = _mm256_cmpeq_epi32 (_mm256_and_si256 (v, mask),
+                                        half);
+            v = _mm256_sub_epi32 (t, _mm256_and_si256
+                                  (tie, _mm256_and_si256 (t, one)));
+          }
+        }
+      }
+      v = _mm256_min_epi32 (_mm256_max_epi32
+                            (v, _mm256_setzero_si256 ()),
+                            _mm256_set1_epi32 (UINT8_MAX));
+      packed = _mm256_or_si256 (packed,
+                                _mm256_sll_epi32
+                                (v, _mm_cvtsi32_si128 (8 * r)));
+    }
+    {
+      char b[32];
+      _mm256_storeu_si256 ((__m256i *)b,
+                           _mm256_shuffle_epi8 (packed, pack));
+      memcpy ((char *)y + i * out_rec,       b,      4 * out_rec);
+      memcpy ((char *)y + (i + 4) * out_rec, b + 16, 4 * out_rec);
+    }
+  }
+
+  /* . */
+  return i;
+}
+
+#define CPU_HAS(feature) (__builtin_cpu_init (), \
+                          __builtin_cpu_supports (feature))
+
+/* NB: the CPU is checked once, on the first call, which may well be
+   made by several threads at once (as with rawmatrix --jobs) */
+static int have_avx2_p;
+static pthread_once_t avx2_once = PTHREAD_ONCE_INIT;
+
+static void
+check_avx2 (void)
+{
+  have_avx2_p = CPU_HAS ("avx2");
+}
+
+#endif
+
+/*** Interface */
+
+void
+nfix_apply (void *y, const void *x, size_t count,
+            const struct nfix *fx)
+{
+  const size_t
+    chunk = BOUND (CHUNK_BYTES / (4 * fx->pairs) / 16 * 16,
+                   16, CHUNK_MAX);
+  int16_t xs[2 * fx->pairs * chunk];
+  int32_t acc[chunk];
+  row_fn row = row_generic;
+  struct numfmt in, out;
+  size_t in_sz, out_sz, i0, r;
+
+  numfmt_init (&in,  fx->in_type);
+  numfmt_init (&out, fx->out_type);
+  in_sz  = numfmt_size (&in);
+  out_sz = numfmt_size (&out);
+
+#ifdef HAVE_X86_DISPATCH
+  pthread_once (&avx2_once, check_avx2);
+  if (have_avx2_p) {
+    /* NB: the small records first, and the rest in the planes */
+    const size_t done = small_avx2 (y, x, count, fx);
+    x = (const char *)x + done * fx->columns * in_sz;
+    y = (char *)y + done * fx->rows * out_sz;
+    count -= done;
+    row = row_avx2;
+  }
+#endif
+
+  for (i0 = 0; i0 < count; i0 += chunk) {
+    const size_t n = MIN (chunk, count - i0);
+    unpack (xs, chunk,
+            (const char *)x + i0 * fx->columns * in_sz, n, fx);
+    for (r = 0; r < fx->rows; r++) {
+      row (acc, xs, chunk, n, fx, r);
+      store ((char *)y + (i0 * fx->rows + r) * out_sz,
+             fx->rows * out_sz, acc, n, fx->out_type);
+    }
+  }
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numfix.c ends here */
@@ -0,0 +1,78 @@
+/*** numfix.h --- Multiplying integer vectors in fixed point  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMFIX_H
+#define NUMFIX_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+#include "numfmt.h"
+
+/* NB: the fixed-point form of the matrix, for multiplying the vectors
+   of 8- or 16-bit integers, giving the vectors of integers.  The
+   elements of the matrix are quantised to 16-bit integers, with SHIFT
+   fraction bits, chosen as many as the 32-bit sums allow; the
+   products are then summed exactly, the sum is rounded to an integer
+   as selected, and saturates at the bounds of the output type.  The
+   sums (before rounding) are within ERROR of those with the matrix
+   given, for any input */
+struct nfix {
+  size_t rows, columns;
+  enum numfmt_type in_type, out_type;
+  enum nconv_rounding rounding;
+  int shift;
+  /* NB: the elements by the rows, with the number of the columns
+     rounded up to even, and the bias, which includes the offset of
+     the inputs (the unsigned 16-bit inputs are taken less 32768) */
+  size_t pairs;
+  int16_t *q;
+  int32_t *bias;
+  int32_t in_offset;
+  double error;
+};
+
+/* NB: IN_TYPE is one of the 8- or 16-bit integer types, and OUT_TYPE
+   is any integer type; return -1 and set errno on failure (EDOM, if
+   the matrix couldn't be represented) */
+int  nfix_init (struct nfix *fx, const double *m,
+                size_t rows, size_t columns, int bias_p,
+                enum numfmt_type in_type, enum numfmt_type out_type,
+                enum nconv_rounding rounding);
+void nfix_free (struct nfix *fx);
+
+/* NB: the COUNT vectors at X (records of fx->columns elements of
+   IN_TYPE, not necessarily aligned) are multiplied, giving the
+   records of fx->rows elements of OUT_TYPE at Y */
+void nfix_apply (void *y, const void *x, size_t count,
+                 const struct nfix *fx);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numfix.h ends here */
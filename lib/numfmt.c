@@ -0,0 +1,406 @@
+/*** numfmt.c --- Raw numeric formats  -*- C -*- */
+#define _GNU_SOURCE
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#include <assert.h>
+#include <errno.h>
+#include <math.h>               /* for isnan () */
+#include <stdlib.h>
+#include <string.h>
+
+#include "numconv.h"
+#include "numfmt.h"
+#include "p_arg.h"
+#include "usemacro.h"
+
+const char *numfmt_type_names[] = {
+  [NUMFMT_UINT8]  = "uint8",
+  [NUMFMT_UINT16] = "uint16",
+  [NUMFMT_UINT32] = "uint32",
+  [NUMFMT_UINT64] = "uint64",
+  [NUMFMT_INT8]   = "int8",
+  [NUMFMT_INT16]  = "int16",
+  [NUMFMT_INT32]  = "int32",
+  [NUMFMT_INT64]  = "int64",
+  [NUMFMT_FLOAT]  = "float",
+  [NUMFMT_DOUBLE] = "double",
+  [NUMFMT_MAX]    = 0
+};
+
+const char *numfmt_rounding_names[] = {
+  [NCONV_ROUND_NEAREST] = "nearest",
+  [NCONV_ROUND_TRUNC]   = "trunc",
+  [NCONV_ROUND_FLOOR]   = "floor",
+  [NCONV_ROUND_MAX]     = 0
+};
+
+/*** Initializing and parsing */
+
+void
+numfmt_init (struct numfmt *fmt, enum numfmt_type type)
+{
+  memset (fmt, 0, sizeof (*fmt));
+  fmt->type     = type;
+  fmt->packed_p = 0;
+  fmt->scale    = 1;
+  fmt->offset   = 0;
+  fmt->fill_p   = 0;
+}
+
+static int
+parse_fill (struct numfmt *fmt, const char *s)
+{
+  union numfmt_value *f = &(fmt->fill);
+  char *t;
+
+  errno = 0;
+  switch (fmt->type) {
+#define CASE_SIGNED(format, member, lo, hi) \
+  case format: \
+    { \
+      const long long v = strtoll (s, &t, 0); \
+      if (t == s || *t != '\0' || errno != 0 \
+          || v < (lo) || v > (hi)) { \
+        errno = EINVAL; \
+        /* . */ \
+        return -1; \
+      } \
+      f->member = v; \
+    } \
+    break;
+#define CASE_UNSIGNED(format, member, hi) \
+  case format: \
+    { \
+      const unsigned long long v = strtoull (s, &t, 0); \
+      if (t == s || *t != '\0' || *s == '-' || errno != 0 \
+          || v > (hi)) { \
+        errno = EINVAL; \
+        /* . */ \
+        return -1; \
+      } \
+      f->member = v; \
+    } \
+    break;
+    CASE_UNSIGNED (NUMFMT_UINT8,  u8,  UINT8_MAX)
+    CASE_UNSIGNED (NUMFMT_UINT16, u16, UINT16_MAX)
+    CASE_UNSIGNED (NUMFMT_UINT32, u32, UINT32_MAX)
+    CASE_UNSIGNED (NUMFMT_UINT64, u64, UINT64_MAX)
+    CASE_SIGNED (NUMFMT_INT8,  i8,  INT8_MIN,  INT8_MAX)
+    CASE_SIGNED (NUMFMT_INT16, i16, INT16_MIN, INT16_MAX)
+    CASE_SIGNED (NUMFMT_INT32, i32, INT32_MIN, INT32_MAX)
+    CASE_SIGNED (NUMFMT_INT64, i64, INT64_MIN, INT64_MAX)
+#undef CASE_SIGNED
+#undef CASE_UNSIGNED
+  case NUMFMT_FLOAT:
+  case NUMFMT_DOUBLE:
+    {
+      double v;
+      if (p_arg_double (s, &v) < 0) {
+        errno = EINVAL;
+        /* . */
+        return -1;
+      }
+      if (fmt->type == NUMFMT_FLOAT) {
+        f->f = v;
+      } else {
+        f->d = v;
+      }
+    }
+    break;
+  default:
+    /* NB: shouldn't happen */
+    assert (0);
+  }
+  fmt->fill_p = 1;
+
+  /* . */
+  return 0;
+}
+
+int
+numfmt_parse (struct numfmt *fmt, const char *s)
+{
+  const char *fields[4];
+  size_t len = strlen (s);
+  char buf[len + 1];
+  size_t n;
+  char *p;
+  int type;
+
+  /* split the string at colons */
+  memcpy (buf, s, len + 1);
+  for (n = 1, fields[0] = p = buf; *p != '\0'; p++) {
+    if (*p != ':') continue;
+    if (n >= sizeof (fields) / sizeof (*fields)) {
+      errno = EINVAL;
+      /* . */
+      return -1;
+    }
+    *p = '\0';
+    fields[n++] = p + 1;
+  }
+
+  if ((type = p_arg_string (fields[0], numfmt_type_names, 0)) < 0) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  numfmt_init (fmt, type);
+
+  /* packing parameters */
+  if (n >= 3) {
+    if (! numfmt_integer_p (fmt)
+        || p_arg_double (fields[1], &(fmt->scale)) < 0
+        || p_arg_double (fields[2], &(fmt->offset)) < 0
+        || fmt->scale == 0) {
+      errno = EINVAL;
+      /* . */
+      return -1;
+    }
+    fmt->packed_p = 1;
+  }
+
+  /* the fill value */
+  if ((n == 2 || n == 4)
+      && parse_fill (fmt, fields[n - 1]) < 0) {
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+int
+numfmt_parse_list (struct numfmt **fmts, size_t *count, const char *s)
+{
+  size_t len = strlen (s);
+  char buf[len + 1];
+  struct numfmt *v;
+  size_t n;
+  char *p, *q;
+
+  memcpy (buf, s, len + 1);
+  for (n = 1, p = buf; *p != '\0'; p++) {
+    n += (*p == ',');
+  }
+  if ((v = malloc (n * sizeof (*v))) == 0) {
+    /* . */
+    return -1;
+  }
+  for (n = 0, p = buf; p != 0; n++, p = q) {
+    if ((q = strchr (p, ',')) != 0) {
+      *(q++) = '\0';
+    }
+    if (numfmt_parse (v + n, p) < 0) {
+      free (v);
+      /* . */
+      return -1;
+    }
+  }
+  free (*fmts);
+  *fmts  = v;
+  *count = n;
+
+  /* . */
+  return 0;
+}
+
+void
+numfmt_set_fill (struct numfmt *fmt, double dn)
+{
+  union numfmt_value *f = &(fmt->fill);
+  switch (fmt->type) {
+#define CASE_SAT(format, member, type) \
+  case format: \
+    nconv_sat_ ## type ## _from_double (&(f->member), &dn, 1, \
+                                        NCONV_ROUND_NEAREST, 0); \
+    break;
+    CASE_SAT (NUMFMT_UINT8,  u8,  uint8_t)
+    CASE_SAT (NUMFMT_UINT16, u16, uint16_t)
+    CASE_SAT (NUMFMT_UINT32, u32, uint32_t)
+    CASE_SAT (NUMFMT_UINT64, u64, uint64_t)
+    CASE_SAT (NUMFMT_INT8,   i8,  int8_t)
+    CASE_SAT (NUMFMT_INT16,  i16, int16_t)
+    CASE_SAT (NUMFMT_INT32,  i32, int32_t)
+    CASE_SAT (NUMFMT_INT64,  i64, int64_t)
+#undef CASE_SAT
+  case NUMFMT_FLOAT:  f->f = dn; break;
+  case NUMFMT_DOUBLE: f->d = dn; break;
+  default:
+    /* NB: shouldn't happen */
+    assert (0);
+  }
+  fmt->fill_p = 1;
+}
+
+/*** Properties */
+
+size_t
+numfmt_size (const struct numfmt *fmt)
+{
+  const enum numfmt_type t = fmt->type;
+  /* . */
+  return (t == NUMFMT_UINT8  || t == NUMFMT_INT8  ? sizeof (int8_t)
+          : t == NUMFMT_UINT16 || t == NUMFMT_INT16 ? sizeof (int16_t)
+          : t == NUMFMT_UINT32 || t == NUMFMT_INT32 ? sizeof (int32_t)
+          : t == NUMFMT_UINT64 || t == NUMFMT_INT64 ? sizeof (int64_t)
+          : t == NUMFMT_FLOAT  ? sizeof (float)
+          : t == NUMFMT_DOUBLE ? sizeof (double)
+          : 0);
+}
+
+int
+numfmt_integer_p (const struct numfmt *fmt)
+{
+  /* . */
+  return (fmt->type != NUMFMT_FLOAT && fmt->type != NUMFMT_DOUBLE);
+}
+
+int
+numfmt_plain_double_p (const struct numfmt *fmt)
+{
+  /* . */
+  return (fmt->type == NUMFMT_DOUBLE && ! fmt->fill_p);
+}
+
+/*** Conversion */
+
+/* NB: plain integers with a fill value are unpacked with the unit
+   scale, so that the fused kernel is used */
+void
+numfmt_to_doubles (double *dst, const void *src, size_t count,
+                   const struct numfmt *fmt)
+{
+  const double
+    scale  = (fmt->packed_p ? fmt->scale  : 1),
+    offset = (fmt->packed_p ? fmt->offset : 0);
+  const int unpack_p = (fmt->packed_p || fmt->fill_p);
+  const union numfmt_value *f = (fmt->fill_p ? &(fmt->fill) : 0);
+
+  switch (fmt->type) {
+#define CASE_INT(format, member, type) \
+  case format: \
+    if (unpack_p) { \
+      nconv_unpack_double_from_ ## type (dst, src, count, \
+                                         scale, offset, \
+                                         f ? &(f->member) : 0); \
+    } else { \
+      nconv_double_from_ ## type (dst, src, count); \
+    } \
+    break;
+    CASE_INT (NUMFMT_UINT8,  u8,  uint8_t)
+    CASE_INT (NUMFMT_UINT16, u16, uint16_t)
+    CASE_INT (NUMFMT_UINT32, u32, uint32_t)
+    CASE_INT (NUMFMT_UINT64, u64, uint64_t)
+    CASE_INT (NUMFMT_INT8,   i8,  int8_t)
+    CASE_INT (NUMFMT_INT16,  i16, int16_t)
+    CASE_INT (NUMFMT_INT32,  i32, int32_t)
+    CASE_INT (NUMFMT_INT64,  i64, int64_t)
+#undef CASE_INT
+  case NUMFMT_FLOAT:
+    if (f != 0) {
+      nconv_nan_double_from_float (dst, src, count, &(f->f));
+    } else {
+      nconv_double_from_float (dst, src, count);
+    }
+    break;
+  case NUMFMT_DOUBLE:
+    if ((const void *)dst != src) {
+      memmove (dst, src, count * sizeof (*dst));
+    }
+    if (f != 0) {
+      nconv_nan_double_from_double (dst, dst, count, &(f->d));
+    }
+    break;
+  default:
+    /* NB: shouldn't happen */
+    assert (0);
+  }
+}
+
+void
+numfmt_from_doubles (void *dst, const double *src, size_t count,
+                     const struct numfmt *fmt,
+                     enum nconv_rounding rounding)
+{
+  const union numfmt_value *f = (fmt->fill_p ? &(fmt->fill) : 0);
+
+  switch (fmt->type) {
+#define CASE_INT(format, member, type) \
+  case format: \
+    if (fmt->packed_p) { \
+      nconv_pack_ ## type ## _from_double (dst, src, count, \
+                                           fmt->scale, fmt->offset, \
+                                           rounding, \
+                                           f ? &(f->member) : 0); \
+    } else { \
+      nconv_sat_ ## type ## _from_double (dst, src, count, rounding, \
+                                          f ? &(f->member) : 0); \
+    } \
+    break;
+    CASE_INT (NUMFMT_UINT8,  u8,  uint8_t)
+    CASE_INT (NUMFMT_UINT16, u16, uint16_t)
+    CASE_INT (NUMFMT_UINT32, u32, uint32_t)
+    CASE_INT (NUMFMT_UINT64, u64, uint64_t)
+    CASE_INT (NUMFMT_INT8,   i8,  int8_t)
+    CASE_INT (NUMFMT_INT16,  i16, int16_t)
+    CASE_INT (NUMFMT_INT32,  i32, int32_t)
+    CASE_INT (NUMFMT_INT64,  i64, int64_t)
+#undef CASE_INT
+  case NUMFMT_FLOAT:
+    nconv_float_from_double (dst, src, count);
+    if (f != 0) {
+      size_t i;
+      float *dp = dst;
+      for (i = 0; i < count; i++) {
+        if (isnan (src[i])) dp[i] = f->f;
+      }
+    }
+    break;
+  case NUMFMT_DOUBLE:
+    if (dst != (const void *)src) {
+      memmove (dst, src, count * sizeof (*src));
+    }
+    if (f != 0) {
+      size_t i;
+      double *dp = dst;
+      for (i = 0; i < count; i++) {
+        if (isnan (dp[i])) dp[i] = f->d;
+      }
+    }
+    break;
+  default:
+    /* NB: shouldn't happen */
+    assert (0);
+  }
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numfmt.c ends here */
@@ -0,0 +1,111 @@
+/*** numfmt.h --- Raw numeric formats  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMFMT_H
+#define NUMFMT_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+#include "numconv.h"            /* for enum nconv_rounding */
+
+enum numfmt_type {
+  NUMFMT_UINT8 = 0,
+  NUMFMT_UINT16,
+  NUMFMT_UINT32,
+  NUMFMT_UINT64,
+  NUMFMT_INT8,
+  NUMFMT_INT16,
+  NUMFMT_INT32,
+  NUMFMT_INT64,
+  NUMFMT_FLOAT,
+  NUMFMT_DOUBLE,
+  NUMFMT_MAX
+};
+
+/* NB: terminated with a null pointer, suitable for p_arg_string () */
+extern const char *numfmt_type_names[];
+extern const char *numfmt_rounding_names[];
+
+/* a value of any of the types above */
+union numfmt_value {
+  uint8_t  u8;
+  uint16_t u16;
+  uint32_t u32;
+  uint64_t u64;
+  int8_t   i8;
+  int16_t  i16;
+  int32_t  i32;
+  int64_t  i64;
+  float    f;
+  double   d;
+};
+
+struct numfmt {
+  enum numfmt_type type;
+  /* packed integers: the value is scale * DN + offset */
+  int packed_p;
+  double scale, offset;
+  /* the raw value (DN) to be read as, and to write for, NaN */
+  int fill_p;
+  union numfmt_value fill;
+};
+
+/** Initializing and parsing */
+
+/* NB: the format is TYPE[:FILL] or TYPE:SCALE:OFFSET[:FILL], the
+   latter being allowed for the integer types only */
+void numfmt_init (struct numfmt *fmt, enum numfmt_type type);
+int  numfmt_parse (struct numfmt *fmt, const char *s);
+/* NB: the formats are separated with commas; the array is allocated
+   with malloc (), and the one at *FMTS (if any) is freed */
+int  numfmt_parse_list (struct numfmt **fmts, size_t *count,
+                        const char *s);
+
+/* set the fill value, saturating it to the range of the type */
+void numfmt_set_fill (struct numfmt *fmt, double dn);
+
+/** Properties */
+
+size_t numfmt_size (const struct numfmt *fmt);
+int numfmt_integer_p (const struct numfmt *fmt);
+/* check if the data could be used as an array of doubles as is */
+int numfmt_plain_double_p (const struct numfmt *fmt);
+
+/** Conversion */
+
+void numfmt_to_doubles (double *dst, const void *src, size_t count,
+                        const struct numfmt *fmt);
+void numfmt_from_doubles (void *dst, const double *src, size_t count,
+                          const struct numfmt *fmt,
+                          enum nconv_rounding rounding);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numfmt.h ends here */
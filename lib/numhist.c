@@ -0,0 +1,288 @@
+/*** numhist.c --- Fixed-Bin Histograms  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <pthread.h>            /* for pthread_once () */
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+#include <stdlib.h>             /* for calloc () */
+#include <string.h>             /* for memset () */
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "numhist.h"
+
+/* NB: the indices are computed for this many values at a time */
+#define CHUNK_SZ 256
+
+/* NB: the slots of the COUNTS array are: the values below MIN, the
+   bins, the values above MAX, and the NaN's, which are discarded */
+#define SLOT_BELOW(h) (0)
+#define SLOT_ABOVE(h) ((h)->bins + 1)
+#define SLOT_NAN(h)   ((h)->bins + 2)
+#define SLOTS(h)      ((h)->bins + 3)
+
+/*** Index kernels */
+
+static void
+index_generic (uint32_t *idx, const struct nhist *h,
+               const double *vec, size_t size)
+{
+  const double last = h->bins - 1;
+  const uint32_t below = SLOT_BELOW (h), above = SLOT_ABOVE (h);
+  const uint32_t nan = SLOT_NAN (h);
+  size_t i;
+  for (i = 0; i < size; i++) {
+    const double v = vec[i];
+    double x = (v - h->min) * h->scale;
+    uint32_t j;
+    /* NB: NaN fails both of the comparisons */
+    x = (x < last) ? x : last;
+    x = (x > 0)    ? x : 0;
+    j = 1 + (uint32_t)x;
+    j = (v < h->min) ? below : j;
+    j = (v > h->max) ? above : j;
+    idx[i] = (v != v) ? nan : j;
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+static __attribute__ ((target ("avx2"))) void
+index_avx2 (uint32_t *idx, const struct nhist *h,
+            const double *vec, size_t size)
+{
+  const __m256d min = _mm256_set1_pd (h->min);
+  const __m256d max = _mm256_set1_pd (h->max);
+  const __m256d scale = _mm256_set1_pd (h->scale);
+  const __m256d zero = _mm256_setzero_pd ();
+  const __m256d last = _mm256_set1_pd (h->bins - 1);
+  const __m256d one = _mm256_set1_pd (1);
+  const __m256d below = _mm256_set1_pd (SLOT_BELOW (h));
+  const __m256d above = _mm256_set1_pd (SLOT_ABOVE (h));
+  const __m256d nan = _mm256_set1_pd (SLOT_NAN (h));
+  size_t i;
+
+  /* NB: the index is computed as a double, and converted at the end;
+     the clamping comparisons put NaN into the last bin first */
+  for (i = 0; i + 4 <= size; i += 4) {
+    const __m256d v = _mm256_loadu_pd (vec + i);
+    __m256d x = _mm256_mul_pd (_mm256_sub_pd (v, min), scale);
+    x = _mm256_max_pd (_mm256_min_pd (x, last), zero);
+    x = _mm256_add_pd (_mm256_floor_pd (x), one);
+    x = _mm256_blendv_pd (x, below,
+                          _mm256_cmp_pd (v, min, _CMP_LT_OQ));
+    x = _mm256_blendv_pd (x, above,
+                          _mm256_cmp_pd (v, max, _CMP_GT_OQ));
+    x = _mm256_blendv_pd (x, nan,
+                          _mm256_cmp_pd (v, v, _CMP_UNORD_Q));
+    _mm_storeu_si128 ((__m128i *)(idx + i), _mm256_cvttpd_epi32 (x));
+  }
+  index_generic (idx + i, h, vec + i, size - i);
+}
+
+#endif
+
+/* NB: the kernel is chosen once, on the first call, which may well be
+   made by several threads at once */
+static void (*kernel) (uint32_t *, const struct nhist *,
+                       const double *, size_t);
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void
+choose_kernel (void)
+{
+#ifdef HAVE_X86_DISPATCH
+  __builtin_cpu_init ();
+  kernel = (__builtin_cpu_supports ("avx2")
+            ? index_avx2 : index_generic);
+#else
+  kernel = index_generic;
+#endif
+}
+
+static void
+compute_indices (uint32_t *idx, const struct nhist *h,
+                 const double *vec, size_t size)
+{
+  pthread_once (&kernel_once, choose_kernel);
+  (*kernel) (idx, h, vec, size);
+}
+
+/*** Interface */
+
+int
+nhist_init (struct nhist *h, size_t bins, double min, double max)
+{
+  if (bins < 1 || ! (min <= max)) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  h->bins  = bins;
+  h->min   = min;
+  h->max   = max;
+  h->scale = (max > min) ? bins / (max - min) : 0;
+  if ((h->counts = calloc (SLOTS (h), sizeof (*(h->counts)))) == 0) {
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+void
+nhist_free (struct nhist *h)
+{
+  free (h->counts);
+  h->counts = 0;
+}
+
+void
+nhist_add_doubles (struct nhist *h, const double *vec, size_t size)
+{
+  uint32_t idx[CHUNK_SZ];
+  size_t rest;
+  const double *p;
+  for (rest = size, p = vec; rest > 0; ) {
+    const size_t n = rest < CHUNK_SZ ? rest : CHUNK_SZ;
+    size_t i;
+    compute_indices (idx, h, p, n);
+    for (i = 0; i < n; i++) {
+      h->counts[idx[i]]++;
+    }
+    rest -= n;
+    p    += n;
+  }
+}
+
+void
+nhist_add_weighted (struct nhist *h, const double *values,
+                    const uint64_t *weights, size_t size)
+{
+  uint32_t idx[CHUNK_SZ];
+  size_t rest;
+  const double *p;
+  const uint64_t *w;
+  for (rest = size, p = values, w = weights; rest > 0; ) {
+    const size_t n = rest < CHUNK_SZ ? rest : CHUNK_SZ;
+    size_t i;
+    compute_indices (idx, h, p, n);
+    for (i = 0; i < n; i++) {
+      h->counts[idx[i]] += w[i];
+    }
+    rest -= n;
+    p    += n;
+    w    += n;
+  }
+}
+
+void
+nhist_merge (struct nhist *h, const struct nhist *other)
+{
+  size_t i;
+  for (i = 0; i < SLOTS (h); i++) {
+    h->counts[i] += other->counts[i];
+  }
+}
+
+uint64_t
+nhist_count (const struct nhist *h, size_t bin)
+{
+  /* . */
+  return h->counts[1 + bin];
+}
+
+uint64_t
+nhist_below (const struct nhist *h)
+{
+  /* . */
+  return h->counts[SLOT_BELOW (h)];
+}
+
+uint64_t
+nhist_above (const struct nhist *h)
+{
+  /* . */
+  return h->counts[SLOT_ABOVE (h)];
+}
+
+double
+nhist_lower (const struct nhist *h, size_t bin)
+{
+  /* . */
+  return (bin >= h->bins ? h->max
+          : h->min + (h->max - h->min) * bin / h->bins);
+}
+
+/*** Direct-indexed counting */
+
+void
+nhist_count_8 (uint64_t *counts, const void *vec, size_t size)
+{
+  /* NB: four private tables break the dependency chains of the
+     increments of the same counter */
+  uint32_t t[4][256];
+  const uint8_t *p = vec;
+  size_t i, k;
+
+  memset (t, 0, sizeof (t));
+  for (i = 0; i + 4 <= size; i += 4) {
+    t[0][p[i]]++;
+    t[1][p[i + 1]]++;
+    t[2][p[i + 2]]++;
+    t[3][p[i + 3]]++;
+  }
+  for (; i < size; i++) {
+    t[0][p[i]]++;
+  }
+  for (k = 0; k < 256; k++) {
+    counts[k] += (uint64_t)t[0][k] + t[1][k] + t[2][k] + t[3][k];
+  }
+}
+
+void
+nhist_count_16 (uint64_t *counts, const void *vec, size_t size)
+{
+  const uint16_t *p = vec;
+  size_t i;
+  for (i = 0; i < size; i++) {
+    counts[p[i]]++;
+  }
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numhist.c ends here */
@@ -0,0 +1,79 @@
+/*** numhist.h --- Fixed-Bin Histograms  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMHIST_H
+#define NUMHIST_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+/* NB: the bins are of equal width, covering [MIN, MAX]; the last one
+   is closed, so that MAX falls into it */
+struct nhist {
+  size_t bins;
+  double min, max;
+  /* BINS / (MAX - MIN), or 0 if the range is empty */
+  double scale;
+  /* NB: the counts of the bins are in COUNTS[1] to COUNTS[BINS] */
+  uint64_t *counts;
+};
+
+/* NB: return -1 and set errno on failure */
+int  nhist_init (struct nhist *h, size_t bins, double min, double max);
+void nhist_free (struct nhist *h);
+
+/* NB: NaN's are never counted */
+void nhist_add_doubles (struct nhist *h,
+                        const double *vec, size_t size);
+/* add WEIGHTS[i] to the bin of VALUES[i] */
+void nhist_add_weighted (struct nhist *h, const double *values,
+                         const uint64_t *weights, size_t size);
+/* NB: both of the histograms should be of the same bins */
+void nhist_merge (struct nhist *h, const struct nhist *other);
+
+/** Access */
+
+uint64_t nhist_count (const struct nhist *h, size_t bin);
+/* the values less than MIN, or greater than MAX */
+uint64_t nhist_below (const struct nhist *h);
+uint64_t nhist_above (const struct nhist *h);
+double   nhist_lower (const struct nhist *h, size_t bin);
+
+/** Direct-indexed counting */
+
+/* NB: for the 8- and 16-bit integer data, the occurrences of each of
+   the possible values are counted instead; the arrays are indexed with
+   the values' bit patterns, and should have 256 or 65536 elements;
+   SIZE should be less than 2^32 */
+void nhist_count_8  (uint64_t *counts, const void *vec, size_t size);
+void nhist_count_16 (uint64_t *counts, const void *vec, size_t size);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numhist.h ends here */
@@ -0,0 +1,748 @@
+/*** nummat.c --- Multiplying vectors by a matrix  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <limits.h>             /* for INT_MAX */
+#include <math.h>               /* for ldexp (), isfinite (), NAN */
+#include <pthread.h>            /* for pthread_once () */
+#include <stddef.h>             /* for size_t */
+#include <stdlib.h>
+#include <string.h>             /* for memset () */
+
+#ifdef HAVE_CBLAS
+#include <cblas.h>
+#endif
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "nummat.h"
+#include "usemacro.h"
+
+/*** The generic kernel */
+
+/* NB: the bias is added last, the same as the trailing element of 1 */
+static void
+apply_generic (double *y, const double *m,
+               size_t rows, size_t columns, int bias_p,
+               const double *x, size_t count)
+{
+  const size_t mc = columns + (bias_p ? 1 : 0);
+  size_t i;
+  for (i = 0; i < count; i++, x += columns, y += rows) {
+    const double *mp;
+    size_t r;
+    for (r = 0, mp = m; r < rows; r++, mp += mc) {
+      double acc = 0;
+      size_t c;
+      for (c = 0; c < columns; c++) {
+        acc += mp[c] * x[c];
+      }
+      if (bias_p) {
+        acc += mp[columns];
+      }
+      y[r] = acc;
+    }
+  }
+}
+
+/*** The kernels for the small shapes */
+
+/* NB: the shape is known at compile time, so that the loops below are
+   unrolled, and the matrix is kept in the registers */
+typedef void (*small_fn) (double *y, const double *m,
+                          const double *x, size_t count);
+
+#define MADD_PLAIN(a, b, acc) ((acc) + (a) * (b))
+#define MADD_FUSED(a, b, acc) (__builtin_fma ((a), (b), (acc)))
+
+/* NB: a vector at a time, the same as apply_generic () (or the tail
+   of the SIMD kernel, with MADD_FUSED) */
+#define NMAT_SMALL_SCALAR(fn, target, R, C, B, madd) \
+    static target void \
+    fn (double *y, const double *m, const double *x, size_t count) { \
+      double mv[(R) * ((C) + (B))]; \
+      size_t i, r, c; \
+      for (c = 0; c < (R) * ((C) + (B)); c++) { mv[c] = m[c]; } \
+      for (i = 0; i < count; i++, x += (C), y += (R)) { \
+        for (r = 0; r < (R); r++) { \
+          const double *mp = mv + r * ((C) + (B)); \
+          double acc = 0; \
+          for (c = 0; c < (C); c++) { acc = madd (mp[c], x[c], acc); } \
+          if (B) { acc += mp[C]; } \
+          y[r] = acc; \
+        } \
+      } \
+    }
+
+#define PLAIN /* any target */
+
+NMAT_SMALL_SCALAR (small_generic_3x3,   PLAIN,    3, 3, 0, MADD_PLAIN)
+NMAT_SMALL_SCALAR (small_generic_3x3_1, PLAIN,    3, 3, 1, MADD_PLAIN)
+NMAT_SMALL_SCALAR (small_generic_4x4,   PLAIN,    4, 4, 0, MADD_PLAIN)
+NMAT_SMALL_SCALAR (small_generic_3x7,   PLAIN,    3, 7, 0, MADD_PLAIN)
+NMAT_SMALL_SCALAR (small_generic_3x7_1, PLAIN,    3, 7, 1, MADD_PLAIN)
+
+#ifdef HAVE_X86_DISPATCH
+
+#define AVX2_FMA __attribute__ ((target ("avx2,fma")))
+
+/* NB: the Ith elements of the vectors are stored STRIDE apart */
+static inline AVX2_FMA __attribute__ ((always_inline)) void
+store_strided (double *p, size_t stride, __m256d v)
+{
+  const __m128d lo = _mm256_castpd256_pd128 (v);
+  const __m128d hi = _mm256_extractf128_pd (v, 1);
+  _mm_storel_pd (p,              lo);
+  _mm_storeh_pd (p + stride,     lo);
+  _mm_storel_pd (p + 2 * stride, hi);
+  _mm_storeh_pd (p + 3 * stride, hi);
+}
+
+/* NB: 8 vectors at a time, with their elements gathered into the SIMD
+   registers, so that the vectors are processed side by side; the rest
+   are handed to the scalar version */
+#define NMAT_SMALL_SIMD(fn, scalar, R, C, B) \
+    static AVX2_FMA void \
+    fn (double *y, const double *m, const double *x, size_t count) { \
+      const __m128i idx = _mm_set_epi32 (3 * (C), 2 * (C), (C), 0); \
+      __m256d mv[(R) * ((C) + (B))]; \
+      size_t i, r, c; \
+      for (c = 0; c < (R) * ((C) + (B)); c++) { \
+        mv[c] = _mm256_broadcast_sd (m + c); \
+      } \
+      for (i = 0; i + 8 <= count; \
+           i += 8, x += 8 * (C), y += 8 * (R)) { \
+        __m256d xa[C], xb[C]; \
+        for (c = 0; c < (C); c++) { \
+          xa[c] = _mm256_i32gather_pd (x + c,           idx, 8); \
+          xb[c] = _mm256_i32gather_pd (x + 4 * (C) + c, idx, 8); \
+        } \
+        for (r = 0; r < (R); r++) { \
+          const __m256d *mp = mv + r * ((C) + (B)); \
+          __m256d a = _mm256_setzero_pd (), b = a; \
+          for (c = 0; c < (C); c++) { \
+            a = _mm256_fmadd_pd (mp[c], xa[c], a); \
+            b = _mm256_fmadd_pd (mp[c], xb[c], b); \
+          } \
+          if (B) { \
+            a = _mm256_add_pd (a, mp[C]); \
+            b = _mm256_add_pd (b, mp[C]); \
+          } \
+          store_strided (y + r,           (R), a); \
+          store_strided (y + 4 * (R) + r, (R), b); \
+        } \
+      } \
+      scalar (y, m, x, count - i); \
+    }
+
+NMAT_SMALL_SCALAR (small_fused_3x3,   AVX2_FMA, 3, 3, 0, MADD_FUSED)
+NMAT_SMALL_SCALAR (small_fused_3x3_1, AVX2_FMA, 3, 3, 1, MADD_FUSED)
+NMAT_SMALL_SCALAR (small_fused_4x4,   AVX2_FMA, 4, 4, 0, MADD_FUSED)
+NMAT_SMALL_SCALAR (small_fused_3x7,   AVX2_FMA, 3, 7, 0, MADD_FUSED)
+NMAT_SMALL_SCALAR (small_fused_3x7_1, AVX2_FMA, 3, 7, 1, MADD_FUSED)
+
+NMAT_SMALL_SIMD (small_avx2_3x3,   small_fused_3x3,   3, 3, 0)
+NMAT_SMALL_SIMD (small_avx2_3x3_1, small_fused_3x3_1, 3, 3, 1)
+NMAT_SMALL_SIMD (small_avx2_4x4,   small_fused_4x4,   4, 4, 0)
+NMAT_SMALL_SIMD (small_avx2_3x7,   small_fused_3x7,   3, 7, 0)
+NMAT_SMALL_SIMD (small_avx2_3x7_1, small_fused_3x7_1, 3, 7, 1)
+
+#define SMALL_AVX2(name) name
+#else
+#define SMALL_AVX2(name) 0
+#endif
+
+static const struct {
+  size_t rows, columns;
+  int bias_p;
+  small_fn generic, avx2;
+} small_kernels[] = {
+  { 3, 3, 0, small_generic_3x3,   SMALL_AVX2 (small_avx2_3x3) },
+  { 3, 3, 1, small_generic_3x3_1, SMALL_AVX2 (small_avx2_3x3_1) },
+  { 4, 4, 0, small_generic_4x4,   SMALL_AVX2 (small_avx2_4x4) },
+  { 3, 7, 0, small_generic_3x7,   SMALL_AVX2 (small_avx2_3x7) },
+  { 3, 7, 1, small_generic_3x7_1, SMALL_AVX2 (small_avx2_3x7_1) }
+};
+
+/*** The blocked kernel */
+
+#ifdef HAVE_X86_DISPATCH
+
+/* NB: the vectors are taken BLOCK_VECTORS at a time, and their
+   elements are packed (transposed) BLOCK_COLUMNS at a time, so that
+   the panel being multiplied stays in the cache; the products for 4
+   rows of the matrix and 8 vectors are accumulated in the registers,
+   with the partial sums for the block kept in YP between the panels.
+   The bias is packed as the last column of 1's */
+enum {
+  BLOCK_VECTORS = 256,
+  BLOCK_COLUMNS = 128,
+  TILE_ROWS = 4,
+  TILE_VECTORS = 8
+};
+
+/* NB: YP is at YP[R * NP + I], M at M[R * MC + C0], and XP at XP[I]
+   of the panel; NR is a constant once inlined */
+static inline AVX2_FMA __attribute__ ((always_inline)) void
+tile_avx2 (size_t nr, double *yp, size_t np,
+           const double *m, size_t mc,
+           const double *xp, size_t kc)
+{
+  __m256d acc[TILE_ROWS][2];
+  size_t c, k;
+  for (k = 0; k < nr; k++) {
+    acc[k][0] = _mm256_load_pd (yp + k * np);
+    acc[k][1] = _mm256_load_pd (yp + k * np + 4);
+  }
+  for (c = 0; c < kc; c++, xp += np) {
+    const __m256d x0 = _mm256_load_pd (xp);
+    const __m256d x1 = _mm256_load_pd (xp + 4);
+    for (k = 0; k < nr; k++) {
+      const __m256d b = _mm256_broadcast_sd (m + k * mc + c);
+      acc[k][0] = _mm256_fmadd_pd (b, x0, acc[k][0]);
+      acc[k][1] = _mm256_fmadd_pd (b, x1, acc[k][1]);
+    }
+  }
+  for (k = 0; k < nr; k++) {
+    _mm256_store_pd (yp + k * np,     acc[k][0]);
+    _mm256_store_pd (yp + k * np + 4, acc[k][1]);
+  }
+}
+
+static AVX2_FMA int
+apply_avx2 (double *y, const double *m,
+            size_t rows, size_t columns, int bias_p,
+            const double *x, size_t count)
+{
+  const size_t mc = columns + (bias_p ? 1 : 0);
+  double *xp, *yp;
+  size_t i0;
+
+  if (posix_memalign ((void **)&xp, 32,
+                      BLOCK_COLUMNS * BLOCK_VECTORS * sizeof (*xp))
+      != 0) {
+    /* . */
+    return -1;
+  }
+  if (posix_memalign ((void **)&yp, 32,
+                      rows * BLOCK_VECTORS * sizeof (*yp))
+      != 0) {
+    free (xp);
+    /* . */
+    return -1;
+  }
+
+  for (i0 = 0; i0 < count; i0 += BLOCK_VECTORS) {
+    const size_t n = MIN (BLOCK_VECTORS, count - i0);
+    /* NB: the extra vectors of the last tile are zeroes */
+    const size_t np
+      = (n + TILE_VECTORS - 1) / TILE_VECTORS * TILE_VECTORS;
+    const double *xb = x + i0 * columns;
+    double *yb = y + i0 * rows;
+    size_t c0, i, r;
+
+    memset (yp, 0, rows * np * sizeof (*yp));
+    for (c0 = 0; c0 < mc; c0 += BLOCK_COLUMNS) {
+      const size_t kc = MIN (BLOCK_COLUMNS, mc - c0);
+      size_t c;
+      for (c = 0; c < kc; c++) {
+        double *p = xp + c * np;
+        if (c0 + c < columns) {
+          for (i = 0; i < n; i++) {
+            p[i] = xb[i * columns + c0 + c];
+          }
+        } else {
+          for (i = 0; i < n; i++) {
+            p[i] = 1;
+          }
+        }
+        for (; i < np; i++) {
+          p[i] = 0;
+        }
+      }
+      for (r = 0; r < rows; r += TILE_ROWS) {
+        const size_t nr = MIN (TILE_ROWS, rows - r);
+        const double *mp = m + r * mc + c0;
+        for (i = 0; i < np; i += TILE_VECTORS) {
+          double *p = yp + r * np + i;
+          switch (nr) {
+          case 4: tile_avx2 (4, p, np, mp, mc, xp + i, kc); break;
+          case 3: tile_avx2 (3, p, np, mp, mc, xp + i, kc); break;
+          case 2: tile_avx2 (2, p, np, mp, mc, xp + i, kc); break;
+          default:
+            tile_avx2 (1, p, np, mp, mc, xp + i, kc);
+            break;
+          }
+        }
+      }
+    }
+    for (i = 0; i < n; i++) {
+      for (r = 0; r < rows; r++) {
+        yb[i * rows + r] = yp[r * np + i];
+      }
+    }
+  }
+  free (xp);
+  free (yp);
+
+  /* . */
+  return 0;
+}
+
+#define CPU_HAS(feature) (__builtin_cpu_init (), \
+                          __builtin_cpu_supports (feature))
+
+/* NB: the CPU is checked once, on the first call, which may well be
+   made by several threads at once (as with rawmatrix --jobs) */
+static int have_avx2_p;
+static pthread_once_t avx2_once = PTHREAD_ONCE_INIT;
+
+static void
+check_avx2 (void)
+{
+  have_avx2_p = (CPU_HAS ("avx2") && CPU_HAS ("fma"));
+}
+
+#endif
+
+/*** Interface */
+
+void
+nmat_apply (double *y, const double *m,
+            size_t rows, size_t columns, int bias_p,
+            const double *x, size_t count)
+{
+#ifdef HAVE_CBLAS
+  const size_t mc = columns + (bias_p ? 1 : 0);
+#endif
+  int avx2_p = 0;
+  size_t k;
+
+#ifdef HAVE_X86_DISPATCH
+  pthread_once (&avx2_once, check_avx2);
+  avx2_p = have_avx2_p;
+#endif
+
+  for (k = 0; k < sizeof (small_kernels) / sizeof (*small_kernels);
+       k++) {
+    if (small_kernels[k].rows       == rows
+        && small_kernels[k].columns == columns
+        && ! small_kernels[k].bias_p == ! bias_p) {
+      if (avx2_p) {
+        small_kernels[k].avx2 (y, m, x, count);
+      } else {
+        small_kernels[k].generic (y, m, x, count);
+      }
+      /* . */
+      return;
+    }
+  }
+
+#ifdef HAVE_CBLAS
+  if (rows <= INT_MAX && mc <= INT_MAX) {
+    /* NB: Y = X M^T, with the rows of X and Y being the vectors; the
+       bias is then added */
+    while (count > 0) {
+      const size_t n = MIN (count, (size_t)INT_MAX);
+      cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasTrans,
+                   (int)n, (int)rows, (int)columns,
+                   1., x, (int)columns, m, (int)mc,
+                   0., y, (int)rows);
+      if (bias_p) {
+        size_t i, r;
+        for (i = 0; i < n; i++) {
+          for (r = 0; r < rows; r++) {
+            y[i * rows + r] += m[r * mc + columns];
+          }
+        }
+      }
+      x += n * columns;
+      y += n * rows;
+      count -= n;
+    }
+    /* . */
+    return;
+  }
+#endif
+#ifdef HAVE_X86_DISPATCH
+  /* NB: falling back to the generic kernel if out of memory */
+  if (avx2_p
+      && apply_avx2 (y, m, rows, columns, bias_p, x, count) == 0) {
+    /* . */
+    return;
+  }
+#endif
+  apply_generic (y, m, rows, columns, bias_p, x, count);
+}
+
+/*** Single precision */
+
+/* NB: the rounding error of each addition is carried along (Kahan) */
+#define KAHAN_ADD(acc, comp, term) \
+    { \
+      const float ka_y = (term) - (comp), ka_t = (acc) + ka_y; \
+      (comp) = (ka_t - (acc)) - ka_y; \
+      (acc)  = ka_t; \
+    }
+
+static void
+apply_float_generic (float *y, const float *m,
+                     size_t rows, size_t columns, int bias_p,
+                     const float *x, size_t count, int compensated_p)
+{
+  const size_t mc = columns + (bias_p ? 1 : 0);
+  size_t i;
+  for (i = 0; i < count; i++, x += columns, y += rows) {
+    const float *mp;
+    size_t r;
+    for (r = 0, mp = m; r < rows; r++, mp += mc) {
+      float acc = 0, comp = 0;
+      size_t c;
+      for (c = 0; c < mc; c++) {
+        const float term = (c < columns) ? mp[c] * x[c] : mp[c];
+        if (compensated_p) {
+          KAHAN_ADD (acc, comp, term);
+        } else {
+          acc += term;
+        }
+      }
+      y[r] = acc;
+    }
+  }
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+enum {
+  FLOAT_LANES = 8,
+  FLOAT_TILE_VECTORS = 4,
+  /* NB: in the lanes, two registers of them */
+  FLOAT_TILE_ROWS = 2 * FLOAT_LANES
+};
+
+/* NB: MT is the matrix transposed, with the rows padded to RP; the
+   rows R to R + 16 of NV vectors are computed at once, and the rows
+   past ROWS are left out; NV is a constant once inlined */
+static inline AVX2_FMA __attribute__ ((always_inline)) void
+tile_float_avx2 (size_t nv, float *y, size_t rows, size_t r,
+                 const float *mt, size_t rp, size_t mc, size_t columns,
+                 const float *x, int compensated_p)
+{
+  const __m256i lanes = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 acc[FLOAT_TILE_VECTORS][2], comp[FLOAT_TILE_VECTORS][2];
+  size_t c, k, h;
+  for (k = 0; k < nv; k++) {
+    for (h = 0; h < 2; h++) {
+      acc[k][h] = comp[k][h] = _mm256_setzero_ps ();
+    }
+  }
+  for (c = 0; c < mc; c++) {
+    const float *mp = mt + c * rp + r;
+    const __m256 m0 = _mm256_load_ps (mp), m1 = _mm256_load_ps (mp + 8);
+    for (k = 0; k < nv; k++) {
+      /* NB: the bias is the product of the last column by 1 */
+      const __m256 xb = (c < columns
+                         ? _mm256_broadcast_ss (x + k * columns + c)
+                         : _mm256_set1_ps (1));
+      if (! compensated_p) {
+        acc[k][0] = _mm256_fmadd_ps (m0, xb, acc[k][0]);
+        acc[k][1] = _mm256_fmadd_ps (m1, xb, acc[k][1]);
+      } else {
+        for (h = 0; h < 2; h++) {
+          const __m256
+            t = _mm256_fmsub_ps (h ? m1 : m0, xb, comp[k][h]),
+            u = _mm256_add_ps (acc[k][h], t);
+          comp[k][h] = _mm256_sub_ps (_mm256_sub_ps (u, acc[k][h]), t);
+          acc[k][h]  = u;
+        }
+      }
+    }
+  }
+  for (h = 0; h < 2; h++) {
+    const size_t rh = r + h * FLOAT_LANES;
+    if (rh >= rows) {
+      break;
+    }
+    if (rh + FLOAT_LANES <= rows) {
+      for (k = 0; k < nv; k++) {
+        _mm256_storeu_ps (y + k * rows + rh, acc[k][h]);
+      }
+    } else {
+      const __m256i mask
+        = _mm256_cmpgt_epi32 (_mm256_set1_epi32 ((int)(rows - rh)),
+                              lanes);
+      for (k = 0; k < nv; k++) {
+        _mm256_maskstore_ps (y + k * rows + rh, mask, acc[k][h]);
+      }
+    }
+  }
+}
+
+/* NB: the matrix is transposed, so that the rows are in the lanes,
+   and the elements of 4 vectors at a time are broadcast, with the
+   products fused */
+static AVX2_FMA int
+apply_float_avx2 (float *y, const float *m,
+                  size_t rows, size_t columns, int bias_p,
+                  const float *x, size_t count, int compensated_p)
+{
+  const size_t
+    mc = columns + (bias_p ? 1 : 0),
+    rp = (rows + FLOAT_TILE_ROWS - 1) / FLOAT_TILE_ROWS * FLOAT_TILE_ROWS;
+  float *mt;
+  size_t i, r, c;
+
+  if (rows > INT_MAX
+      || posix_memalign ((void **)&mt, 32,
+                         MAX (mc * rp, 1) * sizeof (*mt))
+      != 0) {
+    /* . */
+    return -1;
+  }
+  memset (mt, 0, mc * rp * sizeof (*mt));
+  for (r = 0; r < rows; r++) {
+    for (c = 0; c < mc; c++) {
+      mt[c * rp + r] = m[r * mc + c];
+    }
+  }
+  for (i = 0; i < count; i += FLOAT_TILE_VECTORS) {
+    const size_t nv = MIN (FLOAT_TILE_VECTORS, count - i);
+    const float *xb = x + i * columns;
+    float *yb = y + i * rows;
+    for (r = 0; r < rows; r += FLOAT_TILE_ROWS) {
+      switch (nv) {
+      case 4:
+        tile_float_avx2 (4, yb, rows, r, mt, rp, mc, columns, xb,
+                         compensated_p);
+        break;
+      case 3:
+        tile_float_avx2 (3, yb, rows, r, mt, rp, mc, columns, xb,
+                         compensated_p);
+        break;
+      case 2:
+        tile_float_avx2 (2, yb, rows, r, mt, rp, mc, columns, xb,
+                         compensated_p);
+        break;
+      default:
+        tile_float_avx2 (1, yb, rows, r, mt, rp, mc, columns, xb,
+                         compensated_p);
+        break;
+      }
+    }
+  }
+  free (mt);
+
+  /* . */
+  return 0;
+}
+
+#endif
+
+void
+nmat_apply_float (float *y, const float *m,
+                  size_t rows, size_t columns, int bias_p,
+                  const float *x, size_t count, int compensated_p)
+{
+#ifdef HAVE_X86_DISPATCH
+  /* NB: falling back to the generic kernel if out of memory */
+  pthread_once (&avx2_once, check_avx2);
+  if (have_avx2_p
+      && apply_float_avx2 (y, m, rows, columns, bias_p, x, count,
+                           compensated_p) == 0) {
+    /* . */
+    return;
+  }
+#endif
+  apply_float_generic (y, m, rows, columns, bias_p, x, count,
+                       compensated_p);
+}
+
+double
+nmat_sum_error (size_t terms, int float_p, int compensated_p)
+{
+  const double u = ldexp (1, float_p ? -24 : -53);
+  /* NB: the products (unless fused) and the sums are rounded; the
+     bound of the compensated sum doesn't grow with the number of
+     the terms, save for the second order */
+  const double n = terms + 1;
+
+  /* . */
+  return (compensated_p
+          ? 3 * u + 2 * n * u * u
+          : n * u / (1 - n * u));
+}
+
+/*** The sparse form */
+
+/* NB: the sparse form is used if at most 1 / SPARSE_RATIO of the
+   elements are nonzero */
+#define SPARSE_RATIO 4
+
+int
+nmat_sparse_init (struct nmat_sparse *sp, const double *m,
+                  size_t rows, size_t columns, int bias_p, int finite_p)
+{
+  const size_t mc = columns + (bias_p ? 1 : 0);
+  size_t nnz = 0, r, c, k;
+  int gather_p = 1, select_p = 1;
+
+  sp->row_ptr = sp->cols = 0;
+  sp->values = sp->bias = 0;
+  for (r = 0; r < rows; r++) {
+    size_t row_nnz = 0;
+    for (c = 0; c < columns; c++) {
+      if (m[r * mc + c] != 0) {
+        row_nnz++;
+        select_p = select_p && m[r * mc + c] == 1;
+      }
+    }
+    gather_p = gather_p && row_nnz <= 1;
+    select_p = (select_p && row_nnz == 1
+                && (! bias_p || m[r * mc + columns] == 0));
+    nnz += row_nnz;
+  }
+  if (! gather_p && nnz * SPARSE_RATIO > rows * columns) {
+    /* . */
+    return 0;
+  }
+
+  sp->rows     = rows;
+  sp->columns  = columns;
+  sp->select_p = select_p;
+  sp->finite_p = finite_p;
+  if (MALLOC_ARY (sp->row_ptr, rows + 1) == 0
+      || MALLOC_ARY (sp->cols,   MAX (nnz, 1)) == 0
+      || MALLOC_ARY (sp->values, MAX (nnz, 1)) == 0
+      || (bias_p && ! select_p
+          && MALLOC_ARY (sp->bias, rows) == 0)) {
+    nmat_sparse_free (sp);
+    /* . */
+    return -1;
+  }
+  for (r = 0, k = 0; r < rows; r++) {
+    sp->row_ptr[r] = k;
+    for (c = 0; c < columns; c++) {
+      if (m[r * mc + c] != 0) {
+        sp->cols[k]   = c;
+        sp->values[k] = m[r * mc + c];
+        k++;
+      }
+    }
+    if (sp->bias != 0) {
+      sp->bias[r] = m[r * mc + columns];
+    }
+  }
+  sp->row_ptr[rows] = k;
+
+  /* . */
+  return 1;
+}
+
+void
+nmat_sparse_free (struct nmat_sparse *sp)
+{
+  free (sp->row_ptr);
+  free (sp->cols);
+  free (sp->values);
+  free (sp->bias);
+  sp->row_ptr = sp->cols = 0;
+  sp->values = sp->bias = 0;
+}
+
+/* NB: the number of the elements of X which aren't finite */
+static size_t
+nonfinite_count (const double *x, size_t count)
+{
+  size_t c, n = 0;
+
+  for (c = 0; c < count; c++) {
+    n += ! isfinite (x[c]);
+  }
+
+  /* . */
+  return n;
+}
+
+void
+nmat_sparse_apply (double *y, const struct nmat_sparse *sp,
+                   const double *x, size_t count)
+{
+  const size_t rows = sp->rows, columns = sp->columns;
+  const size_t *const row_ptr = sp->row_ptr, *const cols = sp->cols;
+  const double *const values = sp->values, *const bias = sp->bias;
+  size_t i, r, k;
+
+  /* NB: in the dense product, a zero times a NaN or an infinity is a
+     NaN, and so is the sum; thus, a row is NaN if the vector has a
+     non-finite element in any of the columns the row skips; these
+     aren't looked for in the vectors known to be finite */
+  if (sp->select_p) {
+    /* NB: a mere gather */
+    for (i = 0; i < count; i++, x += columns, y += rows) {
+      const size_t nf
+        = (sp->finite_p ? 0 : nonfinite_count (x, columns));
+      for (r = 0; r < rows; r++) {
+        y[r] = (nf > (size_t)! isfinite (x[cols[r]])
+                ? NAN : x[cols[r]]);
+      }
+    }
+    /* . */
+    return;
+  }
+  for (i = 0; i < count; i++, x += columns, y += rows) {
+    const size_t nf
+      = (sp->finite_p ? 0 : nonfinite_count (x, columns));
+    for (r = 0; r < rows; r++) {
+      double acc = 0;
+      size_t used = 0;
+      for (k = row_ptr[r]; k < row_ptr[r + 1]; k++) {
+        acc += values[k] * x[cols[k]];
+      }
+      if (nf > 0) {
+        for (k = row_ptr[r]; k < row_ptr[r + 1]; k++) {
+          used += ! isfinite (x[cols[k]]);
+        }
+        if (used < nf) {
+          acc = NAN;
+        }
+      }
+      if (bias != 0) {
+        acc += bias[r];
+      }
+      y[r] = acc;
+    }
+  }
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** nummat.c ends here */
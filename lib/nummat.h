@@ -0,0 +1,101 @@
+/*** nummat.h --- Multiplying vectors by a matrix  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMMAT_H
+#define NUMMAT_H
+
+#include <stddef.h>             /* for size_t */
+
+/* NB: the COUNT vectors of COLUMNS elements each, X, are multiplied
+   by the ROWS x COLUMNS matrix M (stored by the rows), giving the
+   COUNT vectors of ROWS elements each, Y; i.e., Y = X M^T, for X and
+   Y stored by the vectors.  If BIAS_P, M has one more column, which
+   is added to the products, as if the vectors had the trailing
+   element of 1.  Unless the BLAS library is used, the products are
+   summed in the order of the columns, the same as in the naive loop
+   (although with the fused multiply-add, where available.)  The
+   common small shapes (3 x 3, 4 x 4, 3 x 7, and 3 x 3 and 3 x 7 with
+   the bias) have kernels of their own */
+void nmat_apply (double *y, const double *m,
+                 size_t rows, size_t columns, int bias_p,
+                 const double *x, size_t count);
+
+/* NB: the same as nmat_apply (), but in single precision, with the
+   products fused, where available; with COMPENSATED_P, the rounding
+   errors of the sums are carried along (Kahan), so that the error
+   doesn't grow with the number of the columns */
+void nmat_apply_float (float *y, const float *m,
+                       size_t rows, size_t columns, int bias_p,
+                       const float *x, size_t count,
+                       int compensated_p);
+/* NB: the bound of the error of the sums of TERMS products, relative
+   to the sum of the magnitudes of the products, for the double or
+   single precision, with or without the compensation */
+double nmat_sum_error (size_t terms, int float_p, int compensated_p);
+
+/* NB: the sparse form of the matrix, holding its nonzero elements
+   only, by the rows (CSR); the bias, if any, is kept apart.  If each
+   row is a single 1 and there's no bias (as for the permutations and
+   selections of the elements), SELECT_P is set, and COLS[ROW] is the
+   element selected by the row */
+struct nmat_sparse {
+  size_t rows, columns;
+  /* NB: the nonzeros of the row R are from ROW_PTR[R] to
+     ROW_PTR[R + 1] - 1 */
+  size_t *row_ptr, *cols;
+  double *values;
+  /* NB: 0 if there's no bias */
+  double *bias;
+  int select_p;
+  /* NB: the vectors are known to be finite */
+  int finite_p;
+};
+
+/* NB: the sparse form is made if at most one element in four of M is
+   nonzero, or if each row has at most one (as for the diagonal
+   matrices), and is then used instead of M; FINITE_P tells that the
+   vectors have no NaN's or infinities (as for the integer data), so
+   that these aren't looked for.  Return 1 if it's made, 0 if it isn't,
+   and -1 (with errno set) on failure */
+int  nmat_sparse_init (struct nmat_sparse *sp, const double *m,
+                       size_t rows, size_t columns, int bias_p,
+                       int finite_p);
+void nmat_sparse_free (struct nmat_sparse *sp);
+
+/* NB: the same as nmat_apply (), but for the sparse form, at the cost
+   of the nonzeros only; the products are summed in the order of the
+   columns, without the fused multiply-add.  The NaN's and infinities
+   spread to the result as with the dense product, where the zeros
+   times them are NaN */
+void nmat_sparse_apply (double *y, const struct nmat_sparse *sp,
+                        const double *x, size_t count);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** nummat.h ends here */
@@ -0,0 +1,372 @@
+/*** numquant.c --- Mergeable Quantile Sketches  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <math.h>               /* for isnan (), NAN */
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+#include <stdlib.h>             /* for malloc (), qsort () */
+#include <string.h>             /* for memcpy () */
+
+#include "numquant.h"
+#include "usemacro.h"           /* for MALLOC_ARY () */
+
+/*** Sorting */
+
+/* NB: the compaction sorts K doubles at a time, so there's a sort
+   specialized for these, with no comparison function calls */
+#define INSERTION_SORT_MAX 16
+
+static void
+sort_doubles (double *v, size_t n)
+{
+  while (n > INSERTION_SORT_MAX) {
+    const double a = v[0], b = v[n / 2], c = v[n - 1];
+    const double pivot
+      = (a < b) ? ((b < c) ? b : (a < c) ? c : a)
+      : ((a < c) ? a : (b < c) ? c : b);
+    size_t i = 0, j = n - 1;
+    for (;;) {
+      while (v[i] < pivot) { i++; }
+      while (v[j] > pivot) { j--; }
+      if (i >= j) { break; }
+      {
+        const double t = v[i];
+        v[i++] = v[j];
+        v[j--] = t;
+      }
+    }
+    /* NB: recurse into the smaller part */
+    if (j + 1 < n - j - 1) {
+      sort_doubles (v, j + 1);
+      v += j + 1;
+      n -= j + 1;
+    } else {
+      sort_doubles (v + j + 1, n - j - 1);
+      n = j + 1;
+    }
+  }
+  {
+    size_t i;
+    for (i = 1; i < n; i++) {
+      const double t = v[i];
+      size_t j;
+      for (j = i; j > 0 && v[j - 1] > t; j--) {
+        v[j] = v[j - 1];
+      }
+      v[j] = t;
+    }
+  }
+}
+
+/*** Compactors */
+
+/* NB: xorshift64* */
+static int
+random_bit (struct nquant *q)
+{
+  q->rng ^= q->rng >> 12;
+  q->rng ^= q->rng << 25;
+  q->rng ^= q->rng >> 27;
+  /* . */
+  return (q->rng * UINT64_C (2685821657736338717)) >> 63;
+}
+
+/* NB: a level holds up to 2K - 1 values, as a merge could add K - 1
+   values to the K - 1 already there */
+static int
+ensure_level (struct nquant *q, size_t level)
+{
+  while (q->levels <= level) {
+    const size_t n = q->levels;
+    double **items;
+    size_t *lens;
+    if ((items = realloc (q->items, (n + 1) * sizeof (*items))) == 0) {
+      /* . */
+      return -1;
+    }
+    q->items = items;
+    if ((lens = realloc (q->lens, (n + 1) * sizeof (*lens))) == 0) {
+      /* . */
+      return -1;
+    }
+    q->lens = lens;
+    if (MALLOC_ARY (q->items[n], 2 * q->k) == 0) {
+      /* . */
+      return -1;
+    }
+    q->lens[n] = 0;
+    q->levels  = n + 1;
+  }
+
+  /* . */
+  return 0;
+}
+
+/* NB: move every other one of the sorted values up one level; the
+   largest one stays if there's an odd number of them */
+static int
+compact (struct nquant *q, size_t level)
+{
+  size_t h;
+
+  for (h = level; h < q->levels && q->lens[h] >= q->k; h++) {
+    double *v;
+    size_t n, i, up;
+    if (ensure_level (q, h + 1) < 0) {
+      /* . */
+      return -1;
+    }
+    v = q->items[h];
+    n = q->lens[h];
+    sort_doubles (v, n);
+    for (i = random_bit (q), up = q->lens[h + 1];
+         i < n - n % 2;
+         i += 2) {
+      q->items[h + 1][up++] = v[i];
+    }
+    q->lens[h + 1] = up;
+    if (n % 2 != 0) {
+      v[0] = v[n - 1];
+      q->lens[h] = 1;
+    } else {
+      q->lens[h] = 0;
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
+/*** Interface */
+
+int
+nquant_init (struct nquant *q, size_t k)
+{
+  if (k < 2) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  q->k      = k;
+  q->levels = 0;
+  q->items  = 0;
+  q->lens   = 0;
+  q->count  = 0;
+  q->rng    = UINT64_C (0x9e3779b97f4a7c15);
+
+  /* . */
+  return ensure_level (q, 0);
+}
+
+void
+nquant_free (struct nquant *q)
+{
+  size_t h;
+  for (h = 0; h < q->levels; h++) {
+    free (q->items[h]);
+  }
+  free (q->items);
+  free (q->lens);
+  q->items  = 0;
+  q->lens   = 0;
+  q->levels = 0;
+}
+
+int
+nquant_add_doubles (struct nquant *q, const double *vec, size_t size)
+{
+  size_t i;
+  double *v = q->items[0];
+  size_t n = q->lens[0];
+
+  for (i = 0; i < size; i++) {
+    if (isnan (vec[i])) {
+      continue;
+    }
+    v[n++] = vec[i];
+    q->count++;
+    if (n >= q->k) {
+      q->lens[0] = n;
+      if (compact (q, 0) < 0) {
+        /* . */
+        return -1;
+      }
+      n = q->lens[0];
+    }
+  }
+  q->lens[0] = n;
+
+  /* . */
+  return 0;
+}
+
+int
+nquant_add_repeated (struct nquant *q, double value, uint64_t count)
+{
+  size_t h;
+
+  if (isnan (value)) {
+    /* . */
+    return 0;
+  }
+  q->count += count;
+  for (h = 0; count > 0; h++, count >>= 1) {
+    if ((count & 1) == 0) {
+      continue;
+    }
+    if (ensure_level (q, h) < 0) {
+      /* . */
+      return -1;
+    }
+    q->items[h][q->lens[h]++] = value;
+    if (compact (q, h) < 0) {
+      /* . */
+      return -1;
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
+int
+nquant_merge (struct nquant *q, const struct nquant *other)
+{
+  size_t h;
+
+  if (other->k != q->k) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  if (other->levels > 0 && ensure_level (q, other->levels - 1) < 0) {
+    /* . */
+    return -1;
+  }
+  for (h = 0; h < other->levels; h++) {
+    memcpy (q->items[h] + q->lens[h], other->items[h],
+            other->lens[h] * sizeof (double));
+    q->lens[h] += other->lens[h];
+  }
+  for (h = 0; h < q->levels; h++) {
+    if (compact (q, h) < 0) {
+      /* . */
+      return -1;
+    }
+  }
+  q->count += other->count;
+  q->rng   ^= other->rng;
+
+  /* . */
+  return 0;
+}
+
+struct weighted {
+  double value;
+  uint64_t weight;
+};
+
+static int
+weighted_cmp (const void *a, const void *b)
+{
+  const double
+    da = ((const struct weighted *)a)->value,
+    db = ((const struct weighted *)b)->value;
+
+  /* . */
+  return (da > db) - (da < db);
+}
+
+int
+nquant_quantiles (const struct nquant *q, const double *probs,
+                  size_t count, double *values)
+{
+  struct weighted *w;
+  size_t n, h, i, j;
+
+  for (n = 0, h = 0; h < q->levels; h++) {
+    n += q->lens[h];
+  }
+  if (n == 0) {
+    for (i = 0; i < count; i++) {
+      values[i] = NAN;
+    }
+    /* . */
+    return 0;
+  }
+  if (MALLOC_ARY (w, n) == 0) {
+    /* . */
+    return -1;
+  }
+  for (j = 0, h = 0; h < q->levels; h++) {
+    for (i = 0; i < q->lens[h]; i++, j++) {
+      w[j].value  = q->items[h][i];
+      w[j].weight = (uint64_t)1 << h;
+    }
+  }
+  qsort (w, n, sizeof (*w), weighted_cmp);
+  for (j = 1; j < n; j++) {
+    w[j].weight += w[j - 1].weight;
+  }
+
+  /* NB: the least value whose (cumulative) rank is not less than
+     P times the count */
+  for (i = 0; i < count; i++) {
+    const double rank = probs[i] * q->count;
+    size_t lo = 0, hi = n - 1;
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (w[mid].weight < rank) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    values[i] = w[lo].value;
+  }
+  free (w);
+
+  /* . */
+  return 0;
+}
+
+double
+nquant_error_bound (const struct nquant *q)
+{
+  /* . */
+  return 7.5 / q->k;
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numquant.c ends here */
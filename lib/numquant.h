@@ -0,0 +1,88 @@
+/*** numquant.h --- Mergeable Quantile Sketches  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMQUANT_H
+#define NUMQUANT_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+/* NB: the sketch is a stack of compactors (as in the KLL sketch, but
+   all of the same capacity K): the values of weight 2^H are kept at
+   the level H, and once there're K of them, they're sorted, and every
+   other one (starting with the first or the second, at random) is
+   moved to the level H + 1.
+
+   The error in the rank of a quantile is a sum of independent terms,
+   one per compaction at the level H, each of zero mean and bounded by
+   2^H; there're at most 2N / (K 2^H) of these, so that (Hoeffding) the
+   normalized rank error exceeds E with probability of at most
+   2 exp (-E^2 K^2 / 8).  With the weights of the values returned being
+   at most N / K, the rank error is thus within 7.5 / K of N with the
+   probability of 99%.  (For K = 4096, this is 0.18%.)  The sketch takes
+   K log2 (N / K) doubles at most.  Merging retains the bound.  */
+
+#define NQUANT_DEFAULT_K 4096
+
+struct nquant {
+  size_t k;
+  /* the number of levels allocated, and their contents */
+  size_t levels;
+  double **items;
+  size_t *lens;
+  /* the number of the values added */
+  uint64_t count;
+  /* the random state for choosing the halves */
+  uint64_t rng;
+};
+
+/* NB: return -1 and set errno on failure */
+int  nquant_init (struct nquant *q, size_t k);
+void nquant_free (struct nquant *q);
+
+/* NB: NaN's are not added */
+int  nquant_add_doubles (struct nquant *q,
+                         const double *vec, size_t size);
+int  nquant_merge (struct nquant *q, const struct nquant *other);
+/* NB: COUNT copies of VALUE are added at once, as the values of the
+   weights of the powers of 2 making up COUNT, with no loss of
+   accuracy */
+int  nquant_add_repeated (struct nquant *q, double value,
+                          uint64_t count);
+
+/* NB: PROBS are in [0, 1]; the values are NaN for an empty sketch */
+int  nquant_quantiles (const struct nquant *q, const double *probs,
+                       size_t count, double *values);
+
+/* the rank error (as a fraction of the count) at the 99% level */
+double nquant_error_bound (const struct nquant *q);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numquant.h ends here */
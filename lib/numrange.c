@@ -19,40 +19,315 @@
  */
 
 /*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>            /* for pthread_once () */
 #include <stddef.h>             /* for size_t */
 #include <stdint.h>
 
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "numrange.h"
+
+/* NB: the scalar loop keeps four independent accumulators, so that
+   there's no single compare chain; as in the original loop, a NaN
+   value is never picked up, unless it's the initial one */
+#define NUM_RANGE_EXTEND_GENERIC(fn, type) \
+    static void \
+    fn (const type *vec, size_t size, type *minp, type *maxp) { \
+      type mn[4], mx[4]; \
+      size_t i, k; \
+      for (k = 0; k < 4; k++) { \
+        mn[k] = *minp; \
+        mx[k] = *maxp; \
+      } \
+      for (i = 0; i + 4 <= size; i += 4) { \
+        for (k = 0; k < 4; k++) { \
+          const type v = vec[i + k]; \
+          mn[k] = (v < mn[k]) ? v : mn[k]; \
+          mx[k] = (v > mx[k]) ? v : mx[k]; \
+        } \
+      } \
+      for (; i < size; i++) { \
+        const type v = vec[i]; \
+        mn[0] = (v < mn[0]) ? v : mn[0]; \
+        mx[0] = (v > mx[0]) ? v : mx[0]; \
+      } \
+      for (k = 1; k < 4; k++) { \
+        mn[0] = (mn[k] < mn[0]) ? mn[k] : mn[0]; \
+        mx[0] = (mx[k] > mx[0]) ? mx[k] : mx[0]; \
+      } \
+      *minp = mn[0]; \
+      *maxp = mx[0]; \
+    }
+
+/* NB: the SIMD kernels keep four vector accumulators for either of
+   the extrema, and reduce them horizontally at the end; the remaining
+   elements are handed to the generic version.  The new value is always
+   the first operand of the min/max instructions, so that NaN's are
+   ignored in the very same way as above */
+#define NUM_RANGE_EXTEND_SIMD(fn, generic, type, target, vtype, lanes, \
+                              load, store, set1, vmin, vmax) \
+    static target void \
+    fn (const type *vec, size_t size, type *minp, type *maxp) { \
+      vtype mn0 = set1 (*minp), mn1 = mn0, mn2 = mn0, mn3 = mn0; \
+      vtype mx0 = set1 (*maxp), mx1 = mx0, mx2 = mx0, mx3 = mx0; \
+      type t_mn[lanes], t_mx[lanes]; \
+      size_t i, k; \
+      for (i = 0; i + 4 * (lanes) <= size; i += 4 * (lanes)) { \
+        const vtype \
+          a = load (vec + i), \
+          b = load (vec + i + (lanes)), \
+          c = load (vec + i + 2 * (lanes)), \
+          d = load (vec + i + 3 * (lanes)); \
+        mn0 = vmin (a, mn0); mx0 = vmax (a, mx0); \
+        mn1 = vmin (b, mn1); mx1 = vmax (b, mx1); \
+        mn2 = vmin (c, mn2); mx2 = vmax (c, mx2); \
+        mn3 = vmin (d, mn3); mx3 = vmax (d, mx3); \
+      } \
+      store (t_mn, vmin (vmin (mn0, mn1), vmin (mn2, mn3))); \
+      store (t_mx, vmax (vmax (mx0, mx1), vmax (mx2, mx3))); \
+      for (k = 0; k < (lanes); k++) { \
+        if (t_mn[k] < *minp) { *minp = t_mn[k]; } \
+        if (t_mx[k] > *maxp) { *maxp = t_mx[k]; } \
+      } \
+      generic (vec + i, size - i, minp, maxp); \
+    }
+
+NUM_RANGE_EXTEND_GENERIC (extend_generic_int8_t,   int8_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_int16_t,  int16_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_int32_t,  int32_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_int64_t,  int64_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_uint8_t,  uint8_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_uint16_t, uint16_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_uint32_t, uint32_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_uint64_t, uint64_t)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_float,    float)
+NUM_RANGE_EXTEND_GENERIC (extend_generic_double,   double)
+
+#ifdef HAVE_X86_DISPATCH
+
+#define SSE2   __attribute__ ((target ("sse2")))
+#define SSE41  __attribute__ ((target ("sse4.1")))
+#define AVX2   __attribute__ ((target ("avx2")))
+
+/** 128-bit kernels */
+
+#define LOAD_SI128(p)     _mm_loadu_si128 ((const __m128i *)(p))
+#define STORE_SI128(p, v) _mm_storeu_si128 ((__m128i *)(p), (v))
+
+/* NB: the set1 intrinsics take signed arguments; wrap them so that
+   the initial extrema are passed as is */
+#define SET1(fn, target, vtype, type, intrinsic) \
+    static target vtype fn (type v) { return intrinsic (v); }
+
+SET1 (set1_u8_128,  SSE2, __m128i, uint8_t,  _mm_set1_epi8)
+SET1 (set1_i8_128,  SSE2, __m128i, int8_t,   _mm_set1_epi8)
+SET1 (set1_u16_128, SSE2, __m128i, uint16_t, _mm_set1_epi16)
+SET1 (set1_i16_128, SSE2, __m128i, int16_t,  _mm_set1_epi16)
+SET1 (set1_u32_128, SSE2, __m128i, uint32_t, _mm_set1_epi32)
+SET1 (set1_i32_128, SSE2, __m128i, int32_t,  _mm_set1_epi32)
+
+NUM_RANGE_EXTEND_SIMD (extend_sse2_uint8_t,  extend_generic_uint8_t,
+                       uint8_t,  SSE2, __m128i, 16,
+                       LOAD_SI128, STORE_SI128, set1_u8_128,
+                       _mm_min_epu8,  _mm_max_epu8)
+NUM_RANGE_EXTEND_SIMD (extend_sse2_int16_t,  extend_generic_int16_t,
+                       int16_t,  SSE2, __m128i, 8,
+                       LOAD_SI128, STORE_SI128, set1_i16_128,
+                       _mm_min_epi16, _mm_max_epi16)
+NUM_RANGE_EXTEND_SIMD (extend_sse2_float,    extend_generic_float,
+                       float,    SSE2, __m128,  4,
+                       _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps,
+                       _mm_min_ps,    _mm_max_ps)
+NUM_RANGE_EXTEND_SIMD (extend_sse2_double,   extend_generic_double,
+                       double,   SSE2, __m128d, 2,
+                       _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd,
+                       _mm_min_pd,    _mm_max_pd)
+NUM_RANGE_EXTEND_SIMD (extend_sse41_int8_t,  extend_generic_int8_t,
+                       int8_t,   SSE41, __m128i, 16,
+                       LOAD_SI128, STORE_SI128, set1_i8_128,
+                       _mm_min_epi8,  _mm_max_epi8)
+NUM_RANGE_EXTEND_SIMD (extend_sse41_uint16_t, extend_generic_uint16_t,
+                       uint16_t, SSE41, __m128i, 8,
+                       LOAD_SI128, STORE_SI128, set1_u16_128,
+                       _mm_min_epu16, _mm_max_epu16)
+NUM_RANGE_EXTEND_SIMD (extend_sse41_int32_t, extend_generic_int32_t,
+                       int32_t,  SSE41, __m128i, 4,
+                       LOAD_SI128, STORE_SI128, set1_i32_128,
+                       _mm_min_epi32, _mm_max_epi32)
+NUM_RANGE_EXTEND_SIMD (extend_sse41_uint32_t, extend_generic_uint32_t,
+                       uint32_t, SSE41, __m128i, 4,
+                       LOAD_SI128, STORE_SI128, set1_u32_128,
+                       _mm_min_epu32, _mm_max_epu32)
+
+/** 256-bit kernels */
+
+#define LOAD_SI256(p)     _mm256_loadu_si256 ((const __m256i *)(p))
+#define STORE_SI256(p, v) _mm256_storeu_si256 ((__m256i *)(p), (v))
+
+SET1 (set1_u8_256,  AVX2, __m256i, uint8_t,  _mm256_set1_epi8)
+SET1 (set1_i8_256,  AVX2, __m256i, int8_t,   _mm256_set1_epi8)
+SET1 (set1_u16_256, AVX2, __m256i, uint16_t, _mm256_set1_epi16)
+SET1 (set1_i16_256, AVX2, __m256i, int16_t,  _mm256_set1_epi16)
+SET1 (set1_u32_256, AVX2, __m256i, uint32_t, _mm256_set1_epi32)
+SET1 (set1_i32_256, AVX2, __m256i, int32_t,  _mm256_set1_epi32)
+SET1 (set1_i64_256, AVX2, __m256i, int64_t,  _mm256_set1_epi64x)
+SET1 (set1_u64_256, AVX2, __m256i, uint64_t, _mm256_set1_epi64x)
+
+/* NB: there're no 64-bit min/max instructions before AVX-512, so
+   these are emulated with a compare and a blend; the unsigned compare
+   is done on the values with the sign bit flipped */
+static AVX2 __m256i
+min_epi64_256 (__m256i a, __m256i b)
+{
+  return _mm256_blendv_epi8 (a, b, _mm256_cmpgt_epi64 (a, b));
+}
+
+static AVX2 __m256i
+max_epi64_256 (__m256i a, __m256i b)
+{
+  return _mm256_blendv_epi8 (b, a, _mm256_cmpgt_epi64 (a, b));
+}
+
+static AVX2 __m256i
+min_epu64_256 (__m256i a, __m256i b)
+{
+  const __m256i s = _mm256_set1_epi64x (INT64_MIN);
+  const __m256i gt
+    = _mm256_cmpgt_epi64 (_mm256_xor_si256 (a, s),
+                          _mm256_xor_si256 (b, s));
+  return _mm256_blendv_epi8 (a, b, gt);
+}
+
+static AVX2 __m256i
+max_epu64_256 (__m256i a, __m256i b)
+{
+  const __m256i s = _mm256_set1_epi64x (INT64_MIN);
+  const __m256i gt
+    = _mm256_cmpgt_epi64 (_mm256_xor_si256 (a, s),
+                          _mm256_xor_si256 (b, s));
+  return _mm256_blendv_epi8 (b, a, gt);
+}
+
+NUM_RANGE_EXTEND_SIMD (extend_avx2_int8_t,    extend_generic_int8_t,
+                       int8_t,   AVX2, __m256i, 32,
+                       LOAD_SI256, STORE_SI256, set1_i8_256,
+                       _mm256_min_epi8, _mm256_max_epi8)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_int16_t,   extend_generic_int16_t,
+                       int16_t,  AVX2, __m256i, 16,
+                       LOAD_SI256, STORE_SI256, set1_i16_256,
+                       _mm256_min_epi16, _mm256_max_epi16)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_int32_t,   extend_generic_int32_t,
+                       int32_t,  AVX2, __m256i, 8,
+                       LOAD_SI256, STORE_SI256, set1_i32_256,
+                       _mm256_min_epi32, _mm256_max_epi32)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_int64_t,   extend_generic_int64_t,
+                       int64_t,  AVX2, __m256i, 4,
+                       LOAD_SI256, STORE_SI256, set1_i64_256,
+                       min_epi64_256, max_epi64_256)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_uint8_t,   extend_generic_uint8_t,
+                       uint8_t,  AVX2, __m256i, 32,
+                       LOAD_SI256, STORE_SI256, set1_u8_256,
+                       _mm256_min_epu8, _mm256_max_epu8)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_uint16_t,  extend_generic_uint16_t,
+                       uint16_t, AVX2, __m256i, 16,
+                       LOAD_SI256, STORE_SI256, set1_u16_256,
+                       _mm256_min_epu16, _mm256_max_epu16)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_uint32_t,  extend_generic_uint32_t,
+                       uint32_t, AVX2, __m256i, 8,
+                       LOAD_SI256, STORE_SI256, set1_u32_256,
+                       _mm256_min_epu32, _mm256_max_epu32)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_uint64_t,  extend_generic_uint64_t,
+                       uint64_t, AVX2, __m256i, 4,
+                       LOAD_SI256, STORE_SI256, set1_u64_256,
+                       min_epu64_256, max_epu64_256)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_float,     extend_generic_float,
+                       float,    AVX2, __m256,  8,
+                       _mm256_loadu_ps, _mm256_storeu_ps,
+                       _mm256_set1_ps,
+                       _mm256_min_ps, _mm256_max_ps)
+NUM_RANGE_EXTEND_SIMD (extend_avx2_double,    extend_generic_double,
+                       double,   AVX2, __m256d, 4,
+                       _mm256_loadu_pd, _mm256_storeu_pd,
+                       _mm256_set1_pd,
+                       _mm256_min_pd, _mm256_max_pd)
+
+#define CPU_HAS(feature) (__builtin_cpu_init (), \
+                          __builtin_cpu_supports (feature))
+
+#define CHOOSE3(t, avx2, sse, sse_feature) \
+    (CPU_HAS ("avx2") ? extend_avx2_ ## t \
+     : CPU_HAS (sse_feature) ? extend_ ## sse ## _ ## t \
+     : extend_generic_ ## t)
+#define CHOOSE2(t) \
+    (CPU_HAS ("avx2") ? extend_avx2_ ## t : extend_generic_ ## t)
+#else
+#define CHOOSE3(t, avx2, sse, sse_feature) extend_generic_ ## t
+#define CHOOSE2(t) extend_generic_ ## t
+#endif
+
+/* NB: the kernels are chosen once, on the first call to any of the
+   functions below, which may well be made by several threads at once */
+#define KERNEL(type) \
+    static void (*kernel_ ## type) (const type *, size_t, type *, type *)
+KERNEL (int8_t);
+KERNEL (int16_t);
+KERNEL (int32_t);
+KERNEL (int64_t);
+KERNEL (uint8_t);
+KERNEL (uint16_t);
+KERNEL (uint32_t);
+KERNEL (uint64_t);
+KERNEL (float);
+KERNEL (double);
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void
+choose_kernels (void)
+{
+  kernel_int8_t   = CHOOSE3 (int8_t,   avx2, sse41, "sse4.1");
+  kernel_int16_t  = CHOOSE3 (int16_t,  avx2, sse2,  "sse2");
+  kernel_int32_t  = CHOOSE3 (int32_t,  avx2, sse41, "sse4.1");
+  kernel_int64_t  = CHOOSE2 (int64_t);
+  kernel_uint8_t  = CHOOSE3 (uint8_t,  avx2, sse2,  "sse2");
+  kernel_uint16_t = CHOOSE3 (uint16_t, avx2, sse41, "sse4.1");
+  kernel_uint32_t = CHOOSE3 (uint32_t, avx2, sse41, "sse4.1");
+  kernel_uint64_t = CHOOSE2 (uint64_t);
+  kernel_float    = CHOOSE3 (float,    avx2, sse2,  "sse2");
+  kernel_double   = CHOOSE3 (double,   avx2, sse2,  "sse2");
+}
+
 #define NUM_RANGE_EXTEND(fn, type) \
     void \
     fn (const type *vec, size_t size, type *min, type *max) { \
-      size_t rest; \
-      const type *p; \
       type min1, max1; \
       if (size < 1) { /* . */ return; } \
+      pthread_once (&kernels_once, choose_kernels); \
       min1 = (min != 0) ? *min : vec[0]; \
       max1 = (max != 0) ? *max : vec[0]; \
-      for (rest = size, p = vec; \
-           rest > 0; \
-           rest--, p++) { \
-        if (*p < min1) { min1 = *p; } \
-        if (*p > max1) { max1 = *p; } \
-      } \
+      (*kernel_ ## type) (vec, size, &min1, &max1); \
       if (min != 0) { *min = min1; } \
       if (max != 0) { *max = max1; } \
     }
 
-NUM_RANGE_EXTEND (nrange_extend_int8_tt,        int8_t)
-NUM_RANGE_EXTEND (nrange_extend_int16_tt,       int16_t)
-NUM_RANGE_EXTEND (nrange_extend_int32_tt,       int32_t)
-NUM_RANGE_EXTEND (nrange_extend_int64_tt,       int64_t)
+NUM_RANGE_EXTEND (nrange_extend_int8_tt,   int8_t)
+NUM_RANGE_EXTEND (nrange_extend_int16_tt,  int16_t)
+NUM_RANGE_EXTEND (nrange_extend_int32_tt,  int32_t)
+NUM_RANGE_EXTEND (nrange_extend_int64_tt,  int64_t)
 
-NUM_RANGE_EXTEND (nrange_extend_uint8_tt,       uint8_t)
-NUM_RANGE_EXTEND (nrange_extend_uint16_tt,      uint16_t)
-NUM_RANGE_EXTEND (nrange_extend_uint32_tt,      uint32_t)
-NUM_RANGE_EXTEND (nrange_extend_uint64_tt,      uint64_t)
+NUM_RANGE_EXTEND (nrange_extend_uint8_tt,  uint8_t)
+NUM_RANGE_EXTEND (nrange_extend_uint16_tt, uint16_t)
+NUM_RANGE_EXTEND (nrange_extend_uint32_tt, uint32_t)
+NUM_RANGE_EXTEND (nrange_extend_uint64_tt, uint64_t)
 
-NUM_RANGE_EXTEND (nrange_extend_float,          float)
-NUM_RANGE_EXTEND (nrange_extend_double,         double)
+NUM_RANGE_EXTEND (nrange_extend_float,     float)
+NUM_RANGE_EXTEND (nrange_extend_double,    double)
 
 /*** Emacs stuff */
 /** Local variables: */
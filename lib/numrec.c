@@ -0,0 +1,361 @@
+/*** numrec.c --- Records of numbers in mixed formats  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>             /* for uintptr_t */
+#include <stdlib.h>
+#include <string.h>
+
+#include "numrec.h"
+#include "usemacro.h"
+
+/* NB: the runs are converted by the chunks of up to this many
+   elements, and are no longer than that */
+#define CHUNK_ELTS 4096
+
+/*** Utility */
+
+static int
+same_fmt_p (const struct numfmt *a, const struct numfmt *b)
+{
+  /* . */
+  return (a->type == b->type
+          && a->packed_p == b->packed_p
+          && (! a->packed_p
+              || (a->scale == b->scale && a->offset == b->offset))
+          && a->fill_p == b->fill_p
+          && (! a->fill_p
+              || memcmp (&(a->fill), &(b->fill),
+                         numfmt_size (a)) == 0));
+}
+
+/* NB: the elements may also be copied if they'd be decoded and encoded
+   back the same, as are the plain integers without a fill value, the
+   fill value on output making no difference then */
+static int
+copy_fmt_p (const struct numfmt *to, const struct numfmt *from)
+{
+  /* . */
+  return (same_fmt_p (to, from)
+          || (numfmt_integer_p (from)
+              && ! from->packed_p && ! from->fill_p
+              && to->type == from->type && ! to->packed_p));
+}
+
+/* NB: copy the elements of SIZE bytes each, from SRC to DST, the
+   given strides apart; the common sizes are copied with the sizes
+   known at compile time */
+#define COPY_LOOP(sz) \
+    for (cs_j = 0; cs_j < cs_n; \
+         cs_j++, cs_d += cs_ds, cs_s += cs_ss) { \
+      memcpy (cs_d, cs_s, (sz)); \
+    }
+#define COPY_STRIDED(dst, d_stride, src, s_stride, size, count) \
+    { \
+      char *cs_d = (char *)(dst); \
+      const char *cs_s = (const char *)(src); \
+      const size_t cs_ds = (d_stride), cs_ss = (s_stride); \
+      const size_t cs_sz = (size), cs_n = (count); \
+      size_t cs_j; \
+      switch (cs_sz) { \
+      case 1:  COPY_LOOP (1); break; \
+      case 2:  COPY_LOOP (2); break; \
+      case 4:  COPY_LOOP (4); break; \
+      case 8:  COPY_LOOP (8); break; \
+      default: COPY_LOOP (cs_sz); \
+      } \
+    }
+
+/*** Initializing */
+
+int
+nrec_init (struct nrec *rec, const struct numfmt *fmts, size_t count)
+{
+  size_t i, offset;
+
+  rec->count = count;
+  rec->runs_count = 0;
+  if (MALLOC_ARY (rec->runs, MAX (count, 1)) == 0) {
+    /* . */
+    return -1;
+  }
+  for (i = 0, offset = 0; i < count; i++) {
+    struct nrec_run *r = rec->runs + rec->runs_count - 1;
+    if (rec->runs_count > 0
+        && r->count < CHUNK_ELTS
+        && same_fmt_p (&(r->fmt), fmts + i)) {
+      r->count++;
+    } else {
+      r++;
+      r->fmt    = fmts[i];
+      r->first  = i;
+      r->offset = offset;
+      r->count  = 1;
+      rec->runs_count++;
+    }
+    offset += numfmt_size (fmts + i);
+  }
+  rec->size = offset;
+
+  /* . */
+  return 0;
+}
+
+void
+nrec_free (struct nrec *rec)
+{
+  free (rec->runs);
+  rec->runs = 0;
+  rec->runs_count = 0;
+}
+
+/*** Conversion */
+
+/** Interleaved */
+
+void
+nrec_to_doubles (double *dst, const void *src, size_t count,
+                 const struct nrec *rec)
+{
+  size_t i;
+
+  if (rec->runs_count == 1
+      && (uintptr_t)src % numfmt_size (&(rec->runs->fmt)) == 0) {
+    /* NB: the whole of the data is in a single format */
+    numfmt_to_doubles (dst, src, count * rec->count,
+                       &(rec->runs->fmt));
+    /* . */
+    return;
+  }
+
+  for (i = 0; i < rec->runs_count; i++) {
+    const struct nrec_run *r = rec->runs + i;
+    const size_t
+      esz   = numfmt_size (&(r->fmt)),
+      chunk = MAX (CHUNK_ELTS / r->count, 1);
+    union numfmt_value raw[chunk * r->count];
+    double cooked[chunk * r->count];
+    size_t j0, k;
+    for (j0 = 0; j0 < count; j0 += chunk) {
+      const size_t n = MIN (chunk, count - j0);
+      const char *s = (const char *)src + j0 * rec->size + r->offset;
+      double *d = dst + j0 * rec->count + r->first;
+      for (k = 0; k < r->count; k++) {
+        COPY_STRIDED ((char *)raw + k * esz, r->count * esz,
+                      s + k * esz, rec->size, esz, n);
+      }
+      numfmt_to_doubles (cooked, raw, n * r->count, &(r->fmt));
+      for (k = 0; k < r->count; k++) {
+        COPY_STRIDED (d + k, rec->count * sizeof (*d),
+                      cooked + k, r->count * sizeof (*cooked),
+                      sizeof (*d), n);
+      }
+    }
+  }
+}
+
+void
+nrec_from_doubles (void *dst, const double *src, size_t count,
+                   const struct nrec *rec,
+                   enum nconv_rounding rounding)
+{
+  size_t i;
+
+  if (rec->runs_count == 1
+      && (uintptr_t)dst % numfmt_size (&(rec->runs->fmt)) == 0) {
+    /* NB: the whole of the data is in a single format */
+    numfmt_from_doubles (dst, src, count * rec->count,
+                         &(rec->runs->fmt), rounding);
+    /* . */
+    return;
+  }
+
+  for (i = 0; i < rec->runs_count; i++) {
+    const struct nrec_run *r = rec->runs + i;
+    const size_t
+      esz   = numfmt_size (&(r->fmt)),
+      chunk = MAX (CHUNK_ELTS / r->count, 1);
+    double cooked[chunk * r->count];
+    union numfmt_value raw[chunk * r->count];
+    size_t j0, k;
+    for (j0 = 0; j0 < count; j0 += chunk) {
+      const size_t n = MIN (chunk, count - j0);
+      const double *s = src + j0 * rec->count + r->first;
+      char *d = (char *)dst + j0 * rec->size + r->offset;
+      for (k = 0; k < r->count; k++) {
+        COPY_STRIDED (cooked + k, r->count * sizeof (*cooked),
+                      s + k, rec->count * sizeof (*s),
+                      sizeof (*s), n);
+      }
+      numfmt_from_doubles (raw, cooked, n * r->count, &(r->fmt),
+                           rounding);
+      for (k = 0; k < r->count; k++) {
+        COPY_STRIDED (d + k * esz, rec->size,
+                      (char *)raw + k * esz, r->count * esz, esz, n);
+      }
+    }
+  }
+}
+
+/** Planar */
+
+void
+nrec_to_doubles_planar (double *dst, const void *src,
+                        size_t count, size_t capacity,
+                        const struct nrec *rec)
+{
+  size_t i, k;
+
+  for (i = 0; i < rec->runs_count; i++) {
+    const struct nrec_run *r = rec->runs + i;
+    const size_t esz = numfmt_size (&(r->fmt));
+    for (k = 0; k < r->count; k++) {
+      const char *plane
+        = (const char *)src + capacity * (r->offset + k * esz);
+      double *d = dst + r->first + k;
+      union numfmt_value raw[CHUNK_ELTS];
+      double cooked[CHUNK_ELTS];
+      size_t j0;
+      for (j0 = 0; j0 < count; j0 += CHUNK_ELTS) {
+        const size_t n = MIN (CHUNK_ELTS, count - j0);
+        const char *s = plane + j0 * esz;
+        /* NB: the plane isn't necessarily aligned */
+        if ((uintptr_t)s % esz != 0) {
+          memcpy (raw, s, n * esz);
+          s = (const char *)raw;
+        }
+        numfmt_to_doubles (cooked, s, n, &(r->fmt));
+        COPY_STRIDED (d + j0 * rec->count, rec->count * sizeof (*d),
+                      cooked, sizeof (*cooked), sizeof (*d), n);
+      }
+    }
+  }
+}
+
+void
+nrec_from_doubles_planar (void *dst, const double *src,
+                          size_t count, size_t capacity,
+                          const struct nrec *rec,
+                          enum nconv_rounding rounding)
+{
+  size_t i, k;
+
+  for (i = 0; i < rec->runs_count; i++) {
+    const struct nrec_run *r = rec->runs + i;
+    const size_t esz = numfmt_size (&(r->fmt));
+    for (k = 0; k < r->count; k++) {
+      char *plane = (char *)dst + capacity * (r->offset + k * esz);
+      const double *s = src + r->first + k;
+      union numfmt_value raw[CHUNK_ELTS];
+      double cooked[CHUNK_ELTS];
+      size_t j0;
+      for (j0 = 0; j0 < count; j0 += CHUNK_ELTS) {
+        const size_t n = MIN (CHUNK_ELTS, count - j0);
+        char *d = plane + j0 * esz;
+        COPY_STRIDED (cooked, sizeof (*cooked),
+                      s + j0 * rec->count, rec->count * sizeof (*s),
+                      sizeof (*s), n);
+        /* NB: the plane isn't necessarily aligned */
+        if ((uintptr_t)d % esz != 0) {
+          numfmt_from_doubles (raw, cooked, n, &(r->fmt), rounding);
+          memcpy (d, raw, n * esz);
+        } else {
+          numfmt_from_doubles (d, cooked, n, &(r->fmt), rounding);
+        }
+      }
+    }
+  }
+}
+
+/*** Selecting */
+
+/* NB: the run holding the element */
+static const struct nrec_run *
+elt_run (const struct nrec *rec, size_t j)
+{
+  const struct nrec_run *r = rec->runs;
+  while (j >= r->first + r->count) {
+    r++;
+  }
+
+  /* . */
+  return r;
+}
+
+int
+nrec_select_p (const struct nrec *to, const struct nrec *from,
+               const size_t *select)
+{
+  size_t j;
+
+  for (j = 0; j < to->count; j++) {
+    if (select[j] >= from->count
+        || ! copy_fmt_p (&(elt_run (to, j)->fmt),
+                         &(elt_run (from, select[j])->fmt))) {
+      /* . */
+      return 0;
+    }
+  }
+
+  /* . */
+  return 1;
+}
+
+void
+nrec_select (void *dst, size_t d_capacity, const struct nrec *to,
+             const void *src, size_t s_capacity,
+             const struct nrec *from,
+             const size_t *select, size_t count)
+{
+  size_t j;
+
+  for (j = 0; j < to->count; j++) {
+    const struct nrec_run
+      *d_r = elt_run (to, j),
+      *s_r = elt_run (from, select[j]);
+    const size_t
+      esz   = numfmt_size (&(d_r->fmt)),
+      d_off = d_r->offset + (j - d_r->first) * esz,
+      s_off = s_r->offset + (select[j] - s_r->first) * esz;
+    /* NB: the element is either in its plane, or in the records */
+    COPY_STRIDED ((char *)dst
+                  + (d_capacity > 0 ? d_capacity * d_off : d_off),
+                  (d_capacity > 0 ? esz : to->size),
+                  (const char *)src
+                  + (s_capacity > 0 ? s_capacity * s_off : s_off),
+                  (s_capacity > 0 ? esz : from->size),
+                  esz, count);
+  }
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numrec.c ends here */
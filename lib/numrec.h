@@ -0,0 +1,101 @@
+/*** numrec.h --- Records of numbers in mixed formats  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMREC_H
+#define NUMREC_H
+
+#include <stddef.h>             /* for size_t */
+
+#include "numfmt.h"
+
+/* NB: a record is a sequence of the elements, each in a format of its
+   own.  The codec plans the conversion of the records as a sequence
+   of the runs of the consecutive elements of the same format, each
+   run being gathered from (or scattered to) the records, and
+   converted for many records at once; the records of a single format
+   are converted with a single call */
+
+struct nrec_run {
+  struct numfmt fmt;
+  /* the first element, its offset in the record, and the number of
+     the elements */
+  size_t first, offset, count;
+};
+
+struct nrec {
+  /* the number of the elements, and the size of the record */
+  size_t count, size;
+  size_t runs_count;
+  struct nrec_run *runs;
+};
+
+/* NB: return -1 and set errno on failure */
+int  nrec_init (struct nrec *rec, const struct numfmt *fmts,
+                size_t count);
+void nrec_free (struct nrec *rec);
+
+/* NB: the COUNT records at SRC (not necessarily aligned) are decoded
+   into the COUNT vectors of rec->count doubles at DST, and encoded
+   back */
+void nrec_to_doubles (double *dst, const void *src, size_t count,
+                      const struct nrec *rec);
+void nrec_from_doubles (void *dst, const double *src, size_t count,
+                        const struct nrec *rec,
+                        enum nconv_rounding rounding);
+
+/* NB: the same, but for the planar layout, in which the Jth elements
+   of the records are consecutive, forming a plane, and the planes
+   follow one another, in the space of CAPACITY >= COUNT elements
+   each; i.e., the plane of the Jth element is at CAPACITY times the
+   offset of the element in the record */
+void nrec_to_doubles_planar (double *dst, const void *src,
+                             size_t count, size_t capacity,
+                             const struct nrec *rec);
+void nrec_from_doubles_planar (void *dst, const double *src,
+                               size_t count, size_t capacity,
+                               const struct nrec *rec,
+                               enum nconv_rounding rounding);
+
+/* NB: the elements of the records may also be copied as they are,
+   the Jth element of the records at DST being the SELECT[J]th one of
+   those at SRC; either may be planar, with the planes of CAPACITY
+   elements, or interleaved, if CAPACITY is 0.  The formats of the
+   elements selected should be the same (save for the fill value on
+   output, for the plain integers without one on input), as checked
+   with nrec_select_p () */
+int  nrec_select_p (const struct nrec *to, const struct nrec *from,
+                    const size_t *select);
+void nrec_select (void *dst, size_t d_capacity, const struct nrec *to,
+                  const void *src, size_t s_capacity,
+                  const struct nrec *from,
+                  const size_t *select, size_t count);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numrec.h ends here */
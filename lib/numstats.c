@@ -0,0 +1,313 @@
+/*** numstats.c --- Streaming Statistics  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>               /* for INFINITY, NAN */
+#include <pthread.h>            /* for pthread_once () */
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+#ifdef HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "numstats.h"
+
+/* NB: small enough for a block to stay in the L1 cache between the
+   two passes */
+#define BLOCK_SZ 1024
+
+/*** Block kernels */
+
+/* NB: the kernels fill in COUNT, MIN, MAX, SUM, MEAN and M2 for the
+   finite values of the block; X - X is zero for these only */
+#define FINITE_P(x) ((x) - (x) == 0)
+
+static void
+block_generic (struct nstats *b, const double *vec, size_t size)
+{
+  double s[4] = { 0, 0, 0, 0 }, q[4] = { 0, 0, 0, 0 };
+  double mn[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+  double mx[4] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+  uint64_t n[4] = { 0, 0, 0, 0 };
+  double mean;
+  size_t i, k;
+
+  /* the first pass: count, extrema, and sum */
+  for (i = 0; i + 4 <= size; i += 4) {
+    for (k = 0; k < 4; k++) {
+      const double v = vec[i + k];
+      const int f = FINITE_P (v);
+      n[k] += f;
+      s[k] += f ? v : 0;
+      mn[k] = (f && v < mn[k]) ? v : mn[k];
+      mx[k] = (f && v > mx[k]) ? v : mx[k];
+    }
+  }
+  for (; i < size; i++) {
+    const double v = vec[i];
+    const int f = FINITE_P (v);
+    n[0] += f;
+    s[0] += f ? v : 0;
+    mn[0] = (f && v < mn[0]) ? v : mn[0];
+    mx[0] = (f && v > mx[0]) ? v : mx[0];
+  }
+  b->count = n[0] + n[1] + n[2] + n[3];
+  b->sum   = (s[0] + s[1]) + (s[2] + s[3]);
+  b->min   = mn[0];
+  b->max   = mx[0];
+  for (k = 1; k < 4; k++) {
+    if (mn[k] < b->min) { b->min = mn[k]; }
+    if (mx[k] > b->max) { b->max = mx[k]; }
+  }
+  if (b->count == 0) {
+    b->mean = b->m2 = 0;
+    /* . */
+    return;
+  }
+  mean = b->mean = b->sum / b->count;
+
+  /* the second pass: the squared deviations */
+  for (i = 0; i + 4 <= size; i += 4) {
+    for (k = 0; k < 4; k++) {
+      const double v = vec[i + k];
+      const double d = FINITE_P (v) ? v - mean : 0;
+      q[k] += d * d;
+    }
+  }
+  for (; i < size; i++) {
+    const double v = vec[i];
+    const double d = FINITE_P (v) ? v - mean : 0;
+    q[0] += d * d;
+  }
+  b->m2 = (q[0] + q[1]) + (q[2] + q[3]);
+}
+
+#ifdef HAVE_X86_DISPATCH
+
+static __attribute__ ((target ("avx2"))) void
+block_avx2 (struct nstats *b, const double *vec, size_t size)
+{
+  const __m256d zero = _mm256_setzero_pd ();
+  __m256d s0 = zero, s1 = zero, q0 = zero, q1 = zero;
+  __m256d mn0 = _mm256_set1_pd (INFINITY), mn1 = mn0;
+  __m256d mx0 = _mm256_set1_pd (-INFINITY), mx1 = mx0;
+  __m256i n0 = _mm256_setzero_si256 (), n1 = n0;
+  double t_s[4], t_mn[4], t_mx[4], t_q[4];
+  uint64_t t_n[4];
+  __m256d mean;
+  size_t i, k;
+
+  /* NB: the comparison masks are all ones for the finite values;
+     subtracting these increments the counts */
+  #define STATS_AVX2_STEP1(x, s, mn, mx, n) \
+      { \
+        const __m256d f \
+          = _mm256_cmp_pd (_mm256_sub_pd ((x), (x)), zero, \
+                           _CMP_EQ_OQ); \
+        n  = _mm256_sub_epi64 (n, _mm256_castpd_si256 (f)); \
+        s  = _mm256_add_pd (s, _mm256_and_pd (f, (x))); \
+        mn = _mm256_min_pd (_mm256_blendv_pd (mn, (x), f), mn); \
+        mx = _mm256_max_pd (_mm256_blendv_pd (mx, (x), f), mx); \
+      }
+  for (i = 0; i + 8 <= size; i += 8) {
+    const __m256d a = _mm256_loadu_pd (vec + i);
+    const __m256d c = _mm256_loadu_pd (vec + i + 4);
+    STATS_AVX2_STEP1 (a, s0, mn0, mx0, n0);
+    STATS_AVX2_STEP1 (c, s1, mn1, mx1, n1);
+  }
+  _mm256_storeu_pd (t_s,  _mm256_add_pd (s0, s1));
+  _mm256_storeu_pd (t_mn, _mm256_min_pd (mn0, mn1));
+  _mm256_storeu_pd (t_mx, _mm256_max_pd (mx0, mx1));
+  _mm256_storeu_si256 ((__m256i *)t_n, _mm256_add_epi64 (n0, n1));
+  b->count = t_n[0] + t_n[1] + t_n[2] + t_n[3];
+  b->sum   = (t_s[0] + t_s[1]) + (t_s[2] + t_s[3]);
+  b->min   = t_mn[0];
+  b->max   = t_mx[0];
+  for (k = 1; k < 4; k++) {
+    if (t_mn[k] < b->min) { b->min = t_mn[k]; }
+    if (t_mx[k] > b->max) { b->max = t_mx[k]; }
+  }
+  for (k = i; k < size; k++) {
+    const double v = vec[k];
+    if (FINITE_P (v)) {
+      b->count++;
+      b->sum += v;
+      if (v < b->min) { b->min = v; }
+      if (v > b->max) { b->max = v; }
+    }
+  }
+  if (b->count == 0) {
+    b->mean = b->m2 = 0;
+    /* . */
+    return;
+  }
+  b->mean = b->sum / b->count;
+
+  mean = _mm256_set1_pd (b->mean);
+  #define STATS_AVX2_STEP2(x, q) \
+      { \
+        const __m256d f \
+          = _mm256_cmp_pd (_mm256_sub_pd ((x), (x)), zero, \
+                           _CMP_EQ_OQ); \
+        const __m256d d \
+          = _mm256_and_pd (f, _mm256_sub_pd ((x), mean)); \
+        q = _mm256_add_pd (q, _mm256_mul_pd (d, d)); \
+      }
+  for (i = 0; i + 8 <= size; i += 8) {
+    const __m256d a = _mm256_loadu_pd (vec + i);
+    const __m256d c = _mm256_loadu_pd (vec + i + 4);
+    STATS_AVX2_STEP2 (a, q0);
+    STATS_AVX2_STEP2 (c, q1);
+  }
+  _mm256_storeu_pd (t_q, _mm256_add_pd (q0, q1));
+  b->m2 = (t_q[0] + t_q[1]) + (t_q[2] + t_q[3]);
+  for (k = i; k < size; k++) {
+    const double v = vec[k];
+    if (FINITE_P (v)) {
+      const double d = v - b->mean;
+      b->m2 += d * d;
+    }
+  }
+  #undef STATS_AVX2_STEP1
+  #undef STATS_AVX2_STEP2
+}
+
+#endif
+
+/*** Interface */
+
+void
+nstats_init (struct nstats *st)
+{
+  st->count = st->nan_count = st->pinf_count = st->ninf_count = 0;
+  st->ignored_count = 0;
+  st->min =  INFINITY;
+  st->max = -INFINITY;
+  st->sum = st->mean = st->m2 = 0;
+}
+
+void
+nstats_merge (struct nstats *st, const struct nstats *other)
+{
+  const uint64_t n = st->count + other->count;
+
+  if (other->count > 0) {
+    const double delta = other->mean - st->mean;
+    const double na = st->count, nb = other->count;
+    st->mean += delta * nb / n;
+    st->m2   += other->m2 + delta * delta * na * nb / n;
+    st->sum  += other->sum;
+    if (other->min < st->min) { st->min = other->min; }
+    if (other->max > st->max) { st->max = other->max; }
+    st->count = n;
+  }
+  st->nan_count     += other->nan_count;
+  st->pinf_count    += other->pinf_count;
+  st->ninf_count    += other->ninf_count;
+  st->ignored_count += other->ignored_count;
+}
+
+/* NB: the kernel is chosen once, on the first call, which may well be
+   made by several threads at once */
+static void (*kernel) (struct nstats *, const double *, size_t);
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void
+choose_kernel (void)
+{
+#ifdef HAVE_X86_DISPATCH
+  __builtin_cpu_init ();
+  kernel = (__builtin_cpu_supports ("avx2")
+            ? block_avx2 : block_generic);
+#else
+  kernel = block_generic;
+#endif
+}
+
+void
+nstats_add_doubles (struct nstats *st, const double *vec, size_t size)
+{
+  size_t rest;
+  const double *p;
+
+  pthread_once (&kernel_once, choose_kernel);
+
+  for (rest = size, p = vec; rest > 0; ) {
+    const size_t blk = rest < BLOCK_SZ ? rest : BLOCK_SZ;
+    struct nstats b;
+    nstats_init (&b);
+    (*kernel) (&b, p, blk);
+    /* NB: the non-finite values are expected to be rare */
+    if (b.count < blk) {
+      size_t i;
+      for (i = 0; i < blk; i++) {
+        if (isnan (p[i])) {
+          b.nan_count++;
+        } else if (isinf (p[i])) {
+          if (p[i] > 0) { b.pinf_count++; } else { b.ninf_count++; }
+        }
+      }
+    }
+    nstats_merge (st, &b);
+    rest -= blk;
+    p    += blk;
+  }
+}
+
+void
+nstats_add_repeated (struct nstats *st, double value, uint64_t count)
+{
+  struct nstats b;
+
+  nstats_init (&b);
+  if (isnan (value)) {
+    b.nan_count = count;
+  } else if (isinf (value)) {
+    if (value > 0) { b.pinf_count = count; } else { b.ninf_count = count; }
+  } else if (count > 0) {
+    b.count = count;
+    b.min   = b.max = b.mean = value;
+    b.sum   = value * count;
+  }
+  nstats_merge (st, &b);
+}
+
+double
+nstats_variance (const struct nstats *st)
+{
+  /* . */
+  return (st->count > 0 ? st->m2 / st->count : NAN);
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numstats.c ends here */
@@ -0,0 +1,66 @@
+/*** numstats.h --- Streaming Statistics  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef NUMSTATS_H
+#define NUMSTATS_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+/* NB: the sums, the mean and the variance are those of the finite
+   values only; NaN's and infinities are merely counted */
+struct nstats {
+  uint64_t count;               /* of the finite values */
+  uint64_t nan_count, pinf_count, ninf_count;
+  uint64_t ignored_count;       /* maintained by the caller */
+  double min, max;
+  double sum;
+  /* the running mean, and the sum of the squared deviations from it */
+  double mean, m2;
+};
+
+void nstats_init (struct nstats *st);
+
+/* NB: the values are processed in blocks: the mean and the squared
+   deviations are computed for a block in two passes, and then the
+   block is merged into the state (Chan et al.), so that there's no
+   loss of precision of the textbook single-pass formula */
+void nstats_add_doubles (struct nstats *st,
+                         const double *vec, size_t size);
+void nstats_merge (struct nstats *st, const struct nstats *other);
+/* add COUNT copies of VALUE at once */
+void nstats_add_repeated (struct nstats *st, double value,
+                          uint64_t count);
+
+/* NB: the population variance, i. e., the one divided by COUNT */
+double nstats_variance (const struct nstats *st);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** numstats.h ends here */
@@ -0,0 +1,194 @@
+/*** recparts.c --- Reading the files of records by the parts  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>              /* for open (), posix_fadvise () */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>             /* for pread () */
+
+#include "recparts.h"
+#include "usemacro.h"
+#include "useutil.h"
+
+/*** Units */
+
+struct rp_unit *
+rp_units_new (struct rp_units *us)
+{
+  if (us->count >= us->alloc) {
+    const size_t alloc = 2 * us->alloc + 16;
+    if (REALLOC_ARY (us->s, alloc) == 0) {
+      /* . */
+      return 0;
+    }
+    us->alloc = alloc;
+  }
+
+  /* . */
+  return us->s + (us->count++);
+}
+
+int
+rp_units_add (struct rp_units *us, size_t file, const char *name,
+              size_t size, size_t jobs, off_t *recs)
+{
+  struct stat st;
+  struct rp_unit *u;
+  off_t parts, k;
+
+  if (strcmp (name, "-") == 0) {
+    st.st_mode = 0;
+  } else if (stat (name, &st) != 0) {
+    /* . */
+    return -1;
+  }
+  if (! S_ISREG (st.st_mode)) {
+    /* NB: the streams are read as a whole */
+    if ((u = rp_units_new (us)) == 0) {
+      /* . */
+      return -1;
+    }
+    u->file     = file;
+    u->stream_p = 1;
+    u->first_p  = 1;
+    u->offset   = u->length = 0;
+    *recs = -1;
+    /* . */
+    return 0;
+  }
+  if (st.st_size % size != 0) {
+    /* . */
+    return 1;
+  }
+  *recs = st.st_size / size;
+  parts = (jobs < 1 ? 0
+           : BOUND ((off_t)(st.st_size / RP_MIN_PART_SZ),
+                    1, (off_t)jobs));
+  for (k = 0; k < parts; k++) {
+    const off_t from = *recs * k / parts, to = *recs * (k + 1) / parts;
+    if ((u = rp_units_new (us)) == 0) {
+      /* . */
+      return -1;
+    }
+    u->file     = file;
+    u->stream_p = 0;
+    u->first_p  = (k == 0);
+    u->offset   = from * size;
+    u->length   = (to - from) * size;
+  }
+
+  /* . */
+  return 0;
+}
+
+/*** Reading */
+
+int
+rp_read_stream (FILE *fp, void *buf, size_t buf_recs, size_t size,
+                rp_data_fn data, void *param)
+{
+  size_t got;
+
+  while ((got = fread (buf, 1, buf_recs * size, fp)) > 0) {
+    (*data) (param, buf, got / size);
+    if (got % size != 0) {
+      /* . */
+      return feof (fp) ? 1 : -1;
+    }
+  }
+
+  /* . */
+  return ferror (fp) ? -1 : 0;
+}
+
+int
+rp_read_part (const char *name, off_t offset, off_t length,
+              void *buf, size_t buf_recs, size_t size,
+              rp_data_fn data, rp_zeros_fn zeros, void *param)
+{
+  const off_t end = offset + length;
+  off_t pos, data_end = (zeros != 0 ? offset : end);
+  int fd;
+
+  if ((fd = open (name, O_RDONLY)) < 0) {
+    /* . */
+    return -1;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise (fd, offset, length, POSIX_FADV_SEQUENTIAL);
+#endif
+  for (pos = offset; pos < end; ) {
+    size_t want;
+    ssize_t got;
+    /* NB: the holes are handed over as the runs of zeros */
+    if (pos >= data_end) {
+      off_t run_end;
+      const int r = sparse_extent (fd, pos, size, &run_end);
+      if (r < 0) {
+        close (fd);
+        /* . */
+        return -1;
+      }
+      if (r == 0) {
+        run_end = MIN (run_end, end);
+        (*zeros) (param, (run_end - pos) / size);
+        pos = run_end;
+        continue;
+      }
+      data_end = run_end;
+    }
+    want = MIN ((off_t)(buf_recs * size), MIN (end, data_end) - pos);
+    if ((got = pread (fd, buf, want, pos)) < 0) {
+      close (fd);
+      /* . */
+      return -1;
+    }
+    (*data) (param, buf, got / size);
+    /* NB: the file was truncated if nothing could be read */
+    if (got < (ssize_t)size) {
+      break;
+    }
+    /* NB: a partial record is read again */
+    pos += got - got % size;
+  }
+  close (fd);
+
+  /* . */
+  return 0;
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** recparts.c ends here */
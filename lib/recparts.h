@@ -0,0 +1,89 @@
+/*** recparts.h --- Reading the files of records by the parts  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef RECPARTS_H
+#define RECPARTS_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdio.h>              /* for FILE */
+#include <sys/types.h>          /* for off_t */
+
+/* NB: the files of the records of SIZE bytes are read by the units,
+   each a record-aligned part of a regular file (so that the parts of
+   a file could be read by several threads at once), or a whole
+   stream */
+struct rp_unit {
+  size_t file;
+  int stream_p;
+  /* is it the first part of the file? */
+  int first_p;
+  off_t offset, length;
+};
+
+struct rp_units {
+  size_t count, alloc;
+  struct rp_unit *s;
+};
+
+/* NB: don't split the files into the parts less than this */
+#define RP_MIN_PART_SZ (1 << 22)
+
+/* NB: return the unit appended to US, or 0 (with errno set) */
+struct rp_unit *rp_units_new (struct rp_units *us);
+
+/* NB: the file NAME (the standard input, if `-'), numbered FILE, is
+   added to US: a regular file is split into up to JOBS parts of the
+   whole records, and *RECS is set to the number of these (the parts
+   are left to the caller if JOBS is 0); a stream is a unit by itself,
+   and *RECS is set to -1.  Return 1 if the regular file ends in the
+   middle of a record, and -1 (with errno set) on failure */
+int rp_units_add (struct rp_units *us, size_t file, const char *name,
+                  size_t size, size_t jobs, off_t *recs);
+
+/* NB: the records read are handed to DATA, the BUF_RECS records (of
+   the buffer BUF) at most at a time, along with PARAM; the holes of
+   the regular files are handed to ZEROS as the numbers of the zero
+   records instead, unless ZEROS is a null pointer */
+typedef void (*rp_data_fn) (void *param, const void *raw, size_t count);
+typedef void (*rp_zeros_fn) (void *param, off_t count);
+
+/* NB: the stream FP is read to EOF; return 1 if it ends in the middle
+   of a record, and -1 (with errno set) on a read error */
+int rp_read_stream (FILE *fp, void *buf, size_t buf_recs, size_t size,
+                    rp_data_fn data, void *param);
+/* NB: the LENGTH bytes at OFFSET of the regular file NAME are read;
+   should the file be truncated meanwhile, the records up to its end
+   are; return -1 (with errno set) on failure */
+int rp_read_part (const char *name, off_t offset, off_t length,
+                  void *buf, size_t buf_recs, size_t size,
+                  rp_data_fn data, rp_zeros_fn zeros, void *param);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** recparts.h ends here */
@@ -0,0 +1,307 @@
+/*** sidecar.c --- The cache of the results for the files  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#define _GNU_SOURCE             /* for asprintf () */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sidecar.h"
+
+/* NB: followed by the length of the key, the key, the identity of
+   the file, the length of the data, its checksum, and the data
+   itself */
+static const char magic[] = "rawtools sidecar 2\n";
+#define MAGIC_LEN (sizeof (magic) - 1)
+/* NB: the device, inode, size and modification time (seconds and
+   nanoseconds) */
+#define IDENTITY_N 5
+
+/*** Utility */
+
+/* NB: FNV-1a, for both the names of the entries and the checksums */
+static uint64_t
+fnv1a (const void *data, size_t size)
+{
+  const unsigned char *p = data;
+  uint64_t h = UINT64_C (0xcbf29ce484222325);
+  size_t i;
+  for (i = 0; i < size; i++) {
+    h = (h ^ p[i]) * UINT64_C (0x100000001b3);
+  }
+
+  /* . */
+  return h;
+}
+
+static int
+write_all (int fd, const void *data, size_t size)
+{
+  const char *p = data;
+  while (size > 0) {
+    const ssize_t n = write (fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      /* . */
+      return -1;
+    }
+    p    += n;
+    size -= n;
+  }
+
+  /* . */
+  return 0;
+}
+
+static void
+identity (uint64_t *id, const struct sidecar *sc)
+{
+  id[0] = sc->dev;
+  id[1] = sc->ino;
+  id[2] = sc->size;
+  id[3] = sc->mtime_s;
+  id[4] = sc->mtime_ns;
+}
+
+/* NB: the whole entry is read into memory */
+static char *
+read_all (const char *path, size_t *size)
+{
+  struct stat st;
+  char *buf;
+  size_t got;
+  FILE *fp;
+
+  if ((fp = fopen (path, "rb")) == 0) {
+    /* . */
+    return 0;
+  }
+  if (fstat (fileno (fp), &st) != 0
+      || (buf = malloc (st.st_size > 0 ? st.st_size : 1)) == 0) {
+    fclose (fp);
+    /* . */
+    return 0;
+  }
+  got = fread (buf, 1, st.st_size, fp);
+  fclose (fp);
+  *size = got;
+
+  /* . */
+  return buf;
+}
+
+/*** Initializing */
+
+int
+sidecar_init (struct sidecar *sc, const char *dir,
+              const char *file, const char *config)
+{
+  struct stat st;
+  char *key;
+  int len;
+
+  sc->path = sc->key = sc->file = 0;
+  if (stat (file, &st) != 0) {
+    /* . */
+    return -1;
+  }
+  if (! S_ISREG (st.st_mode)) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  if ((sc->file = realpath (file, 0)) == 0) {
+    /* . */
+    return -1;
+  }
+  sc->dev      = st.st_dev;
+  sc->ino      = st.st_ino;
+  sc->size     = st.st_size;
+  sc->mtime_s  = st.st_mtim.tv_sec;
+  sc->mtime_ns = st.st_mtim.tv_nsec;
+  if ((len = asprintf (&key, "%s\n%s", sc->file, config)) < 0) {
+    free (sc->file);
+    sc->file = 0;
+    /* . */
+    return -1;
+  }
+  sc->key     = key;
+  sc->key_len = len;
+  if (asprintf (&(sc->path), "%s/%016llx", dir,
+                (unsigned long long)fnv1a (key, len)) < 0) {
+    sidecar_free (sc);
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+void
+sidecar_free (struct sidecar *sc)
+{
+  free (sc->path);
+  free (sc->key);
+  free (sc->file);
+  sc->path = sc->key = sc->file = 0;
+}
+
+/*** Loading and storing */
+
+int
+sidecar_load (const struct sidecar *sc, void **data, size_t *size)
+{
+  const size_t head = MAGIC_LEN + sizeof (uint64_t);
+  const size_t tail = (IDENTITY_N + 2) * sizeof (uint64_t);
+  uint64_t key_len, len, sum, id[IDENTITY_N];
+  size_t got, pos;
+  char *buf;
+
+  if ((buf = read_all (sc->path, &got)) == 0) {
+    /* NB: a missing entry isn't an error */
+    return (errno == ENOENT) ? 0 : -1;
+  }
+  if (got < head || memcmp (buf, magic, MAGIC_LEN) != 0) {
+    free (buf);
+    /* . */
+    return 0;
+  }
+  memcpy (&key_len, buf + MAGIC_LEN, sizeof (key_len));
+  pos = head;
+  identity (id, sc);
+  if (key_len != sc->key_len
+      || got - pos < key_len + tail
+      || memcmp (buf + pos, sc->key, key_len) != 0
+      || memcmp (buf + pos + key_len, id, sizeof (id)) != 0) {
+    /* NB: a collision, or the file has changed since */
+    free (buf);
+    /* . */
+    return 0;
+  }
+  pos += key_len + sizeof (id);
+  memcpy (&len, buf + pos, sizeof (len));
+  memcpy (&sum, buf + pos + sizeof (len), sizeof (sum));
+  pos += 2 * sizeof (uint64_t);
+  if (len != got - pos || fnv1a (buf + pos, len) != sum) {
+    /* NB: a truncated or damaged entry */
+    free (buf);
+    /* . */
+    return 0;
+  }
+
+  /* NB: the data is moved to the beginning, so that it's aligned */
+  memmove (buf, buf + pos, len);
+  *data = buf;
+  *size = len;
+
+  /* . */
+  return 1;
+}
+
+int
+sidecar_store (const struct sidecar *sc,
+               const void *data, size_t size)
+{
+  const char *slash = strrchr (sc->path, '/');
+  const uint64_t key_len = sc->key_len, len = size;
+  const uint64_t sum = fnv1a (data, size);
+  uint64_t id[IDENTITY_N];
+  char tmp[strlen (sc->path) + 8];
+  int fd;
+
+  identity (id, sc);
+  sprintf (tmp, "%s.XXXXXX", sc->path);
+  if ((fd = mkstemp (tmp)) < 0 && errno == ENOENT && slash != 0) {
+    /* NB: the directory is created (but not its parents) */
+    char dir[slash - sc->path + 1];
+    memcpy (dir, sc->path, slash - sc->path);
+    dir[slash - sc->path] = '\0';
+    if (mkdir (dir, 0777) != 0 && errno != EEXIST) {
+      /* . */
+      return -1;
+    }
+    sprintf (tmp, "%s.XXXXXX", sc->path);
+    fd = mkstemp (tmp);
+  }
+  if (fd < 0) {
+    /* . */
+    return -1;
+  }
+  if (write_all (fd, magic, MAGIC_LEN) < 0
+      || write_all (fd, &key_len, sizeof (key_len)) < 0
+      || write_all (fd, sc->key, sc->key_len) < 0
+      || write_all (fd, id, sizeof (id)) < 0
+      || write_all (fd, &len, sizeof (len)) < 0
+      || write_all (fd, &sum, sizeof (sum)) < 0
+      || write_all (fd, data, size) < 0) {
+    const int e = errno;
+    close (fd);
+    unlink (tmp);
+    errno = e;
+    /* . */
+    return -1;
+  }
+  if (close (fd) != 0 || rename (tmp, sc->path) != 0) {
+    const int e = errno;
+    unlink (tmp);
+    errno = e;
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+int
+sidecar_unchanged_p (const struct sidecar *sc)
+{
+  struct stat st;
+
+  /* . */
+  return (stat (sc->file, &st) == 0
+          && st.st_dev  == sc->dev
+          && st.st_ino  == sc->ino
+          && st.st_size == sc->size
+          && st.st_mtim.tv_sec  == sc->mtime_s
+          && st.st_mtim.tv_nsec == sc->mtime_ns);
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** sidecar.c ends here */
@@ -0,0 +1,83 @@
+/*** sidecar.h --- The cache of the results for the files  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+#include <sys/types.h>          /* for dev_t, ino_t, off_t */
+
+/* NB: the cache directory holds an entry per (regular) file and
+   configuration, named after the hash of the key: the real path of
+   the file, and the configuration (an arbitrary string, describing
+   what's computed and how).  Along with the data, the entry holds the
+   key, and the identity of the file it was made for (its device,
+   inode, size and modification time); both are compared on loading,
+   so that a stale entry (or a collision) is never used, and a stale
+   one is overwritten as the file is read anew, so that there's never
+   more than an entry per file and configuration.  The data is opaque
+   (and in the host's byte order); it's checksummed, and the entries
+   are replaced atomically (by rename ()), so that concurrent readers
+   and writers never see a partial entry.  */
+
+struct sidecar {
+  /* the entry, and the key it's for */
+  char *path;
+  char *key;
+  size_t key_len;
+  /* the identity of the file */
+  char *file;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  long mtime_s, mtime_ns;
+};
+
+/* NB: return -1 and set errno on failure, e.g., if FILE isn't a
+   regular file */
+int  sidecar_init (struct sidecar *sc, const char *dir,
+                   const char *file, const char *config);
+void sidecar_free (struct sidecar *sc);
+
+/* NB: return 1 and the data (allocated with malloc ()) if the entry
+   is there and valid, 0 if it isn't, and -1 (with errno set) on
+   error */
+int  sidecar_load (const struct sidecar *sc, void **data, size_t *size);
+/* NB: the directory is created if necessary */
+int  sidecar_store (const struct sidecar *sc,
+                    const void *data, size_t size);
+
+/* check if the file is still the one the key was made for (e.g.,
+   after it's read) */
+int  sidecar_unchanged_p (const struct sidecar *sc);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** sidecar.h ends here */
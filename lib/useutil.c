@@ -19,10 +19,19 @@
  */
 
 /*** Code: */
+#define _GNU_SOURCE             /* for SEEK_DATA, SEEK_HOLE */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <errno.h>
+#include <fcntl.h>              /* for fcntl () */
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "usemacro.h"
 #include "useutil.h"
@@ -118,6 +127,127 @@ close_file (FILE *fp)
   /* . */
 }
 
+/*** Sparse files */
+
+/* NB: the data extends to the end of the file (or the stream) */
+#define OFF_MAX ((off_t)(UINT64_MAX >> 1))
+
+int
+sparse_extent (int fd, off_t pos, off_t size, off_t *end)
+{
+#ifdef SEEK_HOLE
+  const off_t saved = lseek (fd, 0, SEEK_CUR);
+  off_t hole, data;
+  int r = 1;
+
+  if (saved < 0) {
+    /* NB: not seekable */
+    *end = OFF_MAX;
+    /* . */
+    return 1;
+  }
+  if ((hole = lseek (fd, pos, SEEK_HOLE)) < 0) {
+    if (errno == ENXIO) {
+      /* NB: at the end of the file */
+      *end = pos + size;
+    } else if (errno == EINVAL || errno == ENOTSUP) {
+      /* NB: the holes couldn't be found */
+      *end = OFF_MAX;
+    } else {
+      r = -1;
+    }
+  } else if (hole > pos) {
+    *end = pos + (hole - pos + size - 1) / size * size;
+  } else if ((data = lseek (fd, pos, SEEK_DATA)) < 0
+             && errno != ENXIO) {
+    r = -1;
+  } else {
+    struct stat st;
+    /* NB: the hole might extend to the end of the file */
+    if (data < 0) {
+      data = (fstat (fd, &st) == 0) ? st.st_size : pos;
+    }
+    if (data - pos >= size) {
+      *end = pos + (data - pos) / size * size;
+      r = 0;
+    } else {
+      /* NB: too short a hole is read as data */
+      *end = pos + size;
+    }
+  }
+  {
+    const int e = errno;
+    lseek (fd, saved, SEEK_SET);
+    errno = e;
+  }
+
+  /* . */
+  return r;
+#else
+  *end = OFF_MAX;
+  /* . */
+  return 1;
+#endif
+}
+
+/* NB: the holes are only left in the regular files, not opened for
+   appending */
+static int
+sparse_p (FILE *fp)
+{
+  struct stat st;
+  int flags;
+
+  /* . */
+  return (fstat (fileno (fp), &st) == 0 && S_ISREG (st.st_mode)
+          && (flags = fcntl (fileno (fp), F_GETFL)) >= 0
+          && (flags & O_APPEND) == 0);
+}
+
+int
+sparse_write_zeros (FILE *fp, off_t count)
+{
+  static const char zeros[4096];
+
+  if (sparse_p (fp)) {
+    /* . */
+    return fseeko (fp, count, SEEK_CUR);
+  }
+  while (count > 0) {
+    const size_t n = MIN (count, (off_t)sizeof (zeros));
+    if (fwrite (zeros, 1, n, fp) != n) {
+      /* . */
+      return -1;
+    }
+    count -= n;
+  }
+
+  /* . */
+  return 0;
+}
+
+int
+sparse_finish (FILE *fp)
+{
+  struct stat st;
+  off_t pos;
+
+  if (fflush (fp) != 0) {
+    /* . */
+    return -1;
+  }
+  if (! sparse_p (fp)
+      || (pos = ftello (fp)) < 0
+      || fstat (fileno (fp), &st) != 0
+      || pos <= st.st_size) {
+    /* . */
+    return 0;
+  }
+
+  /* . */
+  return ftruncate (fileno (fp), pos);
+}
+
 /*** Emacs stuff */
 /** Local variables: */
 /** fill-column: 72 */
@@ -23,6 +23,7 @@
 #define USEUTIL_H
 
 #include <stdio.h>		/* for FILE */
+#include <sys/types.h>          /* for off_t */
 
 int ensure_enough_space (void **ptr, size_t *allocptr,
 			 size_t size, size_t wanted);
@@ -40,6 +41,19 @@ void strings_clear (struct strings *vec);
 FILE *open_file (const char *arg, int input_p);
 void close_file (FILE *fp);
 
+/** Sparse files */
+
+/* NB: tell if the run of the records of SIZE bytes at POS is within a
+   hole (0), or is data (1), setting *END to where the run ends, or
+   return -1 and set errno; the records which are partly in a hole are
+   data.  (Without SEEK_HOLE, or for the streams, it's all data.)  The
+   offset of the file is left intact */
+int sparse_extent (int fd, off_t pos, off_t size, off_t *end);
+/* NB: the zeros are skipped over if FP is a regular file, leaving a
+   hole, and sparse_finish () then extends the file as necessary */
+int sparse_write_zeros (FILE *fp, off_t count);
+int sparse_finish (FILE *fp);
+
 #endif
 /*** Emacs stuff */
 /** Local variables: */
@@ -0,0 +1,321 @@
+/*** zonemap.c --- Per-block summaries of raw files  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#define _GNU_SOURCE             /* for st_mtim */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <math.h>               /* for NAN */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zonemap.h"
+
+/* NB: the header is a sequence of 8-byte words: the magic, the
+   identity of the file, the format, and the geometry of the blocks;
+   the blocks follow, in the host's byte order */
+static const char magic[8] = "rawzmap2";
+enum {
+  H_MAGIC = 0,
+  H_DEV, H_INO, H_SIZE, H_MTIME_S, H_MTIME_NS,
+  H_TYPE, H_PACKED, H_SCALE, H_OFFSET, H_FILL_P, H_FILL,
+  H_BLOCK, H_ELEMENTS,
+  H_MAX
+};
+
+/*** Utility */
+
+static char *
+zmap_path (const char *file)
+{
+  char *path;
+  if ((path = malloc (strlen (file) + sizeof (ZMAP_SUFFIX))) == 0) {
+    /* . */
+    return 0;
+  }
+  strcpy (path, file);
+  strcat (path, ZMAP_SUFFIX);
+
+  /* . */
+  return path;
+}
+
+static int
+zmap_identify (struct zmap *z, const char *file)
+{
+  struct stat st;
+  if (stat (file, &st) != 0) {
+    /* . */
+    return -1;
+  }
+  if (! S_ISREG (st.st_mode)) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  z->dev      = st.st_dev;
+  z->ino      = st.st_ino;
+  z->size     = st.st_size;
+  z->mtime_s  = st.st_mtim.tv_sec;
+  z->mtime_ns = st.st_mtim.tv_nsec;
+
+  /* . */
+  return 0;
+}
+
+/* NB: the words are copied, so that the doubles keep their bits */
+static void
+zmap_header (const struct zmap *z, uint64_t *h)
+{
+  memset (h, 0, H_MAX * sizeof (*h));
+  memcpy (h + H_MAGIC, magic, sizeof (magic));
+  h[H_DEV]      = z->dev;
+  h[H_INO]      = z->ino;
+  h[H_SIZE]     = z->size;
+  h[H_MTIME_S]  = z->mtime_s;
+  h[H_MTIME_NS] = z->mtime_ns;
+  h[H_TYPE]     = z->fmt.type;
+  h[H_PACKED]   = z->fmt.packed_p;
+  memcpy (h + H_SCALE,  &(z->fmt.scale),  sizeof (double));
+  memcpy (h + H_OFFSET, &(z->fmt.offset), sizeof (double));
+  h[H_FILL_P]   = z->fmt.fill_p;
+  if (z->fmt.fill_p) {
+    memcpy (h + H_FILL, &(z->fmt.fill), numfmt_size (&(z->fmt)));
+  }
+  h[H_BLOCK]    = z->block;
+  h[H_ELEMENTS] = z->elements;
+}
+
+/*** Initializing */
+
+enum numfmt_type
+zmap_type (const struct numfmt *fmt)
+{
+  /* . */
+  return ((fmt->packed_p || fmt->fill_p) ? NUMFMT_DOUBLE : fmt->type);
+}
+
+int
+zmap_init (struct zmap *z, const char *file,
+           const struct numfmt *fmt, size_t block)
+{
+  z->blocks = 0;
+  if (block < 1) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  if (zmap_identify (z, file) < 0) {
+    /* . */
+    return -1;
+  }
+  z->fmt      = *fmt;
+  z->t        = zmap_type (fmt);
+  z->block    = block;
+  z->elements = z->size / numfmt_size (fmt);
+  z->count    = (z->elements + block - 1) / block;
+  if (z->count > 0
+      && (z->blocks = calloc (z->count, sizeof (*(z->blocks)))) == 0) {
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+void
+zmap_free (struct zmap *z)
+{
+  free (z->blocks);
+  z->blocks = 0;
+  z->count  = 0;
+}
+
+/*** Loading and storing */
+
+int
+zmap_load (struct zmap *z, const char *file, const struct numfmt *fmt)
+{
+  uint64_t h[H_MAX], want[H_MAX];
+  char *path;
+  FILE *fp;
+  int valid_p;
+
+  z->blocks = 0;
+  z->count  = 0;
+  if (zmap_identify (z, file) < 0) {
+    /* . */
+    return -1;
+  }
+  if ((path = zmap_path (file)) == 0) {
+    /* . */
+    return -1;
+  }
+  fp = fopen (path, "rb");
+  free (path);
+  if (fp == 0) {
+    /* NB: a missing map isn't an error */
+    return (errno == ENOENT) ? 0 : -1;
+  }
+
+  /* NB: the header should be the same as that of a map made now, save
+     for the size of the blocks */
+  z->fmt      = *fmt;
+  z->t        = zmap_type (fmt);
+  z->elements = z->size / numfmt_size (fmt);
+  if (fread (h, sizeof (*h), H_MAX, fp) != H_MAX
+      || (z->block = h[H_BLOCK]) < 1) {
+    fclose (fp);
+    /* . */
+    return 0;
+  }
+  zmap_header (z, want);
+  if (memcmp (h, want, sizeof (h)) != 0) {
+    fclose (fp);
+    /* . */
+    return 0;
+  }
+  z->count = (z->elements + z->block - 1) / z->block;
+  if (z->count > 0
+      && (z->blocks = malloc (z->count * sizeof (*(z->blocks)))) == 0) {
+    fclose (fp);
+    /* . */
+    return -1;
+  }
+  valid_p = (fread (z->blocks, sizeof (*(z->blocks)), z->count, fp)
+             == z->count
+             && fgetc (fp) == EOF);
+  fclose (fp);
+  if (! valid_p) {
+    zmap_free (z);
+  }
+
+  /* . */
+  return valid_p;
+}
+
+int
+zmap_store (const struct zmap *z, const char *file)
+{
+  uint64_t h[H_MAX];
+  char *path, *tmp;
+  FILE *fp;
+  int fd;
+
+  if ((path = zmap_path (file)) == 0) {
+    /* . */
+    return -1;
+  }
+  if ((tmp = malloc (strlen (path) + 8)) == 0) {
+    free (path);
+    /* . */
+    return -1;
+  }
+  sprintf (tmp, "%s.XXXXXX", path);
+  if ((fd = mkstemp (tmp)) < 0 || (fp = fdopen (fd, "wb")) == 0) {
+    const int e = errno;
+    if (fd >= 0) {
+      close (fd);
+      unlink (tmp);
+    }
+    free (tmp);
+    free (path);
+    errno = e;
+    /* . */
+    return -1;
+  }
+  {
+    /* NB: mkstemp () makes the file private */
+    const mode_t mask = umask (0);
+    umask (mask);
+    fchmod (fd, 0666 & ~mask);
+  }
+  zmap_header (z, h);
+  fwrite (h, sizeof (*h), H_MAX, fp);
+  fwrite (z->blocks, sizeof (*(z->blocks)), z->count, fp);
+  if (ferror (fp) | (fclose (fp) != 0)
+      || rename (tmp, path) != 0) {
+    const int e = errno;
+    unlink (tmp);
+    free (tmp);
+    free (path);
+    errno = e;
+    /* . */
+    return -1;
+  }
+  free (tmp);
+  free (path);
+
+  /* . */
+  return 0;
+}
+
+/*** Access */
+
+uint64_t
+zmap_block_length (const struct zmap *z, size_t i)
+{
+  /* . */
+  return ((i + 1 < z->count) ? z->block
+          : z->elements - z->block * (uint64_t)i);
+}
+
+int
+zmap_block_constant_p (const struct zmap *z, size_t i, double *value)
+{
+  const struct zmap_block *b = z->blocks + i;
+  struct numfmt plain;
+
+  if (b->nan_count == zmap_block_length (z, i)) {
+    *value = NAN;
+    /* . */
+    return 1;
+  }
+  if (b->nan_count != 0
+      || memcmp (&(b->min), &(b->max), sizeof (b->min)) != 0) {
+    /* . */
+    return 0;
+  }
+
+  /* NB: the value is at the beginning of the union */
+  numfmt_init (&plain, z->t);
+  numfmt_to_doubles (value, &(b->min), 1, &plain);
+
+  /* . */
+  return 1;
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** zonemap.c ends here */
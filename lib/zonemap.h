@@ -0,0 +1,92 @@
+/*** zonemap.h --- Per-block summaries of raw files  -*- C -*- */
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+/*** Code: */
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <stddef.h>             /* for size_t */
+#include <stdint.h>
+
+#include "numfmt.h"
+
+/* NB: the zone map of FILE is kept alongside of it, in FILE.zmap.  The
+   data, in the format given, is divided into the blocks of BLOCK
+   elements (the last one may be shorter), and the range of the values
+   other than NaN, and the number of NaN's, are kept for each.  The
+   range is in the type of the data, or in `double' for the packed
+   formats and those with the fill value (which is counted as NaN.)
+   The map is valid for as long as the device, inode, size and
+   modification time of the file stay the same.  */
+
+#define ZMAP_SUFFIX ".zmap"
+#define ZMAP_DEFAULT_BLOCK 65536
+
+struct zmap_block {
+  union numfmt_value min, max;
+  uint64_t nan_count;
+};
+
+struct zmap {
+  struct numfmt fmt;
+  /* the type of MIN and MAX */
+  enum numfmt_type t;
+  uint64_t block, elements;
+  size_t count;
+  struct zmap_block *blocks;
+  /* the identity of the file */
+  uint64_t dev, ino, size;
+  int64_t mtime_s, mtime_ns;
+};
+
+/* NB: the map is made for the file as it is now, with the blocks
+   zeroed; return -1 and set errno on failure */
+int  zmap_init (struct zmap *z, const char *file,
+                const struct numfmt *fmt, size_t block);
+void zmap_free (struct zmap *z);
+
+/* NB: return 1 if the map is there, and is valid for the file as it
+   is now and for FMT, 0 if it isn't, and -1 (with errno set) on
+   error */
+int  zmap_load (struct zmap *z, const char *file,
+                const struct numfmt *fmt);
+/* NB: the map is replaced atomically */
+int  zmap_store (const struct zmap *z, const char *file);
+
+/* the type the range is kept in, for the format */
+enum numfmt_type zmap_type (const struct numfmt *fmt);
+
+uint64_t zmap_block_length (const struct zmap *z, size_t i);
+/* check if the values of the block are all the same (or all NaN's),
+   and return the value */
+int  zmap_block_constant_p (const struct zmap *z, size_t i,
+                            double *value);
+
+#endif
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** zonemap.h ends here */
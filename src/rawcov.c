@@ -0,0 +1,634 @@
+/*** rawcov.c --- Covariance of the vectors in the files  -*- C -*- */
+#define _GNU_SOURCE
+#include "config.h"
+#include "gettext.h"
+#define _(string) gettext (string)
+#define N_(string) gettext_noop (string)
+static const char doc[]
+= N_("Find the mean and covariance of the vectors in the files\v"
+     "The vectors of ELTS elements are read in the formats given"
+     " (the last one applying to the rest; `double' by default),"
+     " and the vectors with NaN's or infinities are skipped.\n\n"
+     "The (population) covariance matrix is output as text, one row"
+     " per line, following the comment lines of the number of the"
+     " vectors and their mean, so that it could be read by"
+     " `rawmatrix --matrix-file'.\n\n"
+     "With --pca, the eigenvectors of the covariance matrix are"
+     " output instead, one per row, in the descending order of the"
+     " eigenvalues (the variances along them), which are listed in"
+     " a comment; only the first N are output, if given.  With"
+     " --whiten, each eigenvector is divided by the square root of"
+     " its eigenvalue, so that the result is of unit variance.  With"
+     " --trailing-1, the last column centres the result on zero, as"
+     " for `rawmatrix --trailing-1'.");
+static const char args_doc[] = "[FILE]...";
+
+/*** Copyright (C) 2007 Ivan Shmakov */
+
+/** This program is free software; you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation; either version 2 of the License, or
+ ** (at your option) any later version.
+ **
+ ** This program is distributed in the hope that it will be useful, but
+ ** WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ ** General Public License for more details.
+ **
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program; if not, write to the Free Software
+ ** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ ** 02110-1301 USA
+ */
+
+const char *
+program_copyright (void)
+{
+  return _("Copyright (C) 2007 Ivan Shmakov\n"
+           "This is free software; see the source for copying"
+           " conditions.  There is NO\n"
+           "warranty; not even for MERCHANTABILITY or FITNESS FOR A"
+           " PARTICULAR PURPOSE.\n");
+}
+
+/*** Code: */
+#include <argp.h>
+#include <errno.h>
+#include <error.h>
+#include <float.h>              /* for DBL_DIG, DBL_EPSILON */
+#include <locale.h>
+#include <math.h>               /* for sqrt () */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numcov.h"
+#include "numfmt.h"
+#include "numrec.h"
+#include "p_arg.h"
+#include "recparts.h"
+#include "usemacro.h"
+#include "useutil.h"
+
+#define PROGRAM_NAME "rawcov"
+
+#define BUF_SZ 65536
+
+/*** Reading */
+
+/* NB: the buffers of a worker, for the raw records and the doubles */
+struct reader {
+  const struct nrec *rec;
+  size_t buf_recs;
+  char *raw;
+  double *values;
+};
+
+static void
+reader_init (struct reader *rd, const struct nrec *rec)
+{
+  rd->rec      = rec;
+  rd->buf_recs = MAX (BUF_SZ / rec->size, 1);
+  if (MALLOC_ARY (rd->raw, rd->buf_recs * rec->size) == 0
+      || MALLOC_ARY (rd->values, rd->buf_recs * rec->count) == 0) {
+    error (1, errno, _("allocating the buffers"));
+  }
+}
+
+static void
+reader_free (struct reader *rd)
+{
+  free (rd->raw);
+  free (rd->values);
+}
+
+static void
+reader_add (struct ncov *cv, struct reader *rd, size_t count)
+{
+  nrec_to_doubles (rd->values, rd->raw, count, rd->rec);
+  ncov_add_doubles (cv, rd->values, count);
+}
+
+/* NB: the records are read into the buffer of the reader */
+struct scan_arg {
+  struct ncov *cv;
+  struct reader *rd;
+};
+
+static void
+reader_data (void *param, const void *raw, size_t count)
+{
+  struct scan_arg *sa = param;
+  (void)raw;
+  reader_add (sa->cv, sa->rd, count);
+}
+
+static void
+scan_file (struct ncov *cv, struct reader *rd,
+           const char *name, int verbose_p)
+{
+  struct scan_arg sa = { cv, rd };
+  FILE *fp;
+  int r;
+
+  if ((fp = open_file (name, 1)) == 0) {
+    error (1, errno, "%s", name);
+  }
+  if (verbose_p) {
+    if (fp == stdin)
+      fputs (_("processing standard input...\n"), stderr);
+    else
+      fprintf (stderr, _("processing `%s'...\n"), name);
+  }
+  r = rp_read_stream (fp, rd->raw, rd->buf_recs, rd->rec->size,
+                      reader_data, &sa);
+  if (r > 0) {
+    error (1, 0, _("%s: EOF in the middle of the vector"), name);
+  } else if (r < 0) {
+    error (1, errno, "%s", name);
+  }
+  close_file (fp);
+}
+
+static void
+scan_part (struct ncov *cv, struct reader *rd,
+           const char *name, off_t offset, off_t length)
+{
+  struct scan_arg sa = { cv, rd };
+
+  if (rp_read_part (name, offset, length, rd->raw, rd->buf_recs,
+                    rd->rec->size, reader_data, 0, &sa) < 0) {
+    error (1, errno, "%s", name);
+  }
+}
+
+/*** Parallel scanning */
+
+/* NB: the workers take the units in order, each accumulating into
+   its own result; these are merged pairwise once all are done */
+struct pool {
+  const struct nrec *rec;
+  const char **names;
+  struct rp_units units;
+  size_t next;
+  int verbose_p;
+  pthread_mutex_t lock;
+};
+
+struct worker {
+  struct pool *pl;
+  struct ncov *cv;
+};
+
+static void *
+pool_worker (void *arg)
+{
+  struct worker *w = arg;
+  struct pool *pl = w->pl;
+  struct reader rd;
+
+  reader_init (&rd, pl->rec);
+  for (;;) {
+    const struct rp_unit *u;
+    pthread_mutex_lock (&(pl->lock));
+    u = (pl->next < pl->units.count) ? pl->units.s + (pl->next++) : 0;
+    pthread_mutex_unlock (&(pl->lock));
+    if (u == 0) {
+      break;
+    }
+    if (u->stream_p) {
+      scan_file (w->cv, &rd, pl->names[u->file], pl->verbose_p);
+    } else {
+      if (pl->verbose_p && u->first_p) {
+        fprintf (stderr, _("processing `%s'...\n"),
+                 pl->names[u->file]);
+      }
+      scan_part (w->cv, &rd, pl->names[u->file],
+                 u->offset, u->length);
+    }
+  }
+  reader_free (&rd);
+
+  /* . */
+  return 0;
+}
+
+/* NB: the regular files are split into up to JOBS parts each */
+static void
+pool_add_units (struct pool *pl, const char **names, size_t count,
+                size_t jobs)
+{
+  size_t i;
+
+  pl->units.count = pl->units.alloc = 0;
+  pl->units.s = 0;
+  for (i = 0; i < count; i++) {
+    off_t recs;
+    const int r = rp_units_add (&(pl->units), i, names[i],
+                                pl->rec->size, jobs, &recs);
+    if (r > 0) {
+      error (1, 0, _("%s: EOF in the middle of the vector"), names[i]);
+    } else if (r < 0) {
+      error (1, errno, "%s", names[i]);
+    }
+  }
+  pl->next = 0;
+}
+
+/* NB: the result is left in the first of RESULTS, one per thread;
+   merging these pairwise (rather than one by one) keeps the counts
+   of the merged moments alike, for the sake of precision */
+static void
+results_fold (struct ncov *results, size_t count)
+{
+  size_t step, i;
+  for (step = 1; step < count; step *= 2) {
+    for (i = 0; i + step < count; i += 2 * step) {
+      ncov_merge (results + i, results + i + step);
+    }
+  }
+}
+
+static void
+scan_files (struct ncov *cv, const struct nrec *rec,
+            const struct strings *names, size_t jobs, int verbose_p)
+{
+  struct pool pl;
+  size_t i, threads;
+
+  pl.rec       = rec;
+  pl.names     = names->s;
+  pl.verbose_p = verbose_p;
+  pthread_mutex_init (&(pl.lock), 0);
+  pool_add_units (&pl, names->s, names->size, jobs);
+
+  threads = BOUND (pl.units.count, 1, jobs);
+  {
+    struct ncov results[threads];
+    struct worker workers[threads];
+    results[0] = *cv;
+    for (i = 0; i < threads; i++) {
+      if (i > 0 && ncov_init (results + i, cv->size) < 0) {
+        error (1, errno, _("allocating the moments"));
+      }
+      workers[i].pl = &pl;
+      workers[i].cv = results + i;
+    }
+    if (threads <= 1) {
+      pool_worker (workers);
+    } else {
+      pthread_t tids[threads];
+      for (i = 0; i < threads; i++) {
+        if ((errno = pthread_create (tids + i, 0, pool_worker,
+                                     workers + i))
+            != 0) {
+          error (1, errno, _("creating a worker thread"));
+        }
+      }
+      for (i = 0; i < threads; i++) {
+        pthread_join (tids[i], 0);
+      }
+    }
+    results_fold (results, threads);
+    *cv = results[0];
+    for (i = 1; i < threads; i++) {
+      ncov_free (results + i);
+    }
+  }
+  pthread_mutex_destroy (&(pl.lock));
+  free (pl.units.s);
+}
+
+/*** Output */
+
+static void
+print_row (FILE *fp, const char *prefix, const double *v, size_t n)
+{
+  size_t j;
+  fputs (prefix, fp);
+  for (j = 0; j < n; j++) {
+    fprintf (fp, "%s%.*g", (j > 0 ? " " : ""), DBL_DIG + 2, v[j]);
+  }
+  putc ('\n', fp);
+}
+
+/*** Parsing the Command Line */
+
+const char *
+program_version (void)
+{
+  return
+    "rawcov " PACKAGE_NAME " " PACKAGE_VERSION;
+}
+
+static void
+p_vers (FILE *fp, struct argp_state *unused)
+{
+  fprintf (fp,
+           "%s\n\n%s\n",
+           program_version (),
+           program_copyright ());
+}
+
+const char *argp_program_bug_address = PACKAGE_BUGREPORT;
+void (*argp_program_version_hook)(FILE *, struct argp_state *) = p_vers;
+
+enum opts {
+  opt_pca = 256,
+  opt_trailing_1,
+  opt_whiten,
+  opt_max
+};
+
+static struct argp_option p_opts[] = {
+  { "format",           't', "FORMAT[,FORMAT]...", 0,
+    N_("select input formats of the elements, the last one applying"
+       " to the rest (`double' by default)") },
+  { "vector-size",      's', "ELTS", 0,
+    N_("read vectors of this number of elements (by default, as"
+       " many as the formats given)") },
+  { "jobs",             'j', "N", 0,
+    N_("read the files in N threads") },
+  { "pca",              opt_pca, "N", OPTION_ARG_OPTIONAL,
+    N_("output the (first N) eigenvectors of the covariance matrix,"
+       " as the rows of the matrix") },
+  { "whiten",           opt_whiten, 0, 0,
+    N_("with `--pca', scale the eigenvectors to unit variance") },
+  { "trailing-1",       opt_trailing_1, 0, 0,
+    N_("with `--pca', add the column to centre the result, for"
+       " `rawmatrix --trailing-1'") },
+  { "verbose",          'v', 0, 0,
+    N_("explain what is being done") },
+  { 0 }
+};
+
+struct p_args {
+  int verbose_p;
+  size_t jobs;
+  struct numfmt *formats;
+  size_t formats_count;
+  long vector_size;
+  int pca_p;
+  size_t pca_count;
+  int whiten_p;
+  int trailing_1_p;
+  struct strings files;
+};
+
+static error_t
+p_opt (int key, char *arg, struct argp_state *state)
+{
+  struct p_args *args = state->input;
+
+  switch (key) {
+  case 't':
+    if (numfmt_parse_list (&(args->formats),
+                           &(args->formats_count), arg) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--format'"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
+    break;
+  case 's':
+    {
+      long vs;
+      if (p_arg_long (arg, &vs) < 0 || vs < 1) {
+        argp_error (state,
+                    N_("%s: not a valid size,"
+                       " should be a positive number"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->vector_size = vs;
+    }
+    break;
+  case 'j':
+    {
+      long n;
+      if (p_arg_long (arg, &n) < 0 || n < 1) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--jobs'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->jobs = n;
+    }
+    break;
+  case opt_pca:
+    {
+      long n = 0;
+      if (arg != 0 && (p_arg_long (arg, &n) < 0 || n < 1)) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--pca'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->pca_p     = 1;
+      args->pca_count = n;
+    }
+    break;
+  case opt_whiten:
+    args->whiten_p = 1;
+    break;
+  case opt_trailing_1:
+    args->trailing_1_p = 1;
+    break;
+  case 'v':
+    args->verbose_p = 1;
+    break;
+  case ARGP_KEY_ARGS:
+    if (strings_append (&(args->files),
+                        state->argv + state->next,
+                        state->argc - state->next) < 0) {
+      argp_failure (state, 0, errno,
+                    N_("couldn't store non-option arguments"));
+      /* . */
+      return errno;
+    }
+    break;
+  case ARGP_KEY_NO_ARGS:
+    {
+      const char *s[1] = { "-" };
+      if (strings_append (&(args->files), s, 1) < 0) {
+        argp_failure (state, 0, errno,
+                      N_("couldn't set stdin as the input file"));
+        /* . */
+        return errno;
+      }
+    }
+    break;
+  case ARGP_KEY_END:
+    if (args->formats_count == 0) {
+      static struct numfmt dbl = { NUMFMT_DOUBLE, 0, 1, 0 };
+      args->formats = &dbl;
+      args->formats_count = 1;
+    }
+    if (args->vector_size == 0 && args->formats_count > 1) {
+      args->vector_size = args->formats_count;
+    }
+    if (args->vector_size == 0) {
+      argp_error (state,
+                  N_("the length of the vectors should be given"
+                     " with `-s'"));
+      /* . */
+      return EINVAL;
+    } else if ((size_t)args->vector_size < args->formats_count) {
+      argp_error (state,
+                  N_("more formats given than there're elements"));
+      /* . */
+      return EINVAL;
+    }
+    if (args->pca_count > (size_t)args->vector_size) {
+      argp_error (state,
+                  N_("no more than %ld eigenvectors could be output"),
+                  args->vector_size);
+      /* . */
+      return EINVAL;
+    }
+    if ((args->whiten_p || args->trailing_1_p) && ! args->pca_p) {
+      argp_error (state,
+                  N_("`--whiten' and `--trailing-1' require `--pca'"));
+      /* . */
+      return EINVAL;
+    }
+    break;
+  default:
+    /* . */
+    return ARGP_ERR_UNKNOWN;
+    break;
+  }
+
+  /* . */
+  return 0;
+}
+
+/*** Main */
+
+int
+main (int argc, char **argv)
+{
+  struct p_args args = {
+    .verbose_p  = 0,
+    .jobs       = 1,
+    .formats    = 0,
+    .formats_count = 0,
+    .vector_size = 0,
+    .pca_p      = 0,
+    .pca_count  = 0,
+    .whiten_p   = 0,
+    .trailing_1_p = 0,
+    .files      = { 0, 0, 0 },
+  };
+  FILE *output = stdout;
+
+  /* set the locale */
+  setlocale (LC_ALL, "");
+
+#if ENABLE_NLS
+  /* set the default domain for translations */
+  bindtextdomain (PACKAGE, LOCALEDIR);
+  textdomain (PACKAGE);
+#endif
+
+  /* parse the command line */
+  {
+    static struct argp argp = { p_opts, p_opt, args_doc, doc };
+    argp_parse (&argp, argc, argv, 0, 0, &args);
+  }
+
+  /* read the files, and output the result */
+  {
+    const size_t n = args.vector_size;
+    struct numfmt fmts[n];
+    struct nrec rec;
+    struct ncov cv;
+    double *cov;
+    size_t i, j;
+
+    /* NB: the last format applies to the rest of the elements */
+    for (i = 0; i < n; i++) {
+      fmts[i] = args.formats[MIN (i, args.formats_count - 1)];
+    }
+    if (nrec_init (&rec, fmts, n) < 0) {
+      error (1, errno, _("allocating the record codecs"));
+    }
+    if (ncov_init (&cv, n) < 0 || MALLOC_ARY (cov, n * n) == 0) {
+      error (1, errno, _("allocating the moments"));
+    }
+    scan_files (&cv, &rec, &(args.files), args.jobs, args.verbose_p);
+    if (cv.count == 0) {
+      error (1, 0, _("no vectors read"));
+    }
+    ncov_covariance (cov, &cv);
+
+    fprintf (output, _("# %llu vectors of %lu elements"),
+             (unsigned long long)cv.count, (unsigned long)n);
+    if (cv.skipped_count > 0) {
+      fprintf (output,
+               _(" (%llu with NaN's or infinities skipped)"),
+               (unsigned long long)cv.skipped_count);
+    }
+    putc ('\n', output);
+    print_row (output, "# mean ", cv.mean, n);
+
+    if (! args.pca_p) {
+      for (i = 0; i < n; i++) {
+        print_row (output, "", cov + i * n, n);
+      }
+    } else {
+      const size_t count = args.pca_count > 0 ? args.pca_count : n;
+      double values[n], *vectors, row[n + 1], zero;
+      if (MALLOC_ARY (vectors, n * n) == 0
+          || ncov_eigen (values, vectors, cov, n) < 0) {
+        error (1, errno, _("computing the eigenvectors"));
+      }
+      print_row (output, "# eigenvalues ", values, n);
+      /* NB: the eigenvalues this small relative to the largest one are
+         but the rounding errors of those of the rank-deficient data */
+      zero = n * DBL_EPSILON * values[0];
+      for (i = 0; args.whiten_p && i < count; i++) {
+        if (! (values[i] > zero)) {
+          error (1, 0, _("the variance along the eigenvector %lu"
+                         " is zero, and couldn't be whitened"),
+                 (unsigned long)(i + 1));
+        }
+      }
+      for (i = 0; i < count; i++) {
+        const double scale
+          = args.whiten_p ? 1 / sqrt (values[i]) : 1;
+        double offset = 0;
+        for (j = 0; j < n; j++) {
+          row[j]  = scale * vectors[i * n + j];
+          offset -= row[j] * cv.mean[j];
+        }
+        row[n] = offset;
+        print_row (output, "", row, n + (args.trailing_1_p ? 1 : 0));
+      }
+      free (vectors);
+    }
+    free (cov);
+    ncov_free (&cv);
+    nrec_free (&rec);
+  }
+
+  /* . */
+  return 0;
+}
+
+/*** Emacs stuff */
+/** Local variables: */
+/** fill-column: 72 */
+/** indent-tabs-mode: nil */
+/** ispell-local-dictionary: "british" */
+/** mode: outline-minor */
+/** outline-regexp: "/[*][*][*]" */
+/** End: */
+/** LocalWords:   */
+/*** rawcov.c ends here */
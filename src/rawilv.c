@@ -4,7 +4,10 @@
 #include "gettext.h"
 #define _(string) gettext (string)
 #define N_(string) gettext_noop (string)
-static const char doc[] = N_("Interleave parts of the files");
+static const char doc[]
+= N_("Interleave parts of the files\v"
+     "The holes of the sparse input files are not read, and where the"
+     " output is all zeros, a hole is left in a regular output file.");
 static const char args_doc[]
 = "[INPUT-FILE]...\n-i INPUT-FILE [OUTPUT-FILE]...";
 
@@ -45,6 +48,7 @@ program_copyright (void)
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "interleave.h"
 #include "p_arg.h"
 #include "usemacro.h"
 #include "useutil.h"
@@ -109,6 +113,295 @@ close_files (FILE **files, size_t count)
   }
 }
 
+/* NB: the number of the whole cycles of the blocks of SIZES ahead of
+   the positions POS of the FILES, all within the holes; DATA_END and
+   HOLE_END are where the data and the holes are known to extend to
+   (the former is -1 for the streams), so that the holes are looked
+   for once per extent */
+static off_t
+hole_cycles (FILE **files, const off_t *sizes, size_t count,
+             const off_t *pos, off_t *data_end, off_t *hole_end)
+{
+  off_t cycles = -1;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    off_t n;
+    if (data_end[i] < 0 || pos[i] < data_end[i]) {
+      /* . */
+      return 0;
+    }
+    if (pos[i] >= hole_end[i]) {
+      off_t end;
+      const int r
+        = sparse_extent (fileno (files[i]), pos[i], sizes[i], &end);
+      if (r != 0) {
+        /* NB: on error, the data is read as usual */
+        data_end[i] = (r > 0) ? end : -1;
+        /* . */
+        return 0;
+      }
+      hole_end[i] = end;
+    }
+    n = (hole_end[i] - pos[i]) / sizes[i];
+    if (cycles < 0 || n < cycles) {
+      cycles = n;
+    }
+  }
+
+  /* . */
+  return MAX (cycles, 0);
+}
+
+static void
+init_positions (FILE **files, size_t count,
+                off_t *pos, off_t *data_end, off_t *hole_end)
+{
+  size_t i;
+  for (i = 0; i < count; i++) {
+    pos[i] = ftello (files[i]);
+    data_end[i] = (pos[i] < 0) ? -1 : 0;
+    hole_end[i] = 0;
+  }
+}
+
+/*** Interleaving by the chunks */
+
+/* NB: the cycles of the blocks up to CHUNK_CYCLE_MAX bytes (in total)
+   are read by the chunks of about CHUNK_SZ bytes, and transposed in
+   memory (see interleave.h); the larger ones are copied a block at a
+   time, which is as fast for them */
+#define CHUNK_SZ (1 << 18)
+#define CHUNK_CYCLE_MAX BUF_SZ
+
+static int
+chunked_p (const off_t *sizes, size_t count)
+{
+  off_t cycle = 0;
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    if ((cycle += sizes[i]) > CHUNK_CYCLE_MAX) {
+      /* . */
+      return 0;
+    }
+  }
+
+  /* . */
+  return 1;
+}
+
+static void
+interleave_chunks (FILE *out, const char *out_name,
+                   FILE **ins, const char **names,
+                   const off_t *sizes, size_t count)
+{
+  size_t szs[count], got[count];
+  size_t cycle, chunk, n = 0, i;
+  int partial_p[count];
+  char *obuf, *ibufs[count];
+  off_t pos[count], data_end[count], hole_end[count], cycles;
+  int eof_p = 0;
+
+  for (i = 0, cycle = 0; i < count; i++) {
+    cycle += (szs[i] = sizes[i]);
+  }
+  chunk = MAX (CHUNK_SZ / cycle, 1);
+  if (MALLOC_ARY (obuf, chunk * cycle) == 0) {
+    error (1, errno, "error allocating output buffers");
+  }
+  for (i = 0; i < count; i++) {
+    if (MALLOC_ARY (ibufs[i], chunk * szs[i]) == 0) {
+      error (1, errno, "error allocating input buffers");
+    }
+  }
+  init_positions (ins, count, pos, data_end, hole_end);
+
+  while (! eof_p) {
+    if ((cycles = hole_cycles (ins, sizes, count,
+                               pos, data_end, hole_end)) > 0) {
+      /* NB: the holes of all the inputs make a hole of the output */
+      if (sparse_write_zeros (out, cycles * cycle) < 0) {
+        error (1, errno, "%s", out_name);
+      }
+      for (i = 0; i < count; i++) {
+        pos[i] += cycles * sizes[i];
+        if (fseeko (ins[i], pos[i], SEEK_SET) != 0) {
+          error (1, errno, "%s", names[i]);
+        }
+      }
+      continue;
+    }
+    for (n = chunk, i = 0; i < count; i++) {
+      const size_t want = chunk * szs[i];
+      const size_t rv = fread (ibufs[i], 1, want, ins[i]);
+      pos[i] += rv;
+      if (rv == want) {
+        /* do nothing */
+      } else if (! feof (ins[i])) {
+        /* reading error */
+        error (1, errno, "%s", names[i]);
+      } else {
+        eof_p = 1;
+      }
+      got[i] = rv / szs[i];
+      partial_p[i] = (rv % szs[i] != 0);
+      n = MIN (n, got[i]);
+    }
+    if (n > 0) {
+      ilv_interleave (obuf, (const void *const *)ibufs,
+                      count, szs, n);
+      if (fwrite (obuf, 1, n * cycle, out) != n * cycle) {
+        error (1, errno, "%s", out_name);
+      }
+    }
+    /* NB: an input ending in the middle of the block of the incomplete
+       cycle is reported once the whole cycles, and the whole blocks of
+       the inputs before it, are written, as the block at a time code
+       does */
+    for (i = 0; i < count && ! (partial_p[i] && got[i] == n); i++) {
+      /* do nothing */
+    }
+    if (i < count) {
+      const size_t broken = i;
+      for (i = 0; i < broken; i++) {
+        if (got[i] > n
+            && (fwrite (ibufs[i] + n * szs[i], 1, szs[i], out)
+                != szs[i])) {
+          error (1, errno, "%s", out_name);
+        }
+      }
+      if (sparse_finish (out) < 0) {
+        error (1, errno, "%s", out_name);
+      }
+      error (1, 0, _("%s: EOF in the middle of the block"),
+             names[broken]);
+    }
+  }
+
+  /* NB: the inputs ahead of the shortest one have their blocks of the
+     incomplete cycle written out, and are reported as not at EOF */
+  {
+    size_t neofs = 0;
+    const char *last = 0;
+    for (i = 0; i < count; i++) {
+      if (got[i] <= n) {
+        last = names[i];
+        continue;
+      }
+      if (fwrite (ibufs[i] + n * szs[i], 1, szs[i], out) != szs[i]) {
+        error (1, errno, "%s", out_name);
+      }
+      error (0, 0, _("Warning: `%s' is not at EOF"), names[i]);
+      neofs++;
+    }
+    if (sparse_finish (out) < 0) {
+      error (1, errno, "%s", out_name);
+    }
+    if (neofs == 1) {
+      assert (last != 0);
+      error (0, 0, _("Warning: `%s' ended prematurely"), last);
+    }
+    if (neofs) {
+      close_files (ins, count);
+      error (1, 0, _("premature EOF in some of the inputs"));
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    free (ibufs[i]);
+  }
+  free (obuf);
+}
+
+static void
+deinterleave_chunks (FILE *in, const char *in_name,
+                     FILE **outs, const char **names,
+                     const off_t *sizes, size_t count)
+{
+  size_t szs[count];
+  size_t cycle, chunk, i;
+  char *ibuf, *obufs[count];
+  off_t in_pos, in_data_end, in_hole_end, in_cycle, cycles;
+  int eof_p = 0, broken_p = 0;
+
+  for (i = 0, cycle = 0; i < count; i++) {
+    cycle += (szs[i] = sizes[i]);
+  }
+  in_cycle = cycle;
+  chunk = MAX (CHUNK_SZ / cycle, 1);
+  if (MALLOC_ARY (ibuf, chunk * cycle) == 0) {
+    error (1, errno, "error allocating input buffers");
+  }
+  for (i = 0; i < count; i++) {
+    if (MALLOC_ARY (obufs[i], chunk * szs[i]) == 0) {
+      error (1, errno, "error allocating output buffers");
+    }
+  }
+  init_positions (&in, 1, &in_pos, &in_data_end, &in_hole_end);
+
+  while (! eof_p) {
+    size_t rv, n, rest;
+    if ((cycles = hole_cycles (&in, &in_cycle, 1, &in_pos,
+                               &in_data_end, &in_hole_end))
+        > 0) {
+      /* NB: a hole of the input makes the holes of the outputs */
+      for (i = 0; i < count; i++) {
+        if (sparse_write_zeros (outs[i], cycles * sizes[i]) < 0) {
+          error (1, errno, "%s", names[i]);
+        }
+      }
+      in_pos += cycles * in_cycle;
+      if (fseeko (in, in_pos, SEEK_SET) != 0) {
+        error (1, errno, "%s", in_name);
+      }
+      continue;
+    }
+    rv = fread (ibuf, 1, chunk * cycle, in);
+    in_pos += rv;
+    if (rv == chunk * cycle) {
+      /* do nothing */
+    } else if (! feof (in)) {
+      /* reading error */
+      error (1, errno, "%s", in_name);
+    } else {
+      eof_p = 1;
+    }
+    n = rv / cycle;
+    if (n > 0) {
+      ilv_deinterleave ((void *const *)obufs, ibuf, count, szs, n);
+      for (i = 0; i < count; i++) {
+        if (fwrite (obufs[i], 1, n * szs[i], outs[i])
+            != n * szs[i]) {
+          error (1, errno, "%s", names[i]);
+        }
+      }
+    }
+    /* NB: the whole blocks of an incomplete cycle go to their files,
+       as the block at a time code does */
+    for (i = 0, rest = rv % cycle; rest >= szs[i]; rest -= szs[i++]) {
+      if (fwrite (ibuf + n * cycle + (rv % cycle - rest), 1, szs[i],
+                  outs[i])
+          != szs[i]) {
+        error (1, errno, "%s", names[i]);
+      }
+    }
+    broken_p = (rest > 0);
+  }
+
+  for (i = 0; i < count; i++) {
+    if (sparse_finish (outs[i]) < 0) {
+      error (1, errno, "%s", names[i]);
+    }
+    free (obufs[i]);
+  }
+  free (ibuf);
+  /* NB: reported once the data read is written */
+  if (broken_p) {
+    error (1, 0, _("%s: EOF in the middle of the block"), in_name);
+  }
+}
+
 /*** Parsing the Command Line */
 
 const char *
@@ -338,18 +631,32 @@ main (int argc, char **argv)
     }
 
     /* process the data */
-    if (interleave_p) {
+    assert (args.block_sizes_size == noas_count);
+    if (chunked_p (args.block_sizes, noas_count)) {
+      if (interleave_p) {
+        interleave_chunks (the_file, args.output_file, noas, names->s,
+                           args.block_sizes, noas_count);
+      } else {
+        deinterleave_chunks (the_file, args.input_file, noas,
+                             names->s, args.block_sizes, noas_count);
+      }
+    } else if (interleave_p) {
       const off_t *sizes = args.block_sizes;
       char buf[BUF_SZ];
       char *bp;
       int done_p, eof_p;
-      size_t rest_files;
-      off_t rest_bytes;
+      size_t rest_files, i;
+      off_t rest_bytes, cycle, cycles;
+      off_t pos[noas_count], data_end[noas_count], hole_end[noas_count];
       FILE **fp;
       const off_t *sp;
       const char **np;
 
       assert (args.block_sizes_size == noas_count);
+      for (i = 0, cycle = 0; i < noas_count; i++) {
+        cycle += sizes[i];
+      }
+      init_positions (noas, noas_count, pos, data_end, hole_end);
 
       for (done_p = eof_p = 0,
              bp = buf,
@@ -369,6 +676,28 @@ main (int argc, char **argv)
           fp = noas,  rest_files = noas_count;
           sp = sizes, rest_bytes = *sp;
         }
+        if (fp == noas && rest_bytes == *sizes
+            && (cycles = hole_cycles (noas, sizes, noas_count,
+                                      pos, data_end, hole_end)) > 0) {
+          /* NB: the holes of all the inputs make a hole of the
+             output */
+          if (bp > buf
+              && (fwrite (buf, 1, (bp - buf), the_file)
+                  != (size_t)(bp - buf))) {
+            error (1, errno, "%s", args.output_file);
+          }
+          bp = buf;
+          if (sparse_write_zeros (the_file, cycles * cycle) < 0) {
+            error (1, errno, "%s", args.output_file);
+          }
+          for (i = 0; i < noas_count; i++) {
+            pos[i] += cycles * sizes[i];
+            if (fseeko (noas[i], pos[i], SEEK_SET) != 0) {
+              error (1, errno, "%s", names->s[i]);
+            }
+          }
+          continue;
+        }
         {
           size_t rv;
           const size_t buf_size = bp - buf;
@@ -376,6 +705,7 @@ main (int argc, char **argv)
 
           assert (to_read > 0);
           if ((rv = fread (bp, 1, to_read, *fp),
+               pos[fp - noas] += rv,
                bp += rv, rest_bytes -= rv, rv)
               == to_read) {
             /* do nothing */
@@ -390,7 +720,7 @@ main (int argc, char **argv)
             rest_bytes = 0;
             continue;
           }
-          if (bp - buf < sizeof (buf)) {
+          if ((size_t)(bp - buf) < sizeof (buf)) {
             /* do nothing */
           } else if ((fwrite (buf, 1, sizeof (buf), the_file))
                      != sizeof (buf)) {
@@ -404,7 +734,10 @@ main (int argc, char **argv)
       if (bp <= buf) {
         /* do nothing */
       } else if ((fwrite (buf, 1, (bp - buf), the_file))
-                 != (bp - buf)) {
+                 != (size_t)(bp - buf)) {
+        error (1, errno, "%s", args.output_file);
+      }
+      if (sparse_finish (the_file) < 0) {
         error (1, errno, "%s", args.output_file);
       }
 
@@ -441,13 +774,18 @@ main (int argc, char **argv)
       char *bps[noas_count];
       char **bp0, **bp;
       int eof_p;
-      size_t rest_files;
-      off_t rest_bytes;
+      size_t rest_files, i;
+      off_t rest_bytes, cycle, cycles;
+      off_t in_pos, in_data_end, in_hole_end;
       FILE **fp;
       const off_t *sp;
       const char **np;
 
       assert (args.block_sizes_size == noas_count);
+      for (i = 0, cycle = 0; i < noas_count; i++) {
+        cycle += sizes[i];
+      }
+      init_positions (&the_file, 1, &in_pos, &in_data_end, &in_hole_end);
 
       /* initialize buffer pointers */
       for (rest_files = noas_count, bp = bps, bp0 = bufs;
@@ -475,6 +813,27 @@ main (int argc, char **argv)
           fp = noas,  rest_files = noas_count;
           sp = sizes, rest_bytes = *sp;
         }
+        if (fp == noas && rest_bytes == *sizes
+            && (cycles = hole_cycles (&the_file, &cycle, 1, &in_pos,
+                                      &in_data_end, &in_hole_end))
+            > 0) {
+          /* NB: a hole of the input makes the holes of the outputs */
+          for (i = 0; i < noas_count; i++) {
+            const size_t n = bps[i] - bufs[i];
+            if (n > 0 && fwrite (bufs[i], 1, n, noas[i]) != n) {
+              error (1, errno, "%s", names->s[i]);
+            }
+            bps[i] = bufs[i];
+            if (sparse_write_zeros (noas[i], cycles * sizes[i]) < 0) {
+              error (1, errno, "%s", names->s[i]);
+            }
+          }
+          in_pos += cycles * cycle;
+          if (fseeko (the_file, in_pos, SEEK_SET) != 0) {
+            error (1, errno, "%s", args.input_file);
+          }
+          continue;
+        }
         {
           const char *input_file = args.input_file;
           size_t rv;
@@ -483,6 +842,7 @@ main (int argc, char **argv)
 
           assert (to_read > 0);
           if ((rv = fread (*bp, 1, to_read, the_file),
+               in_pos += rv,
                *bp += rv, rest_bytes -= rv, rv)
               == to_read) {
             /* do nothing */
@@ -500,7 +860,7 @@ main (int argc, char **argv)
             eof_p = 1;
             continue;
           }
-          if (*bp - *bp0 < buf_alloc) {
+          if ((size_t)(*bp - *bp0) < buf_alloc) {
             /* do nothing */
           } else if ((fwrite (*bp0, 1, buf_alloc, *fp))
                      != buf_alloc) {
@@ -519,7 +879,10 @@ main (int argc, char **argv)
         if (*bp <= *bp0) {
           /* do nothing */
         } else if ((fwrite (*bp0, 1, (*bp - *bp0), *fp))
-                   != (*bp - *bp0)) {
+                   != (size_t)(*bp - *bp0)) {
+          error (1, errno, "%s", *np);
+        }
+        if (sparse_finish (*fp) < 0) {
           error (1, errno, "%s", *np);
         }
       }
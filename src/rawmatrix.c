@@ -7,7 +7,9 @@
 static const char doc[] = N_("Multiply input vectors by a matrix");
 static const char args_doc[]
 = N_("MATRIX [FILE]...\n"
-     "-m MATRIX [FILE]...");
+     "-m MATRIX [FILE]...\n"
+     "--matrix-file MATRIX-FILE [FILE]...\n"
+     "--planar -m MATRIX FILE...");
 
 /*** Copyright (C) 2007 Ivan Shmakov */
 
@@ -42,12 +44,22 @@ program_copyright (void)
 #include <argp.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
+#include <float.h>              /* for FLT_EPSILON */
 #include <locale.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>             /* for memset () */
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "numfix.h"
+#include "numfmt.h"
+#include "nummat.h"
+#include "numrec.h"
 #include "p_arg.h"
 #include "parselts.h"
 #include "usemacro.h"
@@ -55,18 +67,13 @@ program_copyright (void)
 
 /*** Handling formats */
 
-enum raw_format {
-  FORMAT_DOUBLE = 0,
-  FORMAT_FLOAT
-};
-
 static int
-all_double_p (size_t size, const enum raw_format *array)
+all_double_p (size_t size, const struct numfmt *array)
 {
   size_t rest;
-  const enum raw_format *p;
+  const struct numfmt *p;
   for (rest = size, p = array; rest > 0; rest--, p++) {
-    if (*p != 0) {
+    if (! numfmt_plain_double_p (p)) {
       /* . */
       return 0;
     }
@@ -76,198 +83,930 @@ all_double_p (size_t size, const enum raw_format *array)
   return 1;
 }
 
+/* NB: the type of the elements, if they're all of the same plain
+   (neither packed, nor with the fill value) type, or -1 */
 static int
-fread_doubles (double *buf, size_t count, FILE *fp)
+uniform_type (size_t size, const struct numfmt *array)
 {
-  size_t read;
-  if ((read = fread (buf, sizeof (*buf), count, fp)) < count) {
+  size_t i;
+  for (i = 0; i < size; i++) {
+    if (array[i].packed_p || array[i].fill_p
+        || array[i].type != array[0].type) {
+      /* . */
+      return -1;
+    }
+  }
+
+  /* . */
+  return (size > 0 ? (int)array[0].type : -1);
+}
+
+/*** Vectors and matrices */
+
+struct sim_matrix {
+  size_t alloc;
+  size_t rows, columns;
+  /* NB: values[ROW * columns + COLUMN] */
+  double *values;
+};
+
+static int
+load_matrix_csv (struct sim_matrix *m, const char *s)
+{
+  const int delim = ',';
+  struct parse_elt_number_param param = { 0, 0 };
+  size_t elts;
+  char *tail;
+
+  m->alloc = 0;
+  m->values = 0;
+  elts = 0;
+
+  parse_elts_delim (s, (void *)&(m->values), sizeof (*(m->values)),
+                    &(m->alloc), &elts, delim, &tail,
+                    parse_elt_double, (const void *)&param);
+  if (tail == s || *tail != '\0') {
+    errno = EINVAL;
     /* . */
-    return (read == 0 && feof (fp)) ? 0 : -1;
+    return -1;
   }
-  return 1;
+  assert (elts != 0);
+
+  /* NB: assuming it's a row, temporarily */
+  m->columns = elts;
+  m->rows    = 1;
+
+  /* . */
+  return 0;
 }
 
+/* NB: parse the list, up to the delimiter given */
 static int
-fwrite_doubles (const double *buf, size_t count, FILE *fp)
+parse_list (const char **s, void *buf, size_t elt_sz, size_t *count,
+            parse_elt_fn parse_elt, void *param, int end)
 {
-  size_t wrtn;
-  if ((wrtn = fwrite (buf, sizeof (*buf), count, fp)) < count) {
+  size_t alloc = 0;
+  char *tail;
+
+  *count = 0;
+  if (parse_elts_delim (*s, buf, elt_sz, &alloc, count, ',', &tail,
+                        parse_elt, param)
+      < 0) {
     /* . */
     return -1;
   }
-  return 1;
+  if (tail == *s || *tail != end) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  *s = tail + 1;
+
+  /* . */
+  return 0;
 }
 
+/* NB: the matrix is given in the sparse (CSR) form, as the lists of
+   the row pointers (one more than there are rows), of the columns of
+   the nonzeros, and of their values, separated by colons; COLUMNS is
+   the number of the columns, or 0 to take one more than the largest
+   column given.  The matrix is then kept in full, as usual (and its
+   sparse form made of it later) */
 static int
-fread_doubles_fmt (double *buf, size_t count,
-                   const enum raw_format *fmts,
-                   FILE *inp)
+load_matrix_csr (struct sim_matrix *m, const char *s, size_t columns,
+                 int trailing_1_p)
 {
-  size_t rest;
-  double *bp;
-  const enum raw_format *fp;
-  for (rest = count, bp = buf, fp = fmts;
-       rest > 0;
-       rest--, bp++, fp++) {
-    float bf;
-    void  *p1 = (*fp == FORMAT_DOUBLE ? (void *)bp : (void *)&bf);
-    size_t s1 = (*fp == FORMAT_DOUBLE
-                 ? sizeof (double) : sizeof (float));
-    size_t read;
-    if ((read = fread (p1, s1, 1, inp)) != 1) {
-      /* . */
-      return (bp == buf && read == 0 && feof (inp)) ? 0 : -1;
+  struct parse_elt_integer_param i_param = { { 0, 0 }, 10 };
+  struct parse_elt_number_param param = { 0, 0 };
+  unsigned long *ptrs = 0, *cols = 0;
+  double *values = 0;
+  size_t ptrs_n, cols_n, values_n, r, k;
+  int valid_p;
+
+  m->alloc = 0;
+  m->values = 0;
+  m->rows = m->columns = 0;
+  if (parse_list (&s, (void *)&ptrs, sizeof (*ptrs), &ptrs_n,
+                  (parse_elt_fn)parse_elt_ulong, &i_param, ':') < 0
+      || parse_list (&s, (void *)&cols, sizeof (*cols), &cols_n,
+                     (parse_elt_fn)parse_elt_ulong, &i_param, ':') < 0
+      || parse_list (&s, (void *)&values, sizeof (*values), &values_n,
+                     (parse_elt_fn)parse_elt_double, &param, '\0')
+      < 0) {
+    free (ptrs);
+    free (cols);
+    free (values);
+    /* . */
+    return -1;
+  }
+
+  /* NB: the row pointers should be non-decreasing, from 0 to the
+     number of the nonzeros, and the columns within the matrix */
+  valid_p = (ptrs_n >= 2 && ptrs[0] == 0
+             && ptrs[ptrs_n - 1] == cols_n && cols_n == values_n);
+  for (r = 1; valid_p && r < ptrs_n; r++) {
+    valid_p = (ptrs[r] >= ptrs[r - 1]);
+  }
+  for (k = 0; valid_p && k < cols_n; k++) {
+    if (columns == 0) {
+      m->columns = MAX (m->columns, cols[k] + 1);
+    } else {
+      valid_p = (cols[k] < columns);
     }
-    if (bp != p1) {
-      *bp = bf;
+  }
+  m->rows    = ptrs_n - 1;
+  m->columns = (columns > 0 ? columns : m->columns);
+  if (m->columns < (trailing_1_p ? 2 : 1)) {
+    valid_p = 0;
+  }
+  if (! valid_p) {
+    errno = EINVAL;
+  } else if ((m->values = calloc (m->rows * m->columns,
+                                  sizeof (*(m->values))))
+             == 0) {
+    valid_p = 0;
+  } else {
+    m->alloc = m->rows * m->columns;
+    for (r = 0; r < m->rows; r++) {
+      for (k = ptrs[r]; k < ptrs[r + 1]; k++) {
+        m->values[r * m->columns + cols[k]] += values[k];
+      }
     }
   }
-  return 1;
+  free (ptrs);
+  free (cols);
+  free (values);
+
+  /* . */
+  return valid_p ? 0 : -1;
+}
+
+/** Matrix files */
+
+/* NB: the text is read as a whole, and is NUL-terminated */
+static char *
+read_text (int fd, size_t *size)
+{
+  size_t alloc = BUFSIZ, got = 0;
+  char *buf = 0;
+  for (;;) {
+    ssize_t n;
+    if (got + 1 >= alloc || buf == 0) {
+      char *p;
+      if ((p = realloc (buf, alloc *= 2)) == 0) {
+        free (buf);
+        /* . */
+        return 0;
+      }
+      buf = p;
+    }
+    if ((n = read (fd, buf + got, alloc - got - 1)) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      free (buf);
+      /* . */
+      return 0;
+    } else if (n == 0) {
+      break;
+    }
+    got += n;
+  }
+  buf[got] = '\0';
+  *size = got;
+
+  /* . */
+  return buf;
 }
 
+/* NB: the numbers are separated by the blanks or commas, one row per
+   line, with the comments from `#' to the end of the line; the lines
+   with no numbers are skipped.  A single line is taken as a row, as
+   with -m; otherwise, the rows should be of the same length */
 static int
-fwrite_doubles_fmt (const double *buf, size_t count,
-                    const enum raw_format *fmts,
-                    FILE *outp)
+parse_matrix_text (struct sim_matrix *m, const char *text)
 {
-  size_t rest;
-  const double *bp;
-  const enum raw_format *fp;
-  for (rest = count, bp = buf, fp = fmts;
-       rest > 0;
-       rest--, bp++, fp++) {
-    float bf;
-    void  *p1 = (*fp == FORMAT_DOUBLE ? (void *)bp : (void *)&bf);
-    size_t s1 = (*fp == FORMAT_DOUBLE
-                 ? sizeof (double) : sizeof (float));
-    size_t wrtn;
-    if (bp != p1) {
-      bf = *bp;
-    }
-    if ((wrtn = fwrite (p1, s1, 1, outp)) != 1) {
+  const char *p = text;
+  size_t elts = 0, rows = 0, row = 0;
+
+  m->columns = 0;
+  while (*p != '\0') {
+    char *tail;
+    double v;
+    if (*p == '\n' || *p == '#') {
+      if (*p == '#') {
+        p += strcspn (p, "\n");
+        continue;
+      }
+      if (row > 0) {
+        if (rows > 0 && row != m->columns) {
+          errno = EINVAL;
+          /* . */
+          return -1;
+        }
+        m->columns = row;
+        rows++;
+      }
+      row = 0;
+      p++;
+      continue;
+    }
+    if (*p == ',' || *p == ' ' || *p == '\t' || *p == '\r') {
+      p++;
+      continue;
+    }
+    v = strtod (p, &tail);
+    if (tail == p) {
+      errno = EINVAL;
       /* . */
       return -1;
     }
+    if (elts >= m->alloc) {
+      double *vp;
+      const size_t alloc = MAX (2 * m->alloc, 64);
+      if ((vp = realloc (m->values, alloc * sizeof (*vp))) == 0) {
+        /* . */
+        return -1;
+      }
+      m->values = vp;
+      m->alloc  = alloc;
+    }
+    m->values[elts++] = v;
+    row++;
+    p = tail;
   }
-  return 1;
+  if (row > 0) {
+    if (rows > 0 && row != m->columns) {
+      errno = EINVAL;
+      /* . */
+      return -1;
+    }
+    m->columns = row;
+    rows++;
+  }
+  if (rows < 1) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  /* NB: a single line is a row, as with -m, until the shape is known */
+  m->rows    = rows;
+  m->columns = (rows > 1 ? m->columns : elts);
+
+  /* . */
+  return 0;
 }
 
-/*** Vectors and matrices */
+/* NB: the matrix is loaded from the file, either as text (if FMT is
+   0), or as the raw data in the format given, stored by the rows,
+   which is mapped and converted as a whole; the shape of the latter
+   is then found the same as for -m */
+static int
+load_matrix_file (struct sim_matrix *m, const char *name,
+                  const struct numfmt *fmt)
+{
+  const int fd = (strcmp (name, "-") == 0
+                  ? STDIN_FILENO : open (name, O_RDONLY));
+  struct stat st;
+  void *map = MAP_FAILED;
+  char *text = 0;
+  size_t size = 0;
+  int rv = 0;
 
-struct sim_matrix {
-  size_t alloc;
-  size_t rows, columns;
-  /* NB: values[ROW * columns + COLUMN] */
+  m->alloc = 0;
+  m->values = 0;
+  m->rows = m->columns = 0;
+  if (fd < 0 || fstat (fd, &st) != 0) {
+    /* . */
+    return -1;
+  }
+  /* NB: the regular files are mapped, and the rest are read */
+  if (fmt != 0 && S_ISREG (st.st_mode) && st.st_size > 0) {
+    size = st.st_size;
+    map = mmap (0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (map == MAP_FAILED && (text = read_text (fd, &size)) == 0) {
+    rv = -1;
+  } else if (fmt == 0) {
+    rv = parse_matrix_text (m, text);
+  } else {
+    const char *raw = (map != MAP_FAILED ? map : text);
+    const size_t esz = numfmt_size (fmt), elts = size / esz;
+    if (elts < 1 || size % esz != 0) {
+      errno = EINVAL;
+      rv = -1;
+    } else if (posix_memalign ((void **)&(m->values), 64,
+                               elts * sizeof (*(m->values)))
+               != 0) {
+      m->values = 0;
+      errno = ENOMEM;
+      rv = -1;
+    } else {
+      m->alloc   = elts;
+      m->rows    = 1;
+      m->columns = elts;
+      numfmt_to_doubles (m->values, raw, elts, fmt);
+    }
+  }
+  {
+    const int e = errno;
+    if (map != MAP_FAILED) {
+      munmap (map, size);
+    }
+    free (text);
+    if (fd != STDIN_FILENO) {
+      close (fd);
+    }
+    errno = e;
+  }
+
+  /* . */
+  return rv;
+}
+
+/* NB: NEXT is applied after M, and the product replaces M; with
+   TRAILING_1_P, both are affine, the last column being the offset,
+   and so is the product */
+static int
+compose_matrix (struct sim_matrix *m, const struct sim_matrix *next,
+                int trailing_1_p)
+{
+  const size_t
+    rows = next->rows, inner = m->rows, columns = m->columns;
   double *values;
+  size_t r, c, k;
+
+  assert (next->columns == inner + (trailing_1_p ? 1 : 0));
+  if (MALLOC_ARY (values, rows * columns) == 0) {
+    /* . */
+    return -1;
+  }
+  for (r = 0; r < rows; r++) {
+    const double *np = next->values + r * next->columns;
+    for (c = 0; c < columns; c++) {
+      double sum = 0;
+      for (k = 0; k < inner; k++) {
+        sum += np[k] * m->values[k * columns + c];
+      }
+      if (trailing_1_p && c + 1 == columns) {
+        sum += np[inner];
+      }
+      values[r * columns + c] = sum;
+    }
+  }
+  free (m->values);
+  m->values = values;
+  m->alloc  = rows * columns;
+  m->rows   = rows;
+
+  /* . */
+  return 0;
+}
+
+/*** Applying matrix to a stream */
+
+/* NB: the vectors are read, multiplied, and written by the blocks of
+   up to this many, or fewer, so that the block is within ~ 8 MiB */
+#define BLOCK_VECTORS  4096
+#define BLOCK_ELEMENTS (1 << 20)
+
+/* NB: the input is either a single stream of the vectors, or one
+   stream per element (planar), and so is the output */
+struct streams {
+  FILE **in, **out;
+  const char **in_names, **out_names;
+  size_t in_count, out_count;
+};
+
+/* NB: what's to be done to the blocks */
+struct mapping {
+  const struct sim_matrix *matrix;
+  const struct numfmt *in_fmts, *out_fmts;
+  struct nrec in_rec, out_rec;
+  enum nconv_rounding rounding;
+  int trailing_1_p;
+  /* NB: the last column is the bias if TRAILING_1_P */
+  size_t in_sz, out_sz, block;
+  /* NB: the planar data is kept in the raw buffers of the blocks as
+     the planes of BLOCK elements, one after another */
+  int planar_in_p, planar_out_p;
+  int i_direct, o_direct;
+  size_t i_rec, o_rec;
+  /* NB: the sparse form of the matrix, if it pays off; the elements
+     selected by a selection matrix are copied as they are, if their
+     formats are the same */
+  struct nmat_sparse sparse;
+  int sparse_p, copy_p;
+  /* NB: the fixed-point form of the matrix, for the integer data */
+  struct nfix fix;
+  int fix_p;
+  /* NB: the single precision copy of the matrix; the float data is
+     used as it is, the rest is converted via double */
+  float *mf;
+  int float_p, compensated_p, i_float, o_float;
 };
 
-static double
-scalar_product (size_t size, const double *a, const double *b)
+/* NB: what the products are computed in */
+enum compute {
+  COMPUTE_DOUBLE = 0,
+  COMPUTE_FIXED,
+  COMPUTE_FLOAT
+};
+static const char *compute_names[] = {
+  "double", "fixed", "float", 0
+};
+
+/* NB: whether the elements read in these formats are always finite,
+   as are the integers without a fill value */
+static int
+finite_fmts_p (const struct numfmt *fmts, size_t count)
 {
-  /* FIXME: qsort () an intermediate array for a better precision? */
-  size_t rest;
-  double acc;
-  const double *ap, *bp;
-  for (rest = size, acc = 0, ap = a, bp = b;
-       rest > 0;
-       rest--, acc += *(ap++) * *(bp++))
-    ;
+  size_t j;
+
+  for (j = 0; j < count; j++) {
+    if (! numfmt_integer_p (fmts + j) || fmts[j].fill_p) {
+      /* . */
+      return 0;
+    }
+  }
+
   /* . */
-  return acc;
+  return 1;
 }
 
 static void
-matrix_by_vector (double *result,
-                  const struct sim_matrix *matrix,
-                  const double *vector)
+mapping_init (struct mapping *mp, const struct sim_matrix *matrix,
+              const struct numfmt *in_fmts,
+              const struct numfmt *out_fmts,
+              enum nconv_rounding rounding,
+              int trailing_1_p, enum compute compute,
+              int compensated_p, const struct streams *st)
 {
-  size_t vector_sz = matrix->columns;
-  size_t rest;
-  double *rp;
-  const double *vp;
-  for (rest = matrix->rows, rp = result, vp = matrix->values;
-       rest > 0;
-       rest--, rp++, vp += vector_sz) {
-    *rp = scalar_product (vector_sz, vp, vector);
+  int finite_p;
+
+  mp->matrix       = matrix;
+  mp->in_fmts      = in_fmts;
+  mp->out_fmts     = out_fmts;
+  mp->rounding     = rounding;
+  mp->trailing_1_p = trailing_1_p;
+  mp->in_sz    = matrix->columns + (trailing_1_p ? -1 : 0);
+  mp->out_sz   = matrix->rows;
+  mp->block    = BOUND (BLOCK_ELEMENTS / MAX (mp->in_sz, mp->out_sz),
+                        1, BLOCK_VECTORS);
+  mp->planar_in_p  = (st->in_count  > 1);
+  mp->planar_out_p = (st->out_count > 1);
+  if (nrec_init (&(mp->in_rec),  in_fmts,  mp->in_sz)  < 0
+      || nrec_init (&(mp->out_rec), out_fmts, mp->out_sz) < 0) {
+    error (1, errno, _("allocating the record codecs"));
   }
+  finite_p = finite_fmts_p (in_fmts, mp->in_sz);
+  if ((mp->sparse_p
+       = nmat_sparse_init (&(mp->sparse), matrix->values,
+                           mp->out_sz, mp->in_sz, trailing_1_p,
+                           finite_p))
+      < 0) {
+    error (1, errno, _("allocating the matrix"));
+  }
+  /* NB: a NaN read spreads to the whole vector, as with the dense
+     product, so that the bands may only be copied if there are none */
+  mp->copy_p = (mp->sparse_p && mp->sparse.select_p && finite_p
+                && nrec_select_p (&(mp->out_rec), &(mp->in_rec),
+                                  mp->sparse.cols));
+  /* NB: the formats are checked while parsing the command line */
+  mp->fix_p = (compute == COMPUTE_FIXED && ! mp->copy_p);
+  if (mp->fix_p
+      && nfix_init (&(mp->fix), matrix->values,
+                    mp->out_sz, mp->in_sz, trailing_1_p,
+                    in_fmts[0].type, out_fmts[0].type, rounding)
+      < 0) {
+    if (errno == EDOM) {
+      error (1, 0, _("the matrix is too large for the fixed point"));
+    }
+    error (1, errno, _("allocating the matrix"));
+  }
+  /* NB: the sparse form is cheaper still */
+  mp->mf = 0;
+  mp->float_p = (compute == COMPUTE_FLOAT && ! mp->sparse_p);
+  mp->compensated_p = compensated_p;
+  mp->i_float = (mp->float_p && ! mp->planar_in_p
+                 && uniform_type (mp->in_sz,  in_fmts)  == NUMFMT_FLOAT);
+  mp->o_float = (mp->float_p && ! mp->planar_out_p
+                 && uniform_type (mp->out_sz, out_fmts) == NUMFMT_FLOAT);
+  if (mp->float_p) {
+    const size_t elts = matrix->rows * matrix->columns;
+    size_t i;
+    if (posix_memalign ((void **)&(mp->mf), 64,
+                        elts * sizeof (*(mp->mf)))
+        != 0) {
+      error (1, errno, _("allocating the matrix"));
+    }
+    for (i = 0; i < elts; i++) {
+      mp->mf[i] = matrix->values[i];
+    }
+  }
+  /* NB: the raw buffers are always used for copying */
+  mp->i_direct = (! mp->planar_in_p && ! mp->copy_p
+                  && all_double_p  (mp->in_sz,  in_fmts));
+  mp->o_direct = (! mp->planar_out_p && ! mp->copy_p
+                  && all_double_p (mp->out_sz, out_fmts));
+  mp->i_rec    = mp->in_rec.size;
+  mp->o_rec    = mp->out_rec.size;
 }
 
+/* NB: the buffers of the blocks are aligned to the cache lines, for
+   the bulk reads and writes, and the SIMD kernels */
+#define ALIGNED_ARY(x, y) \
+    (posix_memalign ((void **)&(x), 64, (y) * sizeof (*(x))) == 0 \
+     ? (x) : ((x) = 0))
+
+struct block {
+  double *i_buf, *o_buf;
+  float *i_flt, *o_flt;
+  char *i_raw, *o_raw;
+  /* the number of vectors read */
+  size_t n;
+  /* NB: used by the workers only */
+  int done_p;
+};
+
 static int
-load_matrix_csv (struct sim_matrix *m, const char *s,
-                 int trailing_1_p)
+block_init (struct block *b, const struct mapping *mp)
 {
-  const int delim = ',';
-  struct parse_elt_number_param param = { 0, 0 };
-  size_t elts;
-  char *tail;
-  size_t root;
+  const int double_p = (! mp->copy_p && ! mp->fix_p);
+  b->i_buf = b->o_buf = 0;
+  b->i_flt = b->o_flt = 0;
+  b->i_raw = b->o_raw = 0;
+  b->n = 0;
+  if ((double_p && ! mp->i_float
+       && ALIGNED_ARY (b->i_buf, mp->block * mp->in_sz) == 0)
+      || (double_p && ! mp->o_float
+          && ALIGNED_ARY (b->o_buf, mp->block * mp->out_sz) == 0)
+      || (mp->float_p && ! mp->i_float
+          && ALIGNED_ARY (b->i_flt, mp->block * mp->in_sz) == 0)
+      || (mp->float_p && ! mp->o_float
+          && ALIGNED_ARY (b->o_flt, mp->block * mp->out_sz) == 0)
+      || (! mp->i_direct
+          && ALIGNED_ARY (b->i_raw, mp->block * mp->i_rec) == 0)
+      || (! mp->o_direct
+          && ALIGNED_ARY (b->o_raw, mp->block * mp->o_rec) == 0)) {
+    /* . */
+    return -1;
+  }
 
-  m->alloc = 0;
-  m->values = 0;
-  elts = 0;
+  /* . */
+  return 0;
+}
 
-  parse_elts_delim (s, (void *)&(m->values), sizeof (*(m->values)),
-                    &(m->alloc), &elts, delim, &tail,
-                    parse_elt_double, (const void *)&param);
-  if (tail == s || *tail != '\0') {
-    errno = EINVAL;
+static void
+block_free (struct block *b)
+{
+  free (b->i_buf);
+  free (b->o_buf);
+  free (b->i_flt);
+  free (b->o_flt);
+  free (b->i_raw);
+  free (b->o_raw);
+}
+
+/* NB: the lengths of the planes should match; the errors are fatal */
+static int
+block_read_planar (struct block *b, const struct mapping *mp,
+                   const struct streams *st)
+{
+  size_t j, offset, n = 0;
+  int more_p = 1;
+
+  for (j = 0, offset = 0; j < mp->in_sz; j++) {
+    const size_t
+      esz  = numfmt_size (mp->in_fmts + j),
+      want = mp->block * esz;
+    FILE *in = st->in[j];
+    size_t read;
+    read = fread (b->i_raw + mp->block * offset, 1, want, in);
+    if (read < want && ! feof (in)) {
+      error (1, errno, "%s", st->in_names[j]);
+    }
+    if (read % esz != 0) {
+      error (1, 0, _("%s: EOF in the middle of the element"),
+             st->in_names[j]);
+    }
+    if (j > 0 && read / esz != n) {
+      error (1, 0, _("premature EOF in some of the inputs"));
+    }
+    n = read / esz;
+    more_p = (read == want);
+    offset += esz;
+  }
+  b->n = n;
+
+  /* . */
+  return more_p;
+}
+
+/* NB: return 1 if there may be more to read, 0 at the end, -1 on
+   error, and READ_PARTIAL if there's a partial vector at the end; the
+   whole vectors before it are in the block all the same */
+#define READ_PARTIAL (-2)
+static int
+block_read (struct block *b, const struct mapping *mp,
+            const struct streams *st)
+{
+  const size_t want = mp->block * mp->i_rec;
+  FILE *in = st->in[0];
+  size_t read;
+  if (mp->planar_in_p) {
     /* . */
-    return -1;
+    return block_read_planar (b, mp, st);
+  }
+  read = fread (mp->i_direct ? (char *)b->i_buf : b->i_raw, 1,
+                want, in);
+  b->n = read / mp->i_rec;
+  if (read < want) {
+    /* . */
+    return (! feof (in) ? -1
+            : read % mp->i_rec != 0 ? READ_PARTIAL : 0);
   }
-  assert (elts != 0);
 
-  /* NB: assuming it's a row, temporarily */
-  m->columns = elts;
-  m->rows    = 1;
+  /* . */
+  return 1;
+}
+
+/* NB: the vectors not in float are converted from (and to) double */
+static void
+block_compute_float (struct block *b, const struct mapping *mp)
+{
+  const size_t i_elts = b->n * mp->in_sz, o_elts = b->n * mp->out_sz;
+  const float *x = mp->i_float ? (const float *)b->i_raw : b->i_flt;
+  float *y = mp->o_float ? (float *)b->o_raw : b->o_flt;
+  size_t i;
+  if (! mp->i_float) {
+    for (i = 0; i < i_elts; i++) {
+      b->i_flt[i] = b->i_buf[i];
+    }
+  }
+  nmat_apply_float (y, mp->mf, mp->out_sz, mp->in_sz,
+                    mp->trailing_1_p, x, b->n, mp->compensated_p);
+  if (! mp->o_float) {
+    for (i = 0; i < o_elts; i++) {
+      b->o_buf[i] = b->o_flt[i];
+    }
+  }
+}
+
+/* NB: VALUES is the matrix, or a copy of it */
+static void
+block_compute (struct block *b, const struct mapping *mp,
+               const double *values)
+{
+  if (mp->copy_p) {
+    nrec_select (b->o_raw, mp->planar_out_p ? mp->block : 0,
+                 &(mp->out_rec),
+                 b->i_raw, mp->planar_in_p ? mp->block : 0,
+                 &(mp->in_rec),
+                 mp->sparse.cols, b->n);
+    /* . */
+    return;
+  }
+  if (mp->fix_p) {
+    nfix_apply (b->o_raw, b->i_raw, b->n, &(mp->fix));
+    /* . */
+    return;
+  }
+  if (mp->planar_in_p) {
+    nrec_to_doubles_planar (b->i_buf, b->i_raw, b->n, mp->block,
+                            &(mp->in_rec));
+  } else if (! mp->i_direct && ! mp->i_float) {
+    nrec_to_doubles (b->i_buf, b->i_raw, b->n, &(mp->in_rec));
+  }
+  if (mp->float_p) {
+    block_compute_float (b, mp);
+  } else if (mp->sparse_p) {
+    nmat_sparse_apply (b->o_buf, &(mp->sparse), b->i_buf, b->n);
+  } else {
+    nmat_apply (b->o_buf, values, mp->out_sz, mp->in_sz,
+                mp->trailing_1_p, b->i_buf, b->n);
+  }
+  if (mp->planar_out_p) {
+    nrec_from_doubles_planar (b->o_raw, b->o_buf, b->n, mp->block,
+                              &(mp->out_rec), mp->rounding);
+  } else if (! mp->o_direct && ! mp->o_float) {
+    nrec_from_doubles (b->o_raw, b->o_buf, b->n, &(mp->out_rec),
+                       mp->rounding);
+  }
+}
+
+static int
+block_write (const struct block *b, const struct mapping *mp,
+             const struct streams *st)
+{
+  size_t j, offset;
+  if (! mp->planar_out_p) {
+    /* . */
+    return ((fwrite (mp->o_direct ? (char *)b->o_buf : b->o_raw,
+                     mp->o_rec, b->n, st->out[0])
+             == b->n)
+            ? 0 : -1);
+  }
+  for (j = 0, offset = 0; j < mp->out_sz; j++) {
+    const size_t esz = numfmt_size (mp->out_fmts + j);
+    if (fwrite (b->o_raw + mp->block * offset, esz, b->n, st->out[j])
+        != b->n) {
+      error (1, errno, "%s", st->out_names[j]);
+    }
+    offset += esz;
+  }
 
   /* . */
   return 0;
 }
 
-/*** Applying matrix to a stream */
+/** Worker threads */
+
+/* NB: the blocks are read and written in turn by the main thread, and
+   are multiplied by the workers in between; a block is reused once
+   it's written, so that the output is in the order of the input */
+struct ring {
+  const struct mapping *mp;
+  struct block *blocks;
+  size_t count;
+  /* the blocks read, and taken by the workers, so far */
+  size_t filled, taken;
+  int done_p;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void *
+ring_worker (void *arg)
+{
+  struct ring *rg = arg;
+  const struct sim_matrix *matrix = rg->mp->matrix;
+  const size_t elts = matrix->rows * matrix->columns;
+  double *values = 0;
+
+  /* NB: each worker has its own (aligned) copy of the matrix, unless
+     its sparse, fixed-point or single precision form is used, which is
+     shared */
+  if (! rg->mp->sparse_p && ! rg->mp->fix_p && ! rg->mp->float_p) {
+    if (posix_memalign ((void **)&values, 64,
+                        elts * sizeof (*values))
+        != 0) {
+      error (1, errno, _("allocating the matrix"));
+    }
+    COPY_ARY (values, matrix->values, elts);
+  }
+
+  pthread_mutex_lock (&(rg->lock));
+  for (;;) {
+    struct block *b;
+    while (rg->taken == rg->filled && ! rg->done_p) {
+      pthread_cond_wait (&(rg->cond), &(rg->lock));
+    }
+    if (rg->taken == rg->filled) {
+      break;
+    }
+    b = rg->blocks + (rg->taken++) % rg->count;
+    pthread_mutex_unlock (&(rg->lock));
+    block_compute (b, rg->mp, values);
+    pthread_mutex_lock (&(rg->lock));
+    b->done_p = 1;
+    pthread_cond_broadcast (&(rg->cond));
+  }
+  pthread_mutex_unlock (&(rg->lock));
+  free (values);
 
+  /* . */
+  return 0;
+}
+
+/* NB: wait for the block to be multiplied, and write it */
 static int
-apply_matrix (FILE *out, const struct sim_matrix *matrix,
-              const enum raw_format *in_fmts,
-              const enum raw_format *out_fmts,
-              int trailing_1_p,
-              FILE *in)
+ring_write (struct ring *rg, struct block *b,
+            const struct streams *st)
 {
-  const size_t
-    inb_sz = matrix->columns,
-    in_sz  = inb_sz + (trailing_1_p ? -1 : 0),
-    out_sz = matrix->rows;
-  const int
-    i_direct = all_double_p  (in_sz,  in_fmts),
-    o_direct = all_double_p (out_sz, out_fmts);
-  double
-    i_buf[inb_sz],
-    o_buf[out_sz];
-
-  while ((i_direct ? fread_doubles (i_buf, in_sz, in)
-          : fread_doubles_fmt (i_buf, in_sz, in_fmts, in)) == 1) {
-    int written;
-    if (inb_sz > in_sz) {
-      i_buf[in_sz] = 1.;
-    }
-    matrix_by_vector (o_buf, matrix, i_buf);
-    if ((written = (o_direct
-                    ? fwrite_doubles (o_buf, out_sz, out)
-                    : fwrite_doubles_fmt (o_buf, out_sz,
-                                          out_fmts, out)))
-        != 1) {
-      /* . */
-      return -1;
+  pthread_mutex_lock (&(rg->lock));
+  while (! b->done_p) {
+    pthread_cond_wait (&(rg->cond), &(rg->lock));
+  }
+  pthread_mutex_unlock (&(rg->lock));
+
+  /* . */
+  return block_write (b, rg->mp, st);
+}
+
+static int
+apply_matrix_threads (const struct streams *st,
+                      const struct mapping *mp, size_t jobs)
+{
+  struct block blocks[2 * jobs];
+  pthread_t tids[jobs];
+  struct ring rg;
+  size_t i, written;
+  int r = 1, rv = 0;
+
+  rg.mp     = mp;
+  rg.blocks = blocks;
+  rg.count  = 2 * jobs;
+  rg.filled = rg.taken = 0;
+  rg.done_p = 0;
+  for (i = 0; i < rg.count; i++) {
+    if (block_init (blocks + i, mp) < 0) {
+      error (1, errno, _("allocating the blocks"));
     }
   }
+  pthread_mutex_init (&(rg.lock), 0);
+  pthread_cond_init (&(rg.cond), 0);
+  for (i = 0; i < jobs; i++) {
+    if ((errno = pthread_create (tids + i, 0, ring_worker, &rg))
+        != 0) {
+      error (1, errno, _("creating a worker thread"));
+    }
+  }
+
+  for (written = 0; r > 0; ) {
+    struct block *b = blocks + rg.filled % rg.count;
+    /* NB: the block is reused once it's written */
+    if (rg.filled - written == rg.count) {
+      if (ring_write (&rg, b, st) < 0) {
+        rv = -1;
+        break;
+      }
+      written++;
+    }
+    if ((r = block_read (b, mp, st)) < 0) {
+      rv = r;
+    }
+    if (b->n > 0) {
+      pthread_mutex_lock (&(rg.lock));
+      b->done_p = 0;
+      rg.filled++;
+      pthread_cond_signal (&(rg.cond));
+      pthread_mutex_unlock (&(rg.lock));
+    }
+  }
+  pthread_mutex_lock (&(rg.lock));
+  rg.done_p = 1;
+  pthread_cond_broadcast (&(rg.cond));
+  pthread_mutex_unlock (&(rg.lock));
+
+  /* NB: the rest is written even if there's a partial vector */
+  for (; written < rg.filled; written++) {
+    if (ring_write (&rg, blocks + written % rg.count, st) < 0) {
+      rv = -1;
+      break;
+    }
+  }
+  for (i = 0; i < jobs; i++) {
+    pthread_join (tids[i], 0);
+  }
+  pthread_cond_destroy (&(rg.cond));
+  pthread_mutex_destroy (&(rg.lock));
+  for (i = 0; i < rg.count; i++) {
+    block_free (blocks + i);
+  }
+
+  /* . */
+  return rv;
+}
+
+/** Applying */
 
-  if (! feof (in)) {
+/* NB: return 0 on success, -1 on error (with errno set), or
+   READ_PARTIAL if the input ends in the middle of a vector, the
+   vectors before it having been written */
+static int
+apply_matrix (const struct streams *st, const struct mapping *mp,
+              size_t jobs)
+{
+  struct block b;
+  int r, rv = 0;
+
+  if (jobs > 1) {
+    /* . */
+    return apply_matrix_threads (st, mp, jobs);
+  }
+
+  if (block_init (&b, mp) < 0) {
+    block_free (&b);
     /* . */
     return -1;
   }
+  do {
+    if ((r = block_read (&b, mp, st)) < 0) {
+      rv = r;
+    }
+    if (b.n > 0) {
+      block_compute (&b, mp, mp->matrix->values);
+      if (block_write (&b, mp, st) < 0) {
+        rv = -1;
+        break;
+      }
+    }
+  } while (r > 0);
+  block_free (&b);
 
   /* . */
-  return 0;
+  return rv;
 }
 
 /*** Parsing the Command Line */
@@ -292,50 +1031,270 @@ const char *argp_program_bug_address = PACKAGE_BUGREPORT;
 void (*argp_program_version_hook)(FILE *, struct argp_state *) = p_vers;
 
 enum opts {
-  opt_trailing_1 = 256,
+  opt_planar = 256,
+  opt_csr,
+  opt_matrix_file,
+  opt_matrix_format,
+  opt_trailing_1,
+  opt_rounding,
+  opt_compute,
+  opt_compensated,
   opt_max
 };
 
-const char *format_opts[] = {
-  [FORMAT_DOUBLE] = "double",
-  [FORMAT_FLOAT]  = "float"
-};
-
 static struct argp_option p_opts[] = {
   { "trailing-1",       opt_trailing_1, 0, 0,
     N_("append a value of 1.0 to each of the vectors read") },
-#if 0
-  /* FIXME: implement it! */
-  { "format",           't', "TYPE", 0,
-    N_("select input format, which may be"
-       " `float' or `double' (default)") },
-  { "output-format",    'T', "TYPE", 0,
-    N_("select output format, which may be"
-       " `float' or `double' (default)") },
-#endif
+  { "format",           't', "FORMAT[,FORMAT]...", 0,
+    N_("select input formats of the elements, the last one applying"
+       " to the rest (`double' by default)") },
+  { "output-format",    'T', "FORMAT[,FORMAT]...", 0,
+    N_("select output formats of the elements, the last one applying"
+       " to the rest (`double' by default)") },
+  { "rounding",         opt_rounding, "MODE", 0,
+    N_("round to integer output formats using MODE, which may be"
+       " `nearest' (to even, default), `trunc' or `floor'") },
+  { "compute",          opt_compute, "MODE", 0,
+    N_("compute the products in MODE, which may be `double'"
+       " (default), `float', or `fixed' (for the 8- and 16-bit"
+       " integer input and integer output)") },
+  { "compensated",      opt_compensated, 0, 0,
+    N_("with `--compute float', carry the rounding errors of the"
+       " sums along (compensated summation)") },
+  { "jobs",             'j', "N", 0,
+    N_("multiply the blocks of vectors in N threads") },
   { "matrix",           'm', "MATRIX", 0,
-    N_("specify the matrix elements") },
+    N_("specify the matrix elements; if given more than once (or"
+       " along with `--matrix-file'), the matrices are applied in"
+       " order, composed into one") },
+  { "matrix-file",      opt_matrix_file, "FILE", 0,
+    N_("read the matrix from FILE, stored by the rows") },
+  { "matrix-format",    opt_matrix_format, "FORMAT", 0,
+    N_("read the matrix file in FORMAT, which may be `text'"
+       " (default), or a raw format, such as `double' or `float'") },
+  { "csr",              opt_csr, 0, 0,
+    N_("read the matrix in the sparse (CSR) form, as"
+       " `ROW-PTRS:COLUMNS:VALUES', each a comma-separated list") },
   { "vector-size",      's', "ELTS", 0,
-    N_("read vectors of this number of elements") },
+    N_("read vectors of this number of elements; the matrix may then"
+       " be of any shape, its rows being the output elements") },
   { "output",           'o', "FILE", 0,
-    N_("output the result to this file instead of stdout") },
+    N_("output the result to this file instead of stdout;"
+       " if given once per element, output each element"
+       " to its own file") },
+  { "planar",           opt_planar, 0, 0,
+    N_("read each element of the vectors from its own file,"
+       " given in order") },
   { "verbose",          'v', 0, 0,
     N_("explain what is being done") },
   { 0 }
 };
 
+/* NB: a matrix, as given in the command line; the matrices are read
+   once all the options are parsed, for their shapes depend on `-s'
+   and `--trailing-1', wherever given, while the form (`--csr' and
+   `--matrix-format') is the one in effect for each */
+struct matrix_arg {
+  const char *arg;
+  int file_p;
+  int csr_p;
+  int raw_p;
+  struct numfmt fmt;
+};
+
 struct p_args {
   int verbose_p;
   int trailing_1_p;
-  enum raw_format *in_fmts;
-  enum raw_format *out_fmts;
+  /* NB: as given, the last one applying to the rest */
+  struct numfmt *in_list, *out_list;
+  size_t in_count, out_count;
+  int rounding;
+  int compute;
+  int compensated_p;
+  struct numfmt *in_fmts;
+  struct numfmt *out_fmts;
   long vector_size;
+  size_t jobs;
+  struct matrix_arg *matrix_args;
+  size_t matrix_args_count, matrix_args_alloc;
   int matrix_read_p;
+  /* NB: the format of the matrix files, if not text */
+  int matrix_raw_p;
+  struct numfmt matrix_fmt;
+  int csr_p;
   struct sim_matrix matrix;
-  const char *output_file;
+  /* NB: the product of the matrices given before the last one */
+  struct sim_matrix prior;
+  int prior_p;
+  int planar_p;
+  struct strings output_files;
   struct strings input_files;
 };
 
+/* NB: the number of the columns of the matrix to be read, if known:
+   from `-s' for the first matrix, and from the rows of the previous
+   one for the rest; 0 otherwise */
+static size_t
+matrix_columns (const struct p_args *args)
+{
+  const size_t in
+    = (args->prior_p ? args->prior.rows
+       : args->vector_size > 0 ? (size_t)args->vector_size : 0);
+
+  /* . */
+  return (in > 0 ? in + (args->trailing_1_p ? 1 : 0) : 0);
+}
+
+/* NB: the matrix read last is composed with those before it */
+static int
+matrix_fold (struct p_args *args)
+{
+  if (! args->prior_p) {
+    args->prior   = args->matrix;
+    args->prior_p = 1;
+    /* . */
+    return 0;
+  }
+  if (compose_matrix (&(args->prior), &(args->matrix),
+                      args->trailing_1_p)
+      < 0) {
+    /* . */
+    return -1;
+  }
+  free (args->matrix.values);
+
+  /* . */
+  return 0;
+}
+
+/* NB: read the matrix given with MA, and compose it with those read
+   before */
+static error_t
+read_matrix (struct argp_state *state, struct p_args *args,
+             const struct matrix_arg *ma)
+{
+  const char *arg = ma->arg;
+
+  /* NB: the matrices given before are applied first */
+  if (args->matrix_read_p && matrix_fold (args) < 0) {
+    argp_failure (state, 0, errno, N_("%s: couldn't store matrix"),
+                  arg);
+    /* . */
+    return errno;
+  }
+  args->matrix.rows = args->matrix.columns = 0;
+  if (ma->file_p) {
+    if (load_matrix_file (&(args->matrix), arg,
+                          ma->raw_p ? &(ma->fmt) : 0)
+        >= 0) {
+      /* do nothing */
+    } else if (errno == EINVAL) {
+      argp_error (state, N_("%s: not a valid matrix file"), arg);
+      /* . */
+      return EINVAL;
+    } else {
+      argp_failure (state, 0, errno, "%s", arg);
+      /* . */
+      return errno;
+    }
+  } else if (ma->csr_p) {
+    const size_t cols1 = matrix_columns (args);
+    if (load_matrix_csr (&(args->matrix), arg, cols1,
+                         args->trailing_1_p)
+        >= 0) {
+      /* do nothing */
+    } else if (errno == EINVAL) {
+      argp_error (state,
+                  N_("%s: not a valid matrix, should be"
+                     " `ROW-PTRS:COLUMNS:VALUES'"),
+                  arg);
+      /* . */
+      return EINVAL;
+    } else {
+      argp_failure (state, 0, errno,
+                    N_("%s: couldn't store matrix"), arg);
+      /* . */
+      return errno;
+    }
+    args->matrix_read_p = 1;
+    /* . */
+    return 0;
+  } else if (load_matrix_csv (&(args->matrix), arg) >= 0) {
+    /* do nothing */
+  } else if (errno == EINVAL) {
+    argp_error (state,
+                N_("%s: not a valid matrix,"
+                   " should be `NUMBER[, NUMBER]...'"),
+                arg);
+    /* . */
+    return EINVAL;
+  } else {
+    argp_failure (state, 0, errno,
+                  N_("%s: couldn't store matrix"), arg);
+    /* . */
+    return errno;
+  }
+
+  /* check the shape, if it's known (as for the text files of
+     several lines) */
+  if (args->matrix.rows > 1) {
+    const size_t cols1 = matrix_columns (args);
+    if ((cols1 > 0 && args->matrix.columns != cols1)
+        || args->matrix.columns < (args->trailing_1_p ? 2 : 1)) {
+      argp_error (state,
+                  N_("%s: the rows are of the wrong length"), arg);
+      /* . */
+      return EINVAL;
+    }
+    args->matrix_read_p = 1;
+    /* . */
+    return 0;
+  }
+
+  /* obtain matrix size */
+  {
+    struct sim_matrix *m = &(args->matrix);
+    const int trailing_1_p = args->trailing_1_p;
+    const size_t elts = m->columns;
+    const size_t cols1 = matrix_columns (args);
+    const size_t cols
+      = (cols1 > 0
+         ? cols1
+         : ((size_t)floor (sqrt ((double)elts))
+            + (trailing_1_p ? 1 : 0)));
+
+    assert (m->columns > 0 && m->rows == 1);
+
+    /* check if the number of columns is given */
+    if (cols1 > 0 && elts % cols1 != 0) {
+      argp_error (state,
+                  N_("%s: integral number of rows expected"),
+                  arg);
+      /* . */
+      return EINVAL;
+    } else if (cols1 > 0
+               || elts == (trailing_1_p ? cols - 1 : cols) * cols) {
+      /* do nothing, N x ELTS, M x M or M x (M + 1) matrix is given */
+    } else if (trailing_1_p) {
+      argp_error (state, N_("%s: M x (M + 1) matrix expected"), arg);
+      /* . */
+      return EINVAL;
+    } else {
+      argp_error (state, N_("%s: square matrix expected"), arg);
+      /* . */
+      return EINVAL;
+    }
+    m->columns = cols;
+    m->rows    = elts / cols;
+  }
+
+  /* raise the flag */
+  args->matrix_read_p = 1;
+
+  /* . */
+  return 0;
+}
+
 static error_t
 p_opt (int key, char *arg, struct argp_state *state)
 {
@@ -352,12 +1311,51 @@ p_opt (int key, char *arg, struct argp_state *state)
     args->trailing_1_p = 1;
     break;
   case 't':
-    argp_failure (state, 0, 0, N_("-%c: not implemented yet"), key);
-    /* FIXME: implement it! */
-    break;
   case 'T':
-    argp_failure (state, 0, 0, N_("-%c: not implemented yet"), key);
-    /* FIXME: implemented it! */
+    if ((key == 't'
+         ? numfmt_parse_list (&(args->in_list), &(args->in_count), arg)
+         : numfmt_parse_list (&(args->out_list), &(args->out_count),
+                              arg))
+        < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `%s';"
+                     " should be `TYPE[:FILL]'"
+                     " or `TYPE:SCALE:OFFSET[:FILL]'"),
+                  arg, (key == 't' ? "--format" : "--output-format"));
+      /* . */
+      return EINVAL;
+    }
+    break;
+  case opt_rounding:
+    {
+      int i;
+      if ((i = p_arg_string (arg, numfmt_rounding_names, 0)) < 0) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--rounding';"
+                       " should be `nearest', `trunc' or `floor'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->rounding = i;
+    }
+    break;
+  case opt_compute:
+    {
+      int i;
+      if ((i = p_arg_string (arg, compute_names, 0)) < 0) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--compute';"
+                       " should be `double', `float' or `fixed'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->compute = i;
+    }
+    break;
+  case opt_compensated:
+    args->compensated_p = 1;
     break;
   case 's':
     {
@@ -373,79 +1371,82 @@ p_opt (int key, char *arg, struct argp_state *state)
       args->vector_size = vs;
     }
     break;
+  case 'j':
+    {
+      long n;
+      if (p_arg_long (arg, &n) < 0 || n < 1) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--jobs'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->jobs = n;
+    }
+    break;
   case 'o':
-    args->output_file = arg;
+    {
+      const char *s[1] = { arg };
+      if (strings_append (&(args->output_files), s, 1) < 0) {
+        argp_failure (state, 0, errno,
+                      N_("couldn't store the output file name"));
+        /* . */
+        return errno;
+      }
+    }
+    break;
+  case opt_planar:
+    args->planar_p = 1;
+    break;
+  case opt_csr:
+    args->csr_p = 1;
+    break;
+  case opt_matrix_format:
+    if (strcmp (arg, "text") == 0) {
+      args->matrix_raw_p = 0;
+    } else if (numfmt_parse (&(args->matrix_fmt), arg) >= 0) {
+      args->matrix_raw_p = 1;
+    } else {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--matrix-format';"
+                     " should be `text' or a format"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
     break;
   case 'v':
     args->verbose_p = 1;
     break;
   case ARGP_KEY_ARG:
-    /* check if matrix was already read */
-    if (args->matrix_read_p) {
+    /* check if matrix was already given */
+    if (args->matrix_args_count > 0) {
       /* . */
       return ARGP_ERR_UNKNOWN;
     }
-    /* NB: no `break' here */
+    /* fall through */
+  case opt_matrix_file:
   case 'm':
-    /* parse matrix */
-    if (load_matrix_csv (&(args->matrix), arg, args->trailing_1_p)
-        >= 0) {
-      /* do nothing */
-    } else if (errno == EINVAL) {
-      argp_error (state,
-                  N_("%s: not a valid matrix,"
-                     " should be `NUMBER[, NUMBER]...'"),
-                  arg);
-      /* . */
-      return EINVAL;
-    } else {
-      argp_failure (state, 0, errno,
-                    N_("%s: couldn't store matrix"), arg);
+    /* NB: the matrices are read once all the options are known */
+    if (ensure_enough_space ((void **)&(args->matrix_args),
+                             &(args->matrix_args_alloc),
+                             sizeof (*(args->matrix_args)),
+                             args->matrix_args_count + 1)
+        != 0) {
+      argp_failure (state, 0, errno, N_("%s: couldn't store matrix"),
+                    arg);
       /* . */
       return errno;
     }
-
-    /* obtain matrix size */
     {
-      struct sim_matrix *m = &(args->matrix);
-      const int trailing_1_p = args->trailing_1_p;
-      const size_t elts = m->columns;
-      const size_t cols1
-        = (args->vector_size > 0
-           ? args->vector_size + (trailing_1_p ? 1 : 0)
-           : 0);
-      const size_t cols
-        = (cols1 > 0
-           ? cols1
-           : ((size_t)floor (sqrt ((double)elts))
-              + (trailing_1_p ? 1 : 0)));
-
-      assert (m->columns > 0 && m->rows == 1);
-
-      /* check if the number of columns is given */
-      if (cols1 > 0 && elts % cols1 != 0) {
-        argp_error (state,
-                    N_("%s: integral number of rows expected"),
-                    arg);
-        /* . */
-        return EINVAL;
-      } else if (elts == (trailing_1_p ? cols - 1 : cols) * cols) {
-        /* do nothing, M x M or M x (M + 1) matrix is given */
-      } else if (trailing_1_p) {
-        argp_error (state, N_("%s: M x (M + 1) matrix expected"), arg);
-        /* . */
-        return EINVAL;
-      } else {
-        argp_error (state, N_("%s: square matrix expected"), arg);
-        /* . */
-        return EINVAL;
-      }
-      m->columns = cols;
-      m->rows    = elts / cols;
+      struct matrix_arg *ma
+        = args->matrix_args + args->matrix_args_count++;
+      ma->arg    = arg;
+      ma->file_p = (key == opt_matrix_file);
+      ma->csr_p  = args->csr_p;
+      ma->raw_p  = args->matrix_raw_p;
+      ma->fmt    = args->matrix_fmt;
     }
-
-    /* raise the flag */
-    args->matrix_read_p = 1;
     break;
   case ARGP_KEY_ARGS:
     if (strings_append (&(args->input_files),
@@ -458,11 +1459,32 @@ p_opt (int key, char *arg, struct argp_state *state)
     }
     break;
   case ARGP_KEY_END:
-    if (! args->matrix_read_p) {
+    if (args->matrix_args_count < 1) {
       argp_error (state, N_("no matrix specified"));
       /* . */
       return EINVAL;
     }
+    {
+      size_t i;
+      for (i = 0; i < args->matrix_args_count; i++) {
+        const error_t e
+          = read_matrix (state, args, args->matrix_args + i);
+        if (e != 0) {
+          /* . */
+          return e;
+        }
+      }
+    }
+    if (args->prior_p) {
+      if (matrix_fold (args) < 0) {
+        argp_failure (state, 0, errno,
+                      N_("couldn't compose the matrices"));
+        /* . */
+        return errno;
+      }
+      args->matrix  = args->prior;
+      args->prior_p = 0;
+    }
     if (args->input_files.size <= 0) {
       const char *s[1] = { "-" };
       if (strings_append (&(args->input_files), s, 1) < 0) {
@@ -472,21 +1494,88 @@ p_opt (int key, char *arg, struct argp_state *state)
         return errno;
       }
     }
-    if (args->output_file == 0) {
-      args->output_file = "-";
+    if (args->output_files.size <= 0) {
+      const char *s[1] = { "-" };
+      if (strings_append (&(args->output_files), s, 1) < 0) {
+        argp_failure (state, 0, errno,
+                      N_("couldn't set stdout as the output file"));
+        /* . */
+        return errno;
+      }
     }
     assert (args->input_files.size > 0);
-    /* FIXME: replace this with an actual code */
+    /* NB: the last format given is used for the rest of the
+       elements */
     {
       const size_t
-        in_sz  = args->matrix.columns,
+        in_sz  = args->matrix.columns - (args->trailing_1_p ? 1 : 0),
         out_sz = args->matrix.rows;
-      MALLOC_ARY (args->in_fmts,  in_sz);
-      MALLOC_ARY (args->out_fmts, out_sz);
-      assert (args->in_fmts != 0 && args->out_fmts != 0);
-      /* initialize to FORMAT_DOUBLE, which is 0 */
-      memset (args->in_fmts,  0,  in_sz * sizeof  (*(args->in_fmts)));
-      memset (args->out_fmts, 0, out_sz * sizeof (*(args->out_fmts)));
+      struct numfmt dbl;
+      size_t i;
+      numfmt_init (&dbl, NUMFMT_DOUBLE);
+      if (args->planar_p && args->input_files.size != in_sz) {
+        argp_error (state,
+                    N_("%lu input files expected, one per element"),
+                    (unsigned long)in_sz);
+        /* . */
+        return EINVAL;
+      }
+      if (args->output_files.size > 1
+          && args->output_files.size != out_sz) {
+        argp_error (state,
+                    N_("%lu output files expected, one per element"),
+                    (unsigned long)out_sz);
+        /* . */
+        return EINVAL;
+      }
+      if (args->in_count > in_sz || args->out_count > out_sz) {
+        argp_error (state,
+                    N_("more formats given than there are elements"));
+        /* . */
+        return EINVAL;
+      }
+      if (MALLOC_ARY (args->in_fmts,  MAX (in_sz, 1)) == 0
+          || MALLOC_ARY (args->out_fmts, out_sz) == 0) {
+        argp_failure (state, 0, errno,
+                      N_("couldn't allocate formats"));
+        /* . */
+        return errno;
+      }
+      for (i = 0; i < in_sz; i++) {
+        args->in_fmts[i]
+          = (args->in_count > 0
+             ? args->in_list[MIN (i, args->in_count - 1)] : dbl);
+      }
+      for (i = 0; i < out_sz; i++) {
+        args->out_fmts[i]
+          = (args->out_count > 0
+             ? args->out_list[MIN (i, args->out_count - 1)] : dbl);
+      }
+      if (args->compute == COMPUTE_FIXED) {
+        const int
+          in_t  = uniform_type (in_sz,  args->in_fmts),
+          out_t = uniform_type (out_sz, args->out_fmts);
+        if (args->planar_p || args->output_files.size > 1
+            || (in_t != NUMFMT_UINT8  && in_t != NUMFMT_INT8
+                && in_t != NUMFMT_UINT16 && in_t != NUMFMT_INT16)
+            || out_t < 0
+            || ! numfmt_integer_p (args->out_fmts)) {
+          argp_error (state,
+                      N_("`--compute fixed' requires the 8- or 16-bit"
+                         " integer input, and integer output, each"
+                         " of a single plain format, interleaved"));
+          /* . */
+          return EINVAL;
+        }
+      }
+      /* NB: lacking the fill value, NaN is written as the largest
+         value of an integer type, as with rawxform */
+      for (i = 0; i < out_sz; i++) {
+        if (numfmt_integer_p (args->out_fmts + i)
+            && ! args->out_fmts[i].fill_p) {
+          numfmt_set_fill (args->out_fmts + i, HUGE_VAL);
+        }
+      }
     }
     break;
   default:
@@ -507,15 +1596,30 @@ main (int argc, char **argv)
   struct p_args args = {
     .verbose_p = 0,
     .trailing_1_p = 0,
+    .in_list = 0,
+    .out_list = 0,
+    .in_count = 0,
+    .out_count = 0,
+    .rounding = NCONV_ROUND_NEAREST,
+    .compute = COMPUTE_DOUBLE,
+    .compensated_p = 0,
     .in_fmts = 0,
     .out_fmts = 0,
     .vector_size = 0,
+    .jobs = 1,
+    .matrix_args = 0,
+    .matrix_args_count = 0,
+    .matrix_args_alloc = 0,
     .matrix_read_p = 0,
+    .prior_p = 0,
+    .matrix_raw_p = 0,
+    .csr_p = 0,
     .matrix = { 0, 0, 0, 0 },
-    .output_file = 0,
+    .planar_p = 0,
+    .output_files = { 0, 0, 0 },
     .input_files = { 0, 0, 0 }
   };
-  FILE *output;
+  struct streams st;
 
   /* set the locale */
   setlocale (LC_ALL, "");
@@ -532,43 +1636,97 @@ main (int argc, char **argv)
     argp_parse (&argp, argc, argv, 0, 0, &args);
   }
 
-  /* open the output file */
-  if ((output = open_file (args.output_file, 0)) == 0) {
-    error (1, errno, "%s", args.output_file);
+  /* open the output files */
+  {
+    const struct strings *names = &(args.output_files);
+    size_t i;
+    if (MALLOC_ARY (st.out, names->size) == 0) {
+      error (1, errno, _("allocating the streams"));
+    }
+    for (i = 0; i < names->size; i++) {
+      if ((st.out[i] = open_file (names->s[i], 0)) == 0) {
+        error (1, errno, "%s", names->s[i]);
+      }
+    }
+    st.out_names = names->s;
+    st.out_count = names->size;
   }
 
-  /* process the input files */
+  /* process the input files, one by one, or all at once */
   {
     const struct strings *names = &(args.input_files);
-    const struct sim_matrix *matrix = &(args.matrix);
-    size_t rest;
+    const size_t count = args.planar_p ? names->size : 1;
+    struct mapping mp;
+    size_t rest, i;
     const char **np;
+    if (MALLOC_ARY (st.in, count) == 0) {
+      error (1, errno, _("allocating the streams"));
+    }
+    st.in_count = count;
     for (rest = names->size, np = names->s;
          rest > 0;
-         rest--, np++) {
-      FILE *fp;
-
-      if ((fp = open_file (*np, 1)) == 0) {
-        error (1, errno, "%s", *np);
+         rest -= count, np += count) {
+      for (i = 0; i < count; i++) {
+        if ((st.in[i] = open_file (np[i], 1)) == 0) {
+          error (1, errno, "%s", np[i]);
+        }
+        if (args.verbose_p) {
+          if (st.in[i] == stdin)
+            fputs (_("processing standard input...\n"), stderr);
+          else
+            fprintf (stderr, _("processing `%s'...\n"), np[i]);
+        }
       }
-      if (args.verbose_p) {
-        if (fp == stdin)
-          fputs (_("processing standard input...\n"), stderr);
-        else
-          fprintf (stderr, _("processing `%s'...\n"), *np);
+      st.in_names = np;
+      if (rest == names->size) {
+        mapping_init (&mp, &(args.matrix),
+                      args.in_fmts, args.out_fmts,
+                      args.rounding, args.trailing_1_p,
+                      args.compute, args.compensated_p, &st);
+        if (args.verbose_p && mp.fix_p) {
+          fprintf (stderr,
+                   _("fixed point of %d fraction bits,"
+                     " the sums within %g of exact\n"),
+                   mp.fix.shift, mp.fix.error);
+        }
+        if (args.verbose_p && mp.float_p) {
+          /* NB: the matrix, and the input unless float, are rounded
+             to float, too */
+          const size_t terms = args.matrix.columns;
+          const double
+            u = FLT_EPSILON / 2,
+            e_f = (nmat_sum_error (terms, 1, args.compensated_p)
+                   + u * (mp.i_float ? 1 : 2)),
+            e_d = nmat_sum_error (terms, 0, 0);
+          fprintf (stderr,
+                   _("single precision%s, the sums within %g"
+                     " (%g in double) of exact, relative to the"
+                     " sums of the magnitudes of the products\n"),
+                   (args.compensated_p ? _(", compensated") : ""),
+                   e_f, e_d);
+        }
       }
-      if (apply_matrix (output, matrix,
-                        args.in_fmts, args.out_fmts,
-                        args.trailing_1_p,
-                        fp) < 0) {
+      switch (apply_matrix (&st, &mp, args.jobs)) {
+      case READ_PARTIAL:
+        error (1, 0, _("%s: EOF in the middle of the vector"), *np);
+        break;
+      case -1:
         error (1, errno, "%s", *np);
+        break;
+      }
+      for (i = 0; i < count; i++) {
+        close_file (st.in[i]);
       }
-      close_file (fp);
     }
   }
 
-  /* close output */
-  close_file (output);
+  /* close the output files */
+  {
+    size_t i;
+    for (i = 0; i < st.out_count; i++) {
+      close_file (st.out[i]);
+    }
+  }
 
   /* . */
   return 0;
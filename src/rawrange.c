@@ -4,13 +4,43 @@
 #include "gettext.h"
 #define _(string) gettext (string)
 #define N_(string) gettext_noop (string)
-static const char doc[] = N_("Interleave parts of the files");
-static const char args_doc[]
-= N_("[FILE]...\n\v"
-     "Supported format names are:"
+static const char doc[]
+= N_("Find the range of the values in the files\v"
+     "FORMAT is TYPE[:FILL] or, for the integer types,"
+     " TYPE:SCALE:OFFSET[:FILL], meaning the values of"
+     " SCALE * DN + OFFSET, with the DN's equal to FILL ignored."
+     "  Supported types are:"
      " uint8 (default), uint16, uint32, uint64,"
      " int8, int16, int32, int64,"
-     " float, double");
+     " float, double\n\n"
+     "With --components, the data is read as the records of N values,"
+     " of the formats given (the last one applying to the rest), and"
+     " the result is reported for each of the components.\n\n"
+     "With --cache, the results for the regular files are kept in"
+     " DIR, and used for as long as the file (its inode, size and"
+     " modification time) and the options stay the same.\n\n"
+     "With --build-index, a zone map is written for each of the"
+     " files, holding the range of the values of each block of BLOCK"
+     " values (65536 by default), and the number of NaN's; it's"
+     " then used for the range (unless --no-index is given), and by"
+     " rawxform(1).\n\n"
+     "With --sample, the files are divided into the strata of equal"
+     " size, and a block of 64 KiB is read from each, chosen at"
+     " random; the confidence of the result is then reported to the"
+     " standard error output.\n\n"
+     "With --stats, the number of the finite values, NaN's and"
+     " infinities is reported, along with the minimum, maximum,"
+     " sum, mean, and (population) variance of the finite values.\n\n"
+     "With --histogram, the values are counted in BINS bins of equal"
+     " width, covering MIN to MAX, or the range of the values, found"
+     " with an additional pass unless the data is of an 8- or 16-bit"
+     " type.  The values out of the range are not counted.  Each"
+     " bin is output as the line of its bounds and count, or, with"
+     " --raw-counts, the counts are written as raw uint64.\n\n"
+     "The quantiles are computed with a sketch of bounded size, with"
+     " the error in the rank within 0.18% of the count (at the 99%"
+     " level), or exactly for the 8- and 16-bit types.");
+static const char args_doc[] = "[FILE]...";
 
 /*** Copyright (C) 2007 Ivan Shmakov */
 
@@ -45,50 +75,1435 @@ program_copyright (void)
 #include <assert.h>
 #include <errno.h>
 #include <error.h>
+#include <float.h>              /* for DBL_DIG */
 #include <locale.h>
+#include <math.h>               /* for isnan () */
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>             /* for memcpy () */
+#include <sys/stat.h>
 
+#include "numfmt.h"
+#include "numhist.h"
+#include "numquant.h"
 #include "numrange.h"
+#include "numstats.h"
 #include "p_arg.h"
+#include "recparts.h"
+#include "sidecar.h"
 #include "usemacro.h"
 #include "useutil.h"
+#include "zonemap.h"
 
 #define PROGRAM_NAME "rawrange"
 
-#define BUF_SZ 4096
+#define BUF_SZ 65536
+/* NB: the values are decoded (and the components of the records
+   gathered) by this many at a time, into the fixed scratch space */
+#define DECODE_SZ 4096
 
 /*** Utility */
 
-enum num_format {
-  FORMAT_UINT8 = 0,
-  FORMAT_UINT16,
-  FORMAT_UINT32,
-  FORMAT_UINT64,
-  FORMAT_INT8,
-  FORMAT_INT16,
-  FORMAT_INT32,
-  FORMAT_INT64,
-  FORMAT_FLOAT,
-  FORMAT_DOUBLE,
-  FORMAT_MAX
+/* NB: NaN's are dropped if NAN_P, and so are the values equal to
+   *IGNORE, unless it's a null pointer */
+static size_t
+compact_doubles (double *buf, size_t count,
+                 int nan_p, const double *ignore)
+{
+  size_t rest;
+  double *dp;
+  const double *sp;
+  for (rest = count, dp = buf, sp = buf; rest > 0; rest--, sp++) {
+    if (! ((nan_p && isnan (*sp))
+           || (ignore != 0 && *sp == *ignore))) {
+      *(dp++) = *sp;
+    }
+  }
+
+  /* . */
+  return dp - buf;
+}
+
+/* NB: the leading NaN's should never be used as the initial range */
+static size_t
+leading_nans (const void *buf, size_t count, enum numfmt_type type)
+{
+  size_t i;
+  for (i = 0; i < count; i++) {
+    if (! (type == NUMFMT_FLOAT    ? isnan (((const float *)buf)[i])
+           : type == NUMFMT_DOUBLE ? isnan (((const double *)buf)[i])
+           : 0)) {
+      break;
+    }
+  }
+
+  /* . */
+  return i;
+}
+
+/*** Scanning */
+
+enum mode {
+  MODE_RANGE = 0,
+  MODE_STATS,
+  MODE_HIST,
+  MODE_QUANT
+};
+
+/* NB: what's to be computed, and how */
+struct scan {
+  const struct numfmt *fmt;
+  const double *ignore;
+  enum mode mode;
+  /* count the DN's for the direct-indexed histogram or quantiles */
+  int dn_p;
+  /* NB: packed data, fill and ignored values, and anything but the
+     range are handled as doubles */
+  int decode_p;
+  /* the type of the values reduced */
+  enum numfmt_type t;
+  size_t in_sz, elt_sz;
+  /* NB: casting to `void *' */
+  void (*extend) (const void *vec, size_t size,
+                  void *min, void *max);
+};
+
+/* NB: the state of the computation */
+struct accum {
+  int has_range_p;
+  union numfmt_value min, max;
+  struct nstats stats;
+  struct nhist hist;
+  struct nquant quant;
+  /* the DN counts, 256 or 65536 of them */
+  uint64_t *dn_counts;
+};
+
+static void
+scan_init (struct scan *sc, const struct numfmt *fmt,
+           const double *ignore, enum mode mode)
+{
+  const size_t in_sz = numfmt_size (fmt);
+  sc->fmt      = fmt;
+  sc->ignore   = ignore;
+  sc->mode     = mode;
+  sc->dn_p     = ((mode == MODE_HIST || mode == MODE_QUANT)
+                  && in_sz <= 2);
+  sc->decode_p = (fmt->packed_p || fmt->fill_p || ignore != 0
+                  || (mode != MODE_RANGE && ! sc->dn_p));
+  sc->t        = sc->decode_p ? NUMFMT_DOUBLE : fmt->type;
+  sc->in_sz    = in_sz;
+  sc->elt_sz   = sc->decode_p ? sizeof (double) : in_sz;
+  sc->extend
+    = (sc->t == NUMFMT_INT8     ? nrange_extend_int8_tt
+       : sc->t == NUMFMT_INT16  ? nrange_extend_int16_tt
+       : sc->t == NUMFMT_INT32  ? nrange_extend_int32_tt
+       : sc->t == NUMFMT_INT64  ? nrange_extend_int64_tt
+       : sc->t == NUMFMT_UINT8  ? nrange_extend_uint8_tt
+       : sc->t == NUMFMT_UINT16 ? nrange_extend_uint16_tt
+       : sc->t == NUMFMT_UINT32 ? nrange_extend_uint32_tt
+       : sc->t == NUMFMT_UINT64 ? nrange_extend_uint64_tt
+       : sc->t == NUMFMT_FLOAT  ? nrange_extend_float
+       : sc->t == NUMFMT_DOUBLE ? nrange_extend_double
+       : 0);
+  assert (sc->extend != 0);
+  assert (sc->elt_sz != 0);
+}
+
+/* NB: the histogram is set up with the bins of GEOMETRY, if given */
+static int
+accum_init (struct accum *a, const struct scan *sc,
+            const struct nhist *geometry)
+{
+  a->has_range_p = 0;
+  memset (&(a->min), 0, sizeof (a->min));
+  memset (&(a->max), 0, sizeof (a->max));
+  nstats_init (&(a->stats));
+  a->hist.counts = 0;
+  a->quant.levels = 0;
+  a->quant.items  = 0;
+  a->quant.lens   = 0;
+  a->dn_counts = 0;
+  if (sc->dn_p
+      && (a->dn_counts = calloc ((size_t)1 << (8 * sc->in_sz),
+                                 sizeof (*(a->dn_counts)))) == 0) {
+    /* . */
+    return -1;
+  }
+  if (sc->mode == MODE_QUANT && ! sc->dn_p
+      && nquant_init (&(a->quant), NQUANT_DEFAULT_K) < 0) {
+    /* . */
+    return -1;
+  }
+  if (geometry != 0
+      && nhist_init (&(a->hist), geometry->bins,
+                     geometry->min, geometry->max) < 0) {
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+static void
+accum_free (struct accum *a)
+{
+  nhist_free (&(a->hist));
+  nquant_free (&(a->quant));
+  free (a->dn_counts);
+  a->dn_counts = 0;
+}
+
+/* NB: both should've been initialized with the same SC and
+   GEOMETRY */
+static int
+accum_merge (struct accum *a, const struct accum *other,
+             const struct scan *sc)
+{
+  if (other->has_range_p) {
+    if (! a->has_range_p) {
+      a->has_range_p = 1;
+      a->min = other->min;
+      a->max = other->max;
+    }
+    (*sc->extend) (&(other->min), 1, &(a->min), &(a->max));
+    (*sc->extend) (&(other->max), 1, &(a->min), &(a->max));
+  }
+  nstats_merge (&(a->stats), &(other->stats));
+  if (a->hist.counts != 0) {
+    nhist_merge (&(a->hist), &(other->hist));
+  }
+  if (a->quant.levels > 0
+      && nquant_merge (&(a->quant), &(other->quant)) < 0) {
+    /* . */
+    return -1;
+  }
+  if (a->dn_counts != 0) {
+    const size_t n = (size_t)1 << (8 * sc->in_sz);
+    size_t i;
+    for (i = 0; i < n; i++) {
+      a->dn_counts[i] += other->dn_counts[i];
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
+/* NB: RAW holds COUNT elements in the input format, no more than
+   DECODE_SZ of them if they're to be decoded */
+static void
+accum_add_part (struct accum *a, const struct scan *sc,
+                const void *raw, size_t count)
+{
+  double dbuf[DECODE_SZ];
+  const char *buf = sc->decode_p ? (const char *)dbuf : raw;
+
+  assert (count <= DECODE_SZ || ! sc->decode_p);
+
+  if (sc->dn_p) {
+    if (sc->in_sz == 1) {
+      nhist_count_8  (a->dn_counts, raw, count);
+    } else {
+      nhist_count_16 (a->dn_counts, raw, count);
+    }
+    /* . */
+    return;
+  }
+  if (sc->decode_p) {
+    numfmt_to_doubles (dbuf, raw, count, sc->fmt);
+  }
+  if (sc->mode != MODE_RANGE) {
+    const size_t kept
+      = compact_doubles (dbuf, count, 0, sc->ignore);
+    switch (sc->mode) {
+    case MODE_STATS:
+      a->stats.ignored_count += count - kept;
+      nstats_add_doubles (&(a->stats), dbuf, kept);
+      break;
+    case MODE_HIST:
+      nhist_add_doubles (&(a->hist), dbuf, kept);
+      break;
+    case MODE_QUANT:
+      if (nquant_add_doubles (&(a->quant), dbuf, kept) < 0) {
+        error (1, errno, _("updating the quantile sketch"));
+      }
+      break;
+    default:
+      /* NB: shouldn't happen */
+      assert (0);
+    }
+    /* . */
+    return;
+  }
+  if (sc->decode_p) {
+    count = compact_doubles (dbuf, count, 1, sc->ignore);
+  }
+  if (! a->has_range_p) {
+    const size_t skip = leading_nans (buf, count, sc->t);
+    buf   += skip * sc->elt_sz;
+    count -= skip;
+    if (count == 0) {
+      /* . */
+      return;
+    }
+    a->has_range_p = 1;
+    memcpy (&(a->min), buf, sc->elt_sz);
+    memcpy (&(a->max), buf, sc->elt_sz);
+  }
+  (*sc->extend) (buf, count, &(a->min), &(a->max));
+}
+
+static void
+accum_add (struct accum *a, const struct scan *sc,
+           const void *raw, size_t count)
+{
+  const size_t part = (sc->decode_p ? DECODE_SZ : count);
+  const char *p = raw;
+  size_t rest;
+
+  for (rest = count; rest > 0; ) {
+    const size_t n = MIN (rest, part);
+    accum_add_part (a, sc, p, n);
+    p    += n * sc->in_sz;
+    rest -= n;
+  }
+}
+
+/* NB: COUNT zero elements (as in a hole of a sparse file) are added
+   at once */
+static void
+accum_add_zeros (struct accum *a, const struct scan *sc, uint64_t count)
+{
+  const union numfmt_value zero = { .u64 = 0 };
+  const void *src = &zero;
+  double v;
+
+  if (count == 0) {
+    /* . */
+    return;
+  }
+  if (sc->dn_p) {
+    a->dn_counts[0] += count;
+    /* . */
+    return;
+  }
+  if (sc->decode_p) {
+    numfmt_to_doubles (&v, &zero, 1, sc->fmt);
+    if (sc->ignore != 0 && v == *(sc->ignore)) {
+      a->stats.ignored_count += count;
+      /* . */
+      return;
+    }
+    switch (sc->mode) {
+    case MODE_STATS:
+      nstats_add_repeated (&(a->stats), v, count);
+      /* . */
+      return;
+    case MODE_HIST:
+      nhist_add_weighted (&(a->hist), &v, &count, 1);
+      /* . */
+      return;
+    case MODE_QUANT:
+      if (nquant_add_repeated (&(a->quant), v, count) < 0) {
+        error (1, errno, _("updating the quantile sketch"));
+      }
+      /* . */
+      return;
+    default:
+      break;
+    }
+    if (isnan (v)) {
+      /* . */
+      return;
+    }
+    src = &v;
+  }
+  if (! a->has_range_p) {
+    a->has_range_p = 1;
+    memcpy (&(a->min), src, sc->elt_sz);
+    memcpy (&(a->max), src, sc->elt_sz);
+  }
+  (*sc->extend) (src, 1, &(a->min), &(a->max));
+}
+
+/*** Records */
+
+/* NB: the data is a sequence of records of COUNT components, each of
+   its own format; there's an accumulator for each of the components */
+struct record {
+  size_t count;
+  struct scan *sc;
+  /* the offsets of the components, and the size of the record */
+  size_t *offsets;
+  size_t size;
+};
+
+static void
+record_init (struct record *rec, const struct numfmt *fmts,
+             size_t count, const double *ignore, enum mode mode)
+{
+  size_t i;
+
+  rec->count = count;
+  if (MALLOC_ARY (rec->sc, count) == 0
+      || MALLOC_ARY (rec->offsets, count) == 0) {
+    error (1, errno, _("allocating the record layout"));
+  }
+  for (i = 0, rec->size = 0; i < count; i++) {
+    scan_init (rec->sc + i, fmts + i, ignore, mode);
+    rec->offsets[i] = rec->size;
+    rec->size += rec->sc[i].in_sz;
+  }
+}
+
+static void
+record_free (struct record *rec)
+{
+  free (rec->sc);
+  free (rec->offsets);
+}
+
+/* NB: GEOMETRY, if given, is one per component; the DN's counted are
+   binned at the end instead */
+static int
+accums_init (struct accum *a, const struct record *rec,
+             const struct nhist *geometry)
+{
+  size_t i;
+  for (i = 0; i < rec->count; i++) {
+    const int bin_p = (geometry != 0 && ! rec->sc[i].dn_p);
+    if (accum_init (a + i, rec->sc + i,
+                    bin_p ? geometry + i : 0) < 0) {
+      /* . */
+      return -1;
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
+static void
+accums_free (struct accum *a, const struct record *rec)
+{
+  size_t i;
+  for (i = 0; i < rec->count; i++) {
+    accum_free (a + i);
+  }
+}
+
+static int
+accums_merge (struct accum *a, const struct accum *other,
+              const struct record *rec)
+{
+  size_t i;
+  for (i = 0; i < rec->count; i++) {
+    if (accum_merge (a + i, other + i, rec->sc + i) < 0) {
+      /* . */
+      return -1;
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
+/* NB: the components are gathered from the records with the strided
+   loops specialized for the sizes of the types */
+#define GATHER(type, dst, src, stride, count) \
+    { \
+      type *d = (type *)(dst); \
+      const char *s = (src); \
+      size_t j; \
+      for (j = 0; j < (count); j++, s += (stride)) { \
+        memcpy (d + j, s, sizeof (type)); \
+      } \
+    }
+
+static void
+accums_add_zeros (struct accum *a, const struct record *rec,
+                  uint64_t count)
+{
+  size_t i;
+  for (i = 0; i < rec->count; i++) {
+    accum_add_zeros (a + i, rec->sc + i, count);
+  }
+}
+
+/* NB: RAW holds COUNT records */
+static void
+accums_add (struct accum *a, const struct record *rec,
+            const void *raw, size_t count)
+{
+  size_t i;
+
+  if (rec->count == 1) {
+    accum_add (a, rec->sc, raw, count);
+    /* . */
+    return;
+  }
+  for (i = 0; i < rec->count; i++) {
+    const struct scan *sc = rec->sc + i;
+    const char *src = (const char *)raw + rec->offsets[i];
+    size_t rest;
+    for (rest = count; rest > 0; ) {
+      const size_t n = MIN (rest, DECODE_SZ);
+      uint64_t comp[DECODE_SZ];
+      switch (sc->in_sz) {
+      case 1: GATHER (uint8_t,  comp, src, rec->size, n); break;
+      case 2: GATHER (uint16_t, comp, src, rec->size, n); break;
+      case 4: GATHER (uint32_t, comp, src, rec->size, n); break;
+      case 8: GATHER (uint64_t, comp, src, rec->size, n); break;
+      default:
+        /* NB: shouldn't happen */
+        assert (0);
+      }
+      accum_add (a + i, sc, comp, n);
+      src  += n * rec->size;
+      rest -= n;
+    }
+  }
+}
+
+/*** Reading */
+
+struct scan_arg {
+  struct accum *a;
+  const struct record *rec;
+};
+
+static void
+scan_data (void *param, const void *raw, size_t count)
+{
+  const struct scan_arg *sa = param;
+  accums_add (sa->a, sa->rec, raw, count);
+}
+
+static void
+scan_zeros (void *param, off_t count)
+{
+  const struct scan_arg *sa = param;
+  accums_add_zeros (sa->a, sa->rec, count);
+}
+
+static void
+scan_file (struct accum *a, const struct record *rec,
+           const char *name, int verbose_p)
+{
+  const size_t buf_recs = MAX (BUF_SZ / rec->size, 1);
+  char raw[buf_recs * rec->size];
+  struct scan_arg sa = { a, rec };
+  FILE *fp;
+  int r;
+
+  if ((fp = open_file (name, 1)) == 0) {
+    error (1, errno, "%s", name);
+  }
+  if (verbose_p) {
+    if (fp == stdin)
+      fputs (_("processing standard input...\n"), stderr);
+    else
+      fprintf (stderr, _("processing `%s'...\n"), name);
+  }
+  r = rp_read_stream (fp, raw, buf_recs, rec->size, scan_data, &sa);
+  if (r > 0) {
+    error (1, 0, _("%s: EOF in the middle of the record"), name);
+  } else if (r < 0) {
+    error (1, errno, "%s", name);
+  }
+  close_file (fp);
+}
+
+static void
+scan_part (struct accum *a, const struct record *rec,
+           const char *name, off_t offset, off_t length)
+{
+  const size_t buf_recs = MAX (BUF_SZ / rec->size, 1);
+  char raw[buf_recs * rec->size];
+  struct scan_arg sa = { a, rec };
+
+  if (rp_read_part (name, offset, length, raw, buf_recs, rec->size,
+                    scan_data, scan_zeros, &sa) < 0) {
+    error (1, errno, "%s", name);
+  }
+}
+
+/*** Parallel scanning */
+
+/* NB: either the FRACTION of the blocks of each file, or the number
+   of the BLOCKS, is read; the statistics are collected as well */
+struct sampling {
+  double fraction;
+  size_t blocks;
+  uint64_t rng;
+  size_t blocks_read;
+  off_t bytes_read, bytes_total;
+};
+
+/* NB: the workers take the units in order; the results are merged
+   into those of the file, or into the only one */
+struct pool {
+  const struct record *rec;
+  const char **names;
+  const struct nhist *geometry;
+  struct rp_units units;
+  size_t next;
+  struct accum *results;
+  int per_file_p;
+  int verbose_p;
+  pthread_mutex_t lock;
+};
+
+static void *
+pool_worker (void *arg)
+{
+  struct pool *pl = arg;
+
+  for (;;) {
+    struct accum a[pl->rec->count];
+    const struct rp_unit *u;
+    pthread_mutex_lock (&(pl->lock));
+    u = (pl->next < pl->units.count) ? pl->units.s + (pl->next++) : 0;
+    pthread_mutex_unlock (&(pl->lock));
+    if (u == 0) {
+      break;
+    }
+    if (accums_init (a, pl->rec, pl->geometry) < 0) {
+      error (1, errno, _("allocating the counts"));
+    }
+    if (u->stream_p) {
+      scan_file (a, pl->rec, pl->names[u->file], pl->verbose_p);
+    } else {
+      if (pl->verbose_p && u->first_p) {
+        fprintf (stderr, _("processing `%s'...\n"),
+                 pl->names[u->file]);
+      }
+      scan_part (a, pl->rec, pl->names[u->file],
+                 u->offset, u->length);
+    }
+    pthread_mutex_lock (&(pl->lock));
+    if (accums_merge (pl->results
+                      + (pl->per_file_p ? u->file : 0) * pl->rec->count,
+                      a, pl->rec) < 0) {
+      error (1, errno, _("merging the results"));
+    }
+    pthread_mutex_unlock (&(pl->lock));
+    accums_free (a, pl->rec);
+  }
+
+  /* . */
+  return 0;
+}
+
+static struct rp_unit *
+pool_new_unit (struct pool *pl)
+{
+  struct rp_unit *u;
+
+  if ((u = rp_units_new (&(pl->units))) == 0) {
+    error (1, errno, _("allocating the work units"));
+  }
+
+  /* . */
+  return u;
+}
+
+/* NB: the blocks chosen are the same for each pass */
+static void
+sampling_reset (struct sampling *smp)
+{
+  smp->rng = UINT64_C (0x9e3779b97f4a7c15);
+  smp->blocks_read = 0;
+  smp->bytes_read = smp->bytes_total = 0;
+}
+
+/* NB: xorshift64* */
+static uint64_t
+sampling_random (struct sampling *smp)
+{
+  smp->rng ^= smp->rng >> 12;
+  smp->rng ^= smp->rng << 25;
+  smp->rng ^= smp->rng >> 27;
+  /* . */
+  return smp->rng * UINT64_C (2685821657736338717);
+}
+
+/* NB: the file of RECS records is divided into SAMPLED strata of
+   (about) the same number of blocks, and a block is chosen at random
+   from each; return the number of blocks chosen */
+static size_t
+pool_add_samples (struct pool *pl, size_t file,
+                  off_t recs, const struct record *rec,
+                  struct sampling *smp)
+{
+  const off_t blk_recs = MAX (BUF_SZ / rec->size, 1);
+  const off_t blocks = (recs + blk_recs - 1) / blk_recs;
+  off_t sampled
+    = (smp->fraction > 0 ? (off_t)ceil (smp->fraction * blocks)
+       : (off_t)smp->blocks);
+  off_t k;
+
+  sampled = MIN (sampled, blocks);
+  for (k = 0; k < sampled; k++) {
+    const off_t from = blocks * k / sampled;
+    const off_t to   = blocks * (k + 1) / sampled;
+    const off_t blk  = from + sampling_random (smp) % (to - from);
+    struct rp_unit *u = pool_new_unit (pl);
+    u->file     = file;
+    u->stream_p = 0;
+    u->first_p  = (k == 0);
+    u->offset   = blk * blk_recs * rec->size;
+    u->length   = MIN (blk_recs, recs - blk * blk_recs) * rec->size;
+    smp->bytes_read += u->length;
+  }
+
+  /* . */
+  return sampled;
+}
+
+/* NB: the regular files are split into up to JOBS parts each, or the
+   blocks are sampled from them */
+static void
+pool_add_units (struct pool *pl, const struct record *rec,
+                const char **names, size_t count, size_t jobs,
+                struct sampling *smp)
+{
+  size_t i;
+
+  pl->units.count = pl->units.alloc = 0;
+  pl->units.s = 0;
+  for (i = 0; i < count; i++) {
+    off_t recs;
+    const int r = rp_units_add (&(pl->units), i, names[i], rec->size,
+                                (smp != 0 ? 0 : jobs), &recs);
+    if (r > 0) {
+      error (1, 0, _("%s: EOF in the middle of the record"), names[i]);
+    } else if (r < 0) {
+      error (1, errno, "%s", names[i]);
+    }
+    if (smp != 0 && recs >= 0) {
+      smp->bytes_total += recs * rec->size;
+      smp->blocks_read += pool_add_samples (pl, i, recs, rec, smp);
+    }
+  }
+  pl->next = 0;
+}
+
+/* NB: RESULTS are either one per file, or just one, each being an
+   array of the accumulators of the components */
+static void
+scan_files (struct accum *results, const struct record *rec,
+            const struct nhist *geometry,
+            const struct strings *names, size_t jobs,
+            struct sampling *smp, int per_file_p, int verbose_p)
+{
+  struct pool pl;
+  size_t i, threads;
+
+  pl.rec        = rec;
+  pl.names      = names->s;
+  pl.geometry   = geometry;
+  pl.results    = results;
+  pl.per_file_p = per_file_p;
+  pl.verbose_p  = verbose_p;
+  pthread_mutex_init (&(pl.lock), 0);
+  pool_add_units (&pl, rec, names->s, names->size, jobs, smp);
+
+  threads = MIN (jobs, pl.units.count);
+  if (threads <= 1) {
+    pool_worker (&pl);
+  } else {
+    pthread_t tids[threads];
+    for (i = 0; i < threads; i++) {
+      if ((errno = pthread_create (tids + i, 0, pool_worker, &pl))
+          != 0) {
+        error (1, errno, _("creating a worker thread"));
+      }
+    }
+    for (i = 0; i < threads; i++) {
+      pthread_join (tids[i], 0);
+    }
+  }
+  pthread_mutex_destroy (&(pl.lock));
+  free (pl.units.s);
+}
+
+/*** Zone maps */
+
+/* NB: the NaN's, including the fill values */
+static uint64_t
+count_nans (const void *raw, size_t count, const struct numfmt *fmt)
+{
+  const size_t sz = numfmt_size (fmt);
+  double dbuf[256];
+  uint64_t nans = 0;
+  size_t i, j, n;
+
+  if (! fmt->fill_p
+      && fmt->type != NUMFMT_FLOAT && fmt->type != NUMFMT_DOUBLE) {
+    /* . */
+    return 0;
+  }
+  for (i = 0; i < count; i += n) {
+    n = MIN (count - i, sizeof (dbuf) / sizeof (*dbuf));
+    numfmt_to_doubles (dbuf, (const char *)raw + i * sz, n, fmt);
+    for (j = 0; j < n; j++) {
+      nans += (isnan (dbuf[j]) != 0);
+    }
+  }
+
+  /* . */
+  return nans;
+}
+
+/* NB: SC is that of MODE_RANGE, so that the ranges of the blocks are
+   of the type zmap_type () tells */
+static void
+build_index (const char *name, const struct scan *sc, size_t block,
+             int verbose_p)
+{
+  const size_t chunk = MAX (BUF_SZ / sc->in_sz, 1);
+  char raw[chunk * sc->in_sz];
+  struct zmap z;
+  struct stat st;
+  size_t i;
+  FILE *fp;
+
+  if (zmap_init (&z, name, sc->fmt, block) < 0
+      || (fp = fopen (name, "rb")) == 0) {
+    error (1, errno, "%s", name);
+  }
+  assert (zmap_type (sc->fmt) == sc->t);
+  if (verbose_p) {
+    fprintf (stderr, _("indexing `%s'...\n"), name);
+  }
+  for (i = 0; i < z.count; i++) {
+    struct zmap_block *b = z.blocks + i;
+    uint64_t left = zmap_block_length (&z, i);
+    struct accum a;
+    accum_init (&a, sc, 0);
+    while (left > 0) {
+      const size_t n = MIN (left, (uint64_t)chunk);
+      if (fread (raw, sc->in_sz, n, fp) != n) {
+        error (1, ferror (fp) ? errno : 0,
+               _("%s: the file was truncated while indexed"), name);
+      }
+      accum_add (&a, sc, raw, n);
+      b->nan_count += count_nans (raw, n, sc->fmt);
+      left -= n;
+    }
+    if (a.has_range_p) {
+      b->min = a.min;
+      b->max = a.max;
+    }
+    accum_free (&a);
+  }
+  fclose (fp);
+
+  /* NB: the map is useless if the file's changed in the meantime */
+  if (stat (name, &st) != 0) {
+    error (1, errno, "%s", name);
+  }
+  if ((uint64_t)st.st_size != z.size
+      || st.st_mtim.tv_sec  != z.mtime_s
+      || st.st_mtim.tv_nsec != z.mtime_ns) {
+    error (1, 0, _("%s: the file was changed while indexed"), name);
+  }
+  if (zmap_store (&z, name) < 0) {
+    error (1, errno, _("%s: writing the zone map"), name);
+  }
+  zmap_free (&z);
+}
+
+/* NB: the range is merged from the zone map of the file, if there's a
+   valid one */
+static int
+range_from_index (struct accum *a, const struct scan *sc,
+                  const char *name)
+{
+  struct accum v;
+  struct zmap z;
+  size_t i;
+
+  if (strcmp (name, "-") == 0 || zmap_load (&z, name, sc->fmt) <= 0) {
+    /* . */
+    return -1;
+  }
+  assert (z.t == sc->t);
+  accum_init (&v, sc, 0);
+  for (i = 0; i < z.count; i++) {
+    const struct zmap_block *b = z.blocks + i;
+    if (b->nan_count >= zmap_block_length (&z, i)) {
+      continue;
+    }
+    if (! v.has_range_p) {
+      v.has_range_p = 1;
+      v.min = b->min;
+      v.max = b->max;
+    }
+    (*sc->extend) (&(b->min), 1, &(v.min), &(v.max));
+    (*sc->extend) (&(b->max), 1, &(v.min), &(v.max));
+  }
+  accum_merge (a, &v, sc);
+  accum_free (&v);
+  zmap_free (&z);
+
+  /* . */
+  return 0;
+}
+
+/*** Caching */
+
+/* NB: everything the results depend upon, save for the data */
+static char *
+cache_config (const struct record *rec, const struct nhist *geometry)
+{
+  const struct scan *sc0 = rec->sc;
+  char *s = 0;
+  size_t len, i, j;
+  FILE *fp;
+
+  if ((fp = open_memstream (&s, &len)) == 0) {
+    error (1, errno, _("allocating the cache key"));
+  }
+  fprintf (fp, "rawrange 1 mode %d k %d",
+           (int)sc0->mode, NQUANT_DEFAULT_K);
+  if (sc0->ignore != 0) {
+    fprintf (fp, " ignore %a", *(sc0->ignore));
+  }
+  for (i = 0; i < rec->count; i++) {
+    const struct scan *sc = rec->sc + i;
+    const struct numfmt *fmt = sc->fmt;
+    const unsigned char *fill = (const unsigned char *)&(fmt->fill);
+    fprintf (fp, "\n%s", numfmt_type_names[fmt->type]);
+    if (fmt->packed_p) {
+      fprintf (fp, ":%a:%a", fmt->scale, fmt->offset);
+    }
+    if (fmt->fill_p) {
+      fputs (" fill ", fp);
+      for (j = 0; j < sc->in_sz; j++) {
+        fprintf (fp, "%02x", fill[j]);
+      }
+    }
+    if (geometry != 0 && ! sc->dn_p) {
+      fprintf (fp, " bins %zu %a %a",
+               geometry[i].bins, geometry[i].min, geometry[i].max);
+    }
+  }
+  if (fclose (fp) != 0) {
+    error (1, errno, _("allocating the cache key"));
+  }
+
+  /* . */
+  return s;
+}
+
+/* NB: all the fields are of 8 bytes, so that the arrays within the
+   data (as loaded) are aligned */
+static void
+accum_encode (FILE *fp, const struct accum *a, const struct scan *sc)
+{
+  const uint64_t has_range = a->has_range_p;
+
+  fwrite (&has_range, sizeof (has_range), 1, fp);
+  fwrite (&(a->min), sizeof (a->min), 1, fp);
+  fwrite (&(a->max), sizeof (a->max), 1, fp);
+  fwrite (&(a->stats), sizeof (a->stats), 1, fp);
+  if (a->hist.counts != 0) {
+    fwrite (a->hist.counts, sizeof (uint64_t), a->hist.bins + 3, fp);
+  }
+  if (sc->mode == MODE_QUANT && ! sc->dn_p) {
+    const struct nquant *q = &(a->quant);
+    const uint64_t levels = q->levels;
+    size_t h;
+    fwrite (&levels, sizeof (levels), 1, fp);
+    fwrite (&(q->count), sizeof (q->count), 1, fp);
+    fwrite (&(q->rng), sizeof (q->rng), 1, fp);
+    for (h = 0; h < q->levels; h++) {
+      const uint64_t len = q->lens[h];
+      fwrite (&len, sizeof (len), 1, fp);
+    }
+    for (h = 0; h < q->levels; h++) {
+      fwrite (q->items[h], sizeof (double), q->lens[h], fp);
+    }
+  }
+  if (a->dn_counts != 0) {
+    fwrite (a->dn_counts, sizeof (uint64_t),
+            (size_t)1 << (8 * sc->in_sz), fp);
+  }
+}
+
+struct cursor {
+  const char *p;
+  size_t left;
 };
 
-const char *format_opts[] = {
-  [FORMAT_UINT8]  = "uint8",
-  [FORMAT_UINT16] = "uint16",
-  [FORMAT_UINT32] = "uint32",
-  [FORMAT_UINT64] = "uint64",
-  [FORMAT_INT8]   = "int8",
-  [FORMAT_INT16]  = "int16",
-  [FORMAT_INT32]  = "int32",
-  [FORMAT_INT64]  = "int64",
-  [FORMAT_FLOAT]  = "float",
-  [FORMAT_DOUBLE] = "double",
-  [FORMAT_MAX]    = 0
+static const void *
+cursor_take (struct cursor *cur, size_t size)
+{
+  const char *p = cur->p;
+  if (size > cur->left) {
+    /* . */
+    return 0;
+  }
+  cur->p    += size;
+  cur->left -= size;
+
+  /* . */
+  return p;
+}
+
+/* NB: V is made to point into the data; A tells the histogram bins */
+static int
+accum_view (struct accum *v, const struct accum *a,
+            const struct scan *sc, struct cursor *cur)
+{
+  const uint64_t *u;
+  const void *p;
+
+  v->hist.counts  = 0;
+  v->quant.levels = 0;
+  v->quant.items  = 0;
+  v->quant.lens   = 0;
+  v->dn_counts    = 0;
+  if ((u = cursor_take (cur, sizeof (*u))) == 0) {
+    /* . */
+    return -1;
+  }
+  v->has_range_p = (*u != 0);
+  if ((p = cursor_take (cur, sizeof (v->min))) == 0) {
+    /* . */
+    return -1;
+  }
+  memcpy (&(v->min), p, sizeof (v->min));
+  if ((p = cursor_take (cur, sizeof (v->max))) == 0) {
+    /* . */
+    return -1;
+  }
+  memcpy (&(v->max), p, sizeof (v->max));
+  if ((p = cursor_take (cur, sizeof (v->stats))) == 0) {
+    /* . */
+    return -1;
+  }
+  memcpy (&(v->stats), p, sizeof (v->stats));
+  if (a->hist.counts != 0) {
+    v->hist = a->hist;
+    if ((v->hist.counts
+         = (uint64_t *)cursor_take (cur, ((a->hist.bins + 3)
+                                          * sizeof (uint64_t))))
+        == 0) {
+      /* . */
+      return -1;
+    }
+  }
+  if (sc->mode == MODE_QUANT && ! sc->dn_p) {
+    struct nquant *q = &(v->quant);
+    const uint64_t *lens;
+    size_t h, levels;
+    if ((u = cursor_take (cur, 3 * sizeof (*u))) == 0
+        || u[0] > 64
+        || (lens = cursor_take (cur, u[0] * sizeof (*u))) == 0) {
+      /* . */
+      return -1;
+    }
+    levels   = u[0];
+    q->k     = a->quant.k;
+    q->count = u[1];
+    q->rng   = u[2];
+    if (MALLOC_ARY (q->items, levels + 1) == 0
+        || MALLOC_ARY (q->lens, levels + 1) == 0) {
+      /* . */
+      return -1;
+    }
+    for (h = 0; h < levels; h++) {
+      /* NB: the levels are always compacted */
+      if (lens[h] >= q->k
+          || ((q->items[h]
+               = (double *)cursor_take (cur, (lens[h]
+                                              * sizeof (double))))
+              == 0)) {
+        /* . */
+        return -1;
+      }
+      q->lens[h] = lens[h];
+    }
+    q->levels = levels;
+  }
+  if (a->dn_counts != 0
+      && (v->dn_counts
+          = (uint64_t *)cursor_take (cur, (sizeof (uint64_t)
+                                           << (8 * sc->in_sz))))
+      == 0) {
+    /* . */
+    return -1;
+  }
+
+  /* . */
+  return 0;
+}
+
+/* NB: nothing is merged unless the whole of the data is valid */
+static int
+accums_decode (struct accum *a, const struct record *rec,
+               const void *data, size_t size)
+{
+  struct accum views[rec->count];
+  struct cursor cur = { data, size };
+  size_t i, n;
+  int r = 0;
+
+  for (n = 0; n < rec->count; n++) {
+    if ((r = accum_view (views + n, a + n, rec->sc + n, &cur)) < 0) {
+      n++;
+      break;
+    }
+  }
+  if (r == 0 && cur.left == 0) {
+    for (i = 0; i < rec->count && r == 0; i++) {
+      r = accum_merge (a + i, views + i, rec->sc + i);
+    }
+  } else {
+    r = -1;
+  }
+  for (i = 0; i < n; i++) {
+    free (views[i].quant.items);
+    free (views[i].quant.lens);
+  }
+
+  /* . */
+  return r;
+}
+
+/* NB: the ranges found with the zone maps (if INDEX_P), and the
+   results found in the cache (if DIR isn't a null pointer) are used as
+   they are; the rest of the files are scanned (as with scan_files ()),
+   and the results cached, unless the files are changed in the
+   meantime */
+static void
+scan_files_cached (struct accum *results, const struct record *rec,
+                   const struct nhist *geometry,
+                   const struct strings *names, size_t jobs,
+                   const char *dir, int index_p,
+                   int per_file_p, int verbose_p)
+{
+  const size_t n = rec->count;
+  char *config = (dir != 0) ? cache_config (rec, geometry) : 0;
+  struct sidecar cache[names->size];
+  int cache_p[names->size];
+  size_t missed_idx[names->size];
+  struct strings missed = { 0, 0, 0 };
+  struct accum *fresh;
+  size_t i, k;
+
+  for (i = 0; i < names->size; i++) {
+    struct accum *dst = results + (per_file_p ? i : 0) * n;
+    void *data;
+    size_t size;
+    cache_p[i] = 0;
+    if (index_p && range_from_index (dst, rec->sc, names->s[i]) == 0) {
+      if (verbose_p) {
+        fprintf (stderr, _("using the zone map of `%s'\n"),
+                 names->s[i]);
+      }
+      continue;
+    }
+    cache_p[i]
+      = (dir != 0
+         && sidecar_init (cache + i, dir, names->s[i], config) == 0);
+    if (cache_p[i] && sidecar_load (cache + i, &data, &size) > 0) {
+      const int r = accums_decode (dst, rec, data, size);
+      free (data);
+      if (r == 0) {
+        if (verbose_p) {
+          fprintf (stderr, _("using the cached result for `%s'\n"),
+                   names->s[i]);
+        }
+        continue;
+      }
+    }
+    missed_idx[missed.size] = i;
+    if (strings_append (&missed, names->s + i, 1) < 0) {
+      error (1, errno, _("allocating the list of files"));
+    }
+  }
+
+  if (missed.size > 0) {
+    if (MALLOC_ARY (fresh, missed.size * n) == 0) {
+      error (1, errno, _("allocating the counts"));
+    }
+    for (k = 0; k < missed.size; k++) {
+      if (accums_init (fresh + k * n, rec, geometry) < 0) {
+        error (1, errno, _("allocating the counts"));
+      }
+    }
+    scan_files (fresh, rec, geometry, &missed, jobs, 0, 1, verbose_p);
+    for (k = 0; k < missed.size; k++) {
+      const size_t i = missed_idx[k];
+      struct accum *a = fresh + k * n;
+      if (cache_p[i] && sidecar_unchanged_p (cache + i)) {
+        char *data = 0;
+        size_t size, c;
+        FILE *fp;
+        if ((fp = open_memstream (&data, &size)) == 0) {
+          error (1, errno, _("allocating the cache entry"));
+        }
+        for (c = 0; c < n; c++) {
+          accum_encode (fp, a + c, rec->sc + c);
+        }
+        if (fclose (fp) != 0) {
+          error (1, errno, _("allocating the cache entry"));
+        }
+        if (sidecar_store (cache + i, data, size) < 0) {
+          error (0, errno, _("couldn't cache the result for `%s'"),
+                 names->s[i]);
+        }
+        free (data);
+      }
+      if (accums_merge (results + (per_file_p ? i : 0) * n,
+                        a, rec) < 0) {
+        error (1, errno, _("merging the results"));
+      }
+      accums_free (a, rec);
+    }
+    free (fresh);
+  }
+
+  for (i = 0; i < names->size; i++) {
+    if (cache_p[i]) {
+      sidecar_free (cache + i);
+    }
+  }
+  strings_clear (&missed);
+  free (config);
+}
+
+/* NB: the values of all the possible DN's, with NaN's for those
+   ignored */
+static void
+dn_values (double *values, const struct scan *sc)
+{
+  const size_t n = (size_t)1 << (8 * sc->in_sz);
+  char dn[n * sc->in_sz];
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (sc->in_sz == 1) {
+      ((uint8_t *)dn)[i]  = i;
+    } else {
+      ((uint16_t *)dn)[i] = i;
+    }
+  }
+  numfmt_to_doubles (values, dn, n, sc->fmt);
+  for (i = 0; i < n; i++) {
+    if (sc->ignore != 0 && values[i] == *(sc->ignore)) {
+      values[i] = NAN;
+    }
+  }
+}
+
+/* NB: fold the DN counts into the histogram */
+static void
+accum_fold_dn_counts (struct accum *a, const struct scan *sc)
+{
+  const size_t n = (size_t)1 << (8 * sc->in_sz);
+  double values[n];
+
+  dn_values (values, sc);
+  nhist_add_weighted (&(a->hist), values, a->dn_counts, n);
+}
+
+/* NB: the (finite) range of the values counted */
+static int
+dn_counts_range (const struct accum *a, const struct scan *sc,
+                 double *min, double *max)
+{
+  const size_t n = (size_t)1 << (8 * sc->in_sz);
+  double values[n];
+  int has_range_p = 0;
+  size_t i;
+
+  dn_values (values, sc);
+  for (i = 0; i < n; i++) {
+    const double v = values[i];
+    if (a->dn_counts[i] == 0 || ! isfinite (v)) {
+      continue;
+    }
+    if (! has_range_p || v < *min) { *min = v; }
+    if (! has_range_p || v > *max) { *max = v; }
+    has_range_p = 1;
+  }
+
+  /* . */
+  return has_range_p;
+}
+
+struct dn_weighted {
+  double value;
+  uint64_t count;
 };
 
+static int
+dn_weighted_cmp (const void *a, const void *b)
+{
+  const double
+    da = ((const struct dn_weighted *)a)->value,
+    db = ((const struct dn_weighted *)b)->value;
+
+  /* . */
+  return (da > db) - (da < db);
+}
+
+/* NB: the exact quantiles of the values counted */
+static void
+dn_counts_quantiles (const struct accum *a, const struct scan *sc,
+                     const double *probs, size_t count,
+                     double *quantiles)
+{
+  const size_t n = (size_t)1 << (8 * sc->in_sz);
+  double values[n];
+  struct dn_weighted *w;
+  uint64_t total;
+  size_t m, i;
+
+  if (MALLOC_ARY (w, n) == 0) {
+    error (1, errno, _("allocating the counts"));
+  }
+  dn_values (values, sc);
+  for (i = 0, m = 0; i < n; i++) {
+    if (a->dn_counts[i] > 0 && ! isnan (values[i])) {
+      w[m].value = values[i];
+      w[m].count = a->dn_counts[i];
+      m++;
+    }
+  }
+  qsort (w, m, sizeof (*w), dn_weighted_cmp);
+  for (i = 1, total = (m > 0 ? w[0].count : 0); i < m; i++) {
+    total = (w[i].count += w[i - 1].count);
+  }
+  for (i = 0; i < count; i++) {
+    const double rank = probs[i] * total;
+    size_t j;
+    for (j = 0; j + 1 < m && w[j].count < rank; j++)
+      ;
+    quantiles[i] = (m > 0) ? w[j].value : NAN;
+  }
+  free (w);
+}
+
+/*** Output */
+
+static void
+print_stats (FILE *fp, const struct nstats *st)
+{
+  const int empty_p = (st->count == 0);
+  fprintf (fp, "count %llu\n", (unsigned long long)st->count);
+  fprintf (fp, "nan %llu\n", (unsigned long long)st->nan_count);
+  fprintf (fp, "+inf %llu\n", (unsigned long long)st->pinf_count);
+  fprintf (fp, "-inf %llu\n", (unsigned long long)st->ninf_count);
+  fprintf (fp, "ignored %llu\n",
+           (unsigned long long)st->ignored_count);
+  fprintf (fp, "min %.*g\n", DBL_DIG, empty_p ? NAN : st->min);
+  fprintf (fp, "max %.*g\n", DBL_DIG, empty_p ? NAN : st->max);
+  fprintf (fp, "sum %.*g\n", DBL_DIG, st->sum);
+  fprintf (fp, "mean %.*g\n", DBL_DIG, empty_p ? NAN : st->mean);
+  fprintf (fp, "variance %.*g\n", DBL_DIG, nstats_variance (st));
+}
+
+/* NB: either the lines of LOWER UPPER COUNT, or the raw counts */
+static void
+print_hist (FILE *fp, const struct nhist *h, int raw_p)
+{
+  size_t i;
+  if (raw_p) {
+    for (i = 0; i < h->bins; i++) {
+      const uint64_t c = nhist_count (h, i);
+      if (fwrite (&c, sizeof (c), 1, fp) != 1) {
+        error (1, errno, _("writing the histogram"));
+      }
+    }
+    /* . */
+    return;
+  }
+  for (i = 0; i < h->bins; i++) {
+    fprintf (fp, "%.*g %.*g %llu\n",
+             DBL_DIG, nhist_lower (h, i),
+             DBL_DIG, nhist_lower (h, i + 1),
+             (unsigned long long)nhist_count (h, i));
+  }
+}
+
+static void
+print_quantiles (FILE *fp, const double *probs, size_t count,
+                 const double *quantiles)
+{
+  size_t i;
+  for (i = 0; i < count; i++) {
+    fprintf (fp, "%g %.*g\n", probs[i], DBL_DIG, quantiles[i]);
+  }
+}
+
+/* NB: a table for rawxform(1), mapping the quantiles to 0 to MAX,
+   linearly in probability; the PROBS are sorted */
+static void
+print_stretch_table (FILE *fp, const double *probs, size_t count,
+                     const double *quantiles, double max,
+                     double error_bound)
+{
+  const double p0 = probs[0], p1 = probs[count - 1];
+  size_t i;
+
+  fprintf (fp, "# rank error within %g (99%%)\n", error_bound);
+  fprintf (fp, "nan 0\n-inf 0\n");
+  for (i = 0; i < count; i++) {
+    /* NB: the bounds should be distinct for the interpolation */
+    if (isnan (quantiles[i])
+        || (i > 0 && quantiles[i] == quantiles[i - 1])) {
+      continue;
+    }
+    fprintf (fp, "%.*g %.*g\n",
+             DBL_DIG, quantiles[i],
+             DBL_DIG, (p1 > p0 ? max * (probs[i] - p0) / (p1 - p0)
+                       : max));
+  }
+}
+
+static void
+print_range (FILE *fp, const struct accum *a, enum numfmt_type t)
+{
+  #define PRINTF_RANGE(fs, dtype, field) \
+      fprintf (fp, "%" fs " %" fs "\n", \
+               (dtype)a->min.field, (dtype)a->max.field)
+  #define PRINTF_INT_RANGE(field) \
+      PRINTF_RANGE ("lld", long long int, field)
+  #define PRINTF_UINT_RANGE(field) \
+      PRINTF_RANGE ("llu", unsigned long long int, field)
+  #define PRINTF_DOUBLE_RANGE(field) \
+      PRINTF_RANGE ("g", double, field)
+  switch (t) {
+  case NUMFMT_INT8:   PRINTF_INT_RANGE    (i8);  break;
+  case NUMFMT_INT16:  PRINTF_INT_RANGE    (i16); break;
+  case NUMFMT_INT32:  PRINTF_INT_RANGE    (i32); break;
+  case NUMFMT_INT64:  PRINTF_INT_RANGE    (i64); break;
+  case NUMFMT_UINT8:  PRINTF_UINT_RANGE   (u8);  break;
+  case NUMFMT_UINT16: PRINTF_UINT_RANGE   (u16); break;
+  case NUMFMT_UINT32: PRINTF_UINT_RANGE   (u32); break;
+  case NUMFMT_UINT64: PRINTF_UINT_RANGE   (u64); break;
+  case NUMFMT_FLOAT:  PRINTF_DOUBLE_RANGE (f);   break;
+  case NUMFMT_DOUBLE: PRINTF_DOUBLE_RANGE (d);   break;
+  default:
+    /* NB: shouldn't happen */
+    assert (0);
+  }
+  #undef PRINTF_RANGE
+  #undef PRINTF_INT_RANGE
+  #undef PRINTF_UINT_RANGE
+  #undef PRINTF_DOUBLE_RANGE
+}
+
 /*** Parsing the Command Line */
 
 const char *
@@ -111,12 +1526,51 @@ const char *argp_program_bug_address = PACKAGE_BUGREPORT;
 void (*argp_program_version_hook)(FILE *, struct argp_state *) = p_vers;
 
 enum opts {
+  opt_build_index = 256,
+  opt_cache,
+  opt_ignore,
+  opt_histogram,
+  opt_no_index,
+  opt_per_file,
+  opt_quantiles,
+  opt_raw_counts,
+  opt_sample,
+  opt_stats,
+  opt_stretch_table,
   opt_max
 };
 
 static struct argp_option p_opts[] = {
-  { "format",           't', "TYPE", 0,
-    N_("select input format") },
+  { "build-index",      opt_build_index, "BLOCK", OPTION_ARG_OPTIONAL,
+    N_("write the zone map (FILE.zmap) for each of the files") },
+  { "cache",            opt_cache, "DIR", 0,
+    N_("keep the results for the files in DIR, and reuse them") },
+  { "components",       'c', "N", 0,
+    N_("treat the data as the records of N components") },
+  { "format",           't', "FORMAT[,FORMAT]...", 0,
+    N_("select input format (of each of the components)") },
+  { "histogram",        opt_histogram, "BINS[:MIN:MAX]", 0,
+    N_("output the histogram of the values") },
+  { "ignore",           opt_ignore, "VALUE", 0,
+    N_("ignore the values equal to VALUE") },
+  { "jobs",             'j', "N", 0,
+    N_("read the files in N threads") },
+  { "no-index",         opt_no_index, 0, 0,
+    N_("don't use the zone maps of the files") },
+  { "per-file",         opt_per_file, 0, 0,
+    N_("report the result for each file separately") },
+  { "quantiles",        opt_quantiles, "P[,P]...", 0,
+    N_("output the (approximate) quantiles of the values") },
+  { "raw-counts",       opt_raw_counts, 0, 0,
+    N_("output the histogram counts as raw uint64") },
+  { "sample",           opt_sample, "FRACTION|BLOCKS", 0,
+    N_("read only the FRACTION (if less than 1 or with a point)"
+       " or the number of the blocks of each file, chosen at random") },
+  { "stats",            opt_stats, 0, 0,
+    N_("report the counts, mean and variance as well") },
+  { "stretch-table",    opt_stretch_table, "MAX", OPTION_ARG_OPTIONAL,
+    N_("output the quantiles as a rawxform(1) table,"
+       " stretching them to 0 to MAX (255 by default)") },
   { "verbose",          'v', 0, 0,
     N_("explain what is being done") },
   { 0 }
@@ -124,28 +1578,268 @@ static struct argp_option p_opts[] = {
 
 struct p_args {
   int verbose_p;
-  int format;
+  size_t jobs;
+  int per_file_p;
+  size_t components;
+  struct numfmt *formats;
+  size_t formats_count;
+  int ignore_p;
+  double ignore;
+  enum mode mode;
+  size_t hist_bins;
+  int hist_range_p;
+  double hist_min, hist_max;
+  int raw_counts_p;
+  double *probs;
+  size_t probs_count;
+  int stretch_p;
+  double stretch_max;
+  int sample_p;
+  struct sampling sampling;
+  const char *cache_dir;
+  int build_index_p;
+  size_t index_block;
+  int no_index_p;
   struct strings files;
 };
 
+/* NB: the modes are mutually exclusive */
+static int
+set_mode (struct argp_state *state, struct p_args *args,
+          enum mode mode)
+{
+  if (args->mode != MODE_RANGE && args->mode != mode) {
+    argp_error (state,
+                N_("`--stats', `--histogram' and `--quantiles'"
+                   " are mutually exclusive"));
+    /* . */
+    return -1;
+  }
+  args->mode = mode;
+
+  /* . */
+  return 0;
+}
+
+/* NB: BINS[:MIN:MAX] */
+static int
+parse_histogram (struct p_args *args, const char *arg)
+{
+  char s[1 + strlen (arg)];
+  char *min_s, *max_s;
+  long bins;
+
+  strcpy (s, arg);
+  if ((min_s = strchr (s, ':')) != 0) {
+    *(min_s++) = '\0';
+    if ((max_s = strchr (min_s, ':')) == 0) {
+      /* . */
+      return -1;
+    }
+    *(max_s++) = '\0';
+  }
+  if (p_arg_long (s, &bins) < 0 || bins < 1
+      || (min_s != 0
+          && (p_arg_double (min_s, &(args->hist_min)) < 0
+              || p_arg_double (max_s, &(args->hist_max)) < 0
+              || ! (args->hist_min <= args->hist_max)))) {
+    /* . */
+    return -1;
+  }
+  args->hist_bins    = bins;
+  args->hist_range_p = (min_s != 0);
+
+  /* . */
+  return 0;
+}
+
+static int
+double_cmp (const void *a, const void *b)
+{
+  const double da = *((const double *)a), db = *((const double *)b);
+
+  /* . */
+  return (da > db) - (da < db);
+}
+
+/* NB: P[,P]..., sorted */
+static int
+parse_quantiles (struct p_args *args, const char *arg)
+{
+  char s[1 + strlen (arg)];
+  char *p, *save;
+  size_t n;
+
+  strcpy (s, arg);
+  for (n = 1, p = s; *p != '\0'; p++) {
+    n += (*p == ',');
+  }
+  if (MALLOC_ARY (args->probs, n) == 0) {
+    /* . */
+    return -1;
+  }
+  for (n = 0, p = strtok_r (s, ",", &save);
+       p != 0;
+       n++, p = strtok_r (0, ",", &save)) {
+    double *v = args->probs + n;
+    if (p_arg_double (p, v) < 0 || ! (*v >= 0 && *v <= 1)) {
+      errno = EINVAL;
+      /* . */
+      return -1;
+    }
+  }
+  if (n == 0) {
+    errno = EINVAL;
+    /* . */
+    return -1;
+  }
+  qsort (args->probs, n, sizeof (*(args->probs)), double_cmp);
+  args->probs_count = n;
+
+  /* . */
+  return 0;
+}
+
 static error_t
 p_opt (int key, char *arg, struct argp_state *state)
 {
   struct p_args *args = state->input;
 
   switch (key) {
+  case opt_build_index:
+    {
+      long n = ZMAP_DEFAULT_BLOCK;
+      if (arg != 0 && (p_arg_long (arg, &n) < 0 || n < 1)) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--build-index'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->build_index_p = 1;
+      args->index_block   = n;
+    }
+    break;
+  case opt_cache:
+    args->cache_dir = arg;
+    break;
   case 't':
+    if (numfmt_parse_list (&(args->formats),
+                           &(args->formats_count), arg) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--format'"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
+    break;
+  case opt_histogram:
+    if (parse_histogram (args, arg) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--histogram'"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
+    if (set_mode (state, args, MODE_HIST) < 0) {
+      /* . */
+      return EINVAL;
+    }
+    break;
+  case opt_ignore:
+    if (p_arg_double (arg, &(args->ignore)) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--ignore'"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
+    args->ignore_p = 1;
+    break;
+  case opt_quantiles:
+    if (parse_quantiles (args, arg) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--quantiles'"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
+    if (set_mode (state, args, MODE_QUANT) < 0) {
+      /* . */
+      return EINVAL;
+    }
+    break;
+  case 'c':
+    {
+      long n;
+      if (p_arg_long (arg, &n) < 0 || n < 1) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--components'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->components = n;
+    }
+    break;
+  case 'j':
+    {
+      long n;
+      if (p_arg_long (arg, &n) < 0 || n < 1) {
+        argp_error (state,
+                    N_("invalid argument `%s' for `--jobs'"),
+                    arg);
+        /* . */
+        return EINVAL;
+      }
+      args->jobs = n;
+    }
+    break;
+  case opt_no_index:
+    args->no_index_p = 1;
+    break;
+  case opt_per_file:
+    args->per_file_p = 1;
+    break;
+  case opt_raw_counts:
+    args->raw_counts_p = 1;
+    break;
+  case opt_sample:
     {
-      int i;
-      if ((i = p_arg_string (arg, format_opts, 0)) < 0) {
+      double v;
+      if (p_arg_double (arg, &v) < 0 || ! (v > 0)
+          || (strchr (arg, '.') == 0 && v >= 1 && v != floor (v))) {
         argp_error (state,
-                    N_("invalid argument `%s' for `--format'"),
+                    N_("invalid argument `%s' for `--sample'"),
                     arg);
         /* . */
         return EINVAL;
       }
-      args->format = i;
+      if (v < 1 || strchr (arg, '.') != 0) {
+        args->sampling.fraction = MIN (v, 1);
+        args->sampling.blocks   = 0;
+      } else {
+        args->sampling.fraction = 0;
+        args->sampling.blocks   = v;
+      }
+      args->sample_p = 1;
+    }
+    break;
+  case opt_stats:
+    if (set_mode (state, args, MODE_STATS) < 0) {
+      /* . */
+      return EINVAL;
+    }
+    break;
+  case opt_stretch_table:
+    if (arg != 0 && p_arg_double (arg, &(args->stretch_max)) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--stretch-table'"),
+                  arg);
+      /* . */
+      return EINVAL;
     }
+    args->stretch_p = 1;
     break;
   case 'v':
     args->verbose_p = 1;
@@ -172,6 +1866,41 @@ p_opt (int key, char *arg, struct argp_state *state)
     }
     break;
   case ARGP_KEY_END:
+    if (args->formats_count == 0) {
+      static struct numfmt uint8 = { NUMFMT_UINT8, 0, 1, 0 };
+      args->formats = &uint8;
+      args->formats_count = 1;
+    }
+    if (args->components == 0) {
+      args->components = args->formats_count;
+    } else if (args->components < args->formats_count) {
+      argp_error (state,
+                  N_("more formats given than there're components"));
+      /* . */
+      return EINVAL;
+    }
+    if (args->build_index_p
+        && (args->mode != MODE_RANGE || args->components != 1
+            || args->ignore_p || args->sample_p)) {
+      argp_error (state,
+                  N_("`--build-index' requires the data of a single"
+                     " component, and no other mode, `--ignore' or"
+                     " `--sample'"));
+      /* . */
+      return EINVAL;
+    }
+    if (args->cache_dir != 0 && args->sample_p) {
+      argp_error (state,
+                  N_("`--cache' and `--sample' are mutually exclusive"));
+      /* . */
+      return EINVAL;
+    }
+    if (args->stretch_p && args->mode != MODE_QUANT) {
+      argp_error (state,
+                  N_("`--stretch-table' requires `--quantiles'"));
+      /* . */
+      return EINVAL;
+    }
     break;
   default:
     /* . */
@@ -183,6 +1912,89 @@ p_opt (int key, char *arg, struct argp_state *state)
   return 0;
 }
 
+/*** Output of the results */
+
+static void
+print_result (FILE *output, const struct accum *acc,
+              const struct scan *sc, const struct p_args *args)
+{
+  switch (sc->mode) {
+  case MODE_STATS:
+    print_stats (output, &(acc->stats));
+    break;
+  case MODE_HIST:
+    print_hist (output, &(acc->hist), args->raw_counts_p);
+    break;
+  case MODE_QUANT:
+    {
+      /* NB: the quantiles are exact for the DN's counted */
+      double quantiles[args->probs_count];
+      const double bound
+        = sc->dn_p ? 0 : nquant_error_bound (&(acc->quant));
+      if (sc->dn_p) {
+        dn_counts_quantiles (acc, sc, args->probs, args->probs_count,
+                             quantiles);
+      } else if (nquant_quantiles (&(acc->quant),
+                                   args->probs, args->probs_count,
+                                   quantiles) < 0) {
+        error (1, errno, _("computing the quantiles"));
+      }
+      if (args->verbose_p) {
+        fprintf (stderr, _("rank error within %g (99%%)\n"), bound);
+      }
+      if (args->stretch_p) {
+        print_stretch_table (output, args->probs, args->probs_count,
+                             quantiles, args->stretch_max, bound);
+      } else {
+        print_quantiles (output, args->probs, args->probs_count,
+                         quantiles);
+      }
+    }
+    break;
+  default:
+    print_range (output, acc, sc->t);
+  }
+}
+
+/* NB: the blocks are taken as the units of the sample, which gives
+   the (conservative) bounds for the correlated data */
+static void
+print_confidence (const struct accum *acc, const struct scan *sc,
+                  const struct sampling *smp, size_t component)
+{
+  const double b = smp->blocks_read;
+  char prefix[32] = "";
+
+  if (component <= 1) {
+    error (0, 0, _("sampled %zu blocks, %.3g%% of the data"),
+           smp->blocks_read,
+           (smp->bytes_total > 0
+            ? 100. * smp->bytes_read / smp->bytes_total : 100.));
+  }
+  if (smp->bytes_read >= smp->bytes_total) {
+    /* NB: everything was read */
+    return;
+  }
+  if (component > 0) {
+    snprintf (prefix, sizeof (prefix), _("component %zu: "), component);
+  }
+  switch (sc->mode) {
+  case MODE_STATS:
+    error (0, 0, _("%sthe standard error of the mean is at most %.*g"),
+           prefix, DBL_DIG, sqrt (nstats_variance (&(acc->stats)) / b));
+    break;
+  case MODE_QUANT:
+    error (0, 0, _("%sthe rank error due to sampling is about %.2g"
+                   " at most"),
+           prefix, 0.5 / sqrt (b));
+    break;
+  default:
+    error (0, 0, _("%sup to %.3g%% of the blocks could hold the values"
+                   " out of the range sampled"),
+           prefix, 200. / (b + 1));
+  }
+}
+
 /*** main () */
 
 int
@@ -190,7 +2002,22 @@ main (int argc, char **argv)
 {
   struct p_args args = {
     .verbose_p  = 0,
-    .format     = FORMAT_UINT8,
+    .jobs       = 1,
+    .per_file_p = 0,
+    .components = 0,
+    .formats    = 0,
+    .formats_count = 0,
+    .ignore_p   = 0,
+    .mode       = MODE_RANGE,
+    .hist_range_p = 0,
+    .raw_counts_p = 0,
+    .probs      = 0,
+    .stretch_p  = 0,
+    .stretch_max  = 255,
+    .sample_p   = 0,
+    .cache_dir  = 0,
+    .build_index_p = 0,
+    .no_index_p = 0,
     .files      = { 0, 0, 0 },
   };
   FILE *output = stdout;
@@ -213,97 +2040,135 @@ main (int argc, char **argv)
   /* process the input files */
   {
     const struct strings *names = &(args.files);
-    const int t = args.format;
-    /* NB: casting to `void *' */
-    void (*extend) (const void *vec, size_t size,
-                    void *min, void *max)
-      = (t == FORMAT_INT8     ? nrange_extend_int8_tt
-         : t == FORMAT_INT16  ? nrange_extend_int16_tt
-         : t == FORMAT_INT32  ? nrange_extend_int32_tt
-         : t == FORMAT_INT64  ? nrange_extend_int64_tt
-         : t == FORMAT_UINT8  ? nrange_extend_uint8_tt
-         : t == FORMAT_UINT16 ? nrange_extend_uint16_tt
-         : t == FORMAT_UINT32 ? nrange_extend_uint32_tt
-         : t == FORMAT_UINT64 ? nrange_extend_uint64_tt
-         : t == FORMAT_FLOAT  ? nrange_extend_float
-         : t == FORMAT_DOUBLE ? nrange_extend_double
-         : 0);
-    const size_t elt_sz
-      = (t == FORMAT_UINT8 || t == FORMAT_INT8 ? sizeof (int8_t)
-         : t == FORMAT_UINT16 || t == FORMAT_INT16 ? sizeof (int16_t)
-         : t == FORMAT_UINT32 || t == FORMAT_INT32 ? sizeof (int32_t)
-         : t == FORMAT_UINT64 || t == FORMAT_INT64 ? sizeof (int64_t)
-         : t == FORMAT_FLOAT  ? sizeof (float)
-         : t == FORMAT_DOUBLE ? sizeof (double)
-         : 0);
-    const size_t buf_elts = BUF_SZ / elt_sz;
-    char minp[elt_sz], maxp[elt_sz];
-    size_t rest;
-    const char **np;
-    int has_range_p = 0;
-
-    assert (extend != 0);
-    assert (elt_sz != 0);
-    assert (buf_elts > 0);
-
-    for (rest = names->size, np = names->s;
-         rest > 0;
-         rest--, np++) {
-      char buf[buf_elts * elt_sz];
-      FILE *fp;
-      size_t count;
-
-      if ((fp = open_file (*np, 1)) == 0) {
-        error (1, errno, "%s", *np);
+    const double *ignore = args.ignore_p ? &(args.ignore) : 0;
+    const size_t n_results = args.per_file_p ? names->size : 1;
+    const size_t n_comps = args.components;
+    struct numfmt fmts[n_comps];
+    struct record rec;
+    struct accum results[n_results * n_comps];
+    struct nhist geometry[n_comps], *geom = 0;
+    /* NB: the zone maps hold the ranges of the values as they are */
+    const int index_p = (args.mode == MODE_RANGE && n_comps == 1
+                         && ! args.ignore_p && ! args.sample_p
+                         && ! args.no_index_p);
+    size_t i, c;
+
+    /* NB: the last format applies to the rest of the components */
+    for (c = 0; c < n_comps; c++) {
+      fmts[c] = args.formats[MIN (c, args.formats_count - 1)];
+    }
+    record_init (&rec, fmts, n_comps, ignore, args.mode);
+
+    /* NB: the zone maps are written instead of any output */
+    if (args.build_index_p) {
+      for (i = 0; i < names->size; i++) {
+        if (strcmp (names->s[i], "-") == 0) {
+          error (1, 0, _("the standard input couldn't be indexed"));
+        }
+        build_index (names->s[i], rec.sc, args.index_block,
+                     args.verbose_p);
+      }
+      record_free (&rec);
+      /* . */
+      return 0;
+    }
+
+    /* NB: unless given, the range of the histogram is found with the
+       first pass over the data */
+    if (args.mode == MODE_HIST) {
+      struct record rec1;
+      struct accum a1[n_comps];
+      int first_pass_p = 0;
+      for (c = 0; c < n_comps; c++) {
+        geometry[c].bins = args.hist_bins;
+        geometry[c].min  = args.hist_min;
+        geometry[c].max  = args.hist_max;
+        first_pass_p |= (! rec.sc[c].dn_p && ! args.hist_range_p);
+      }
+      geom = geometry;
+      if (first_pass_p) {
+        for (i = 0; i < names->size; i++) {
+          if (strcmp (names->s[i], "-") == 0) {
+            error (1, 0,
+                   _("the histogram range should be given"
+                     " to read the standard input"));
+          }
+        }
+        record_init (&rec1, fmts, n_comps, ignore, MODE_STATS);
+        if (accums_init (a1, &rec1, 0) < 0) {
+          error (1, errno, _("allocating the counts"));
+        }
+        sampling_reset (&(args.sampling));
+        if (args.cache_dir != 0) {
+          /* NB: the range might well be cached by --stats */
+          scan_files_cached (a1, &rec1, 0, names, args.jobs,
+                             args.cache_dir, 0, 0, args.verbose_p);
+        } else {
+          scan_files (a1, &rec1, 0, names, args.jobs,
+                      args.sample_p ? &(args.sampling) : 0,
+                      0, args.verbose_p);
+        }
+        for (c = 0; c < n_comps; c++) {
+          const struct nstats *st = &(a1[c].stats);
+          geometry[c].min = (st->count > 0) ? st->min : 0;
+          geometry[c].max = (st->count > 0) ? st->max : 0;
+        }
+        accums_free (a1, &rec1);
+        record_free (&rec1);
+      }
+    }
+
+    for (i = 0; i < n_results; i++) {
+      if (accums_init (results + i * n_comps, &rec, geom) < 0) {
+        error (1, errno, _("allocating the counts"));
       }
-      if (args.verbose_p) {
-        if (fp == stdin)
-          fputs (_("processing standard input...\n"), stderr);
-        else
-          fprintf (stderr, _("processing `%s'...\n"), *np);
+    }
+    sampling_reset (&(args.sampling));
+    if (args.cache_dir != 0 || index_p) {
+      scan_files_cached (results, &rec, geom, names, args.jobs,
+                         args.cache_dir, index_p, args.per_file_p,
+                         args.verbose_p);
+    } else {
+      scan_files (results, &rec, geom, names, args.jobs,
+                  args.sample_p ? &(args.sampling) : 0,
+                  args.per_file_p, args.verbose_p);
+    }
+
+    for (i = 0; i < n_results; i++) {
+      if (args.per_file_p && ! args.raw_counts_p) {
+        fprintf (output, "==> %s <==\n", names->s[i]);
       }
-      while (! feof (fp)
-             && (count = fread (buf, elt_sz, buf_elts, fp)) > 0) {
-        void   *bp  = (has_range_p ? 0 : elt_sz) + buf;
-        size_t size = (has_range_p ? 0 :     -1) + count;
-        if (! has_range_p) {
-          has_range_p = 1;
-          COPY_ARY ((char *)minp, (char *)buf, elt_sz);
-          COPY_ARY ((char *)maxp, (char *)buf, elt_sz);
+      for (c = 0; c < n_comps; c++) {
+        const struct scan *sc = rec.sc + c;
+        struct accum *acc = results + i * n_comps + c;
+
+        if (args.mode == MODE_HIST && sc->dn_p) {
+          double min = args.hist_min, max = args.hist_max;
+          if (! args.hist_range_p
+              && ! dn_counts_range (acc, sc, &min, &max)) {
+            min = max = 0;
+          }
+          if (nhist_init (&(acc->hist), args.hist_bins,
+                          min, max) < 0) {
+            error (1, errno, _("allocating the histogram"));
+          }
+          accum_fold_dn_counts (acc, sc);
+        }
+
+        /* print the result */
+        if (n_comps > 1 && args.mode != MODE_RANGE
+            && ! args.raw_counts_p) {
+          fprintf (output, "# component %zu\n", c + 1);
         }
-        /* NB: casting to `void *' */
-        (*extend) ((void *)bp, size, (void *)minp, (void *)maxp);
+        print_result (output, acc, sc, &args);
+        if (args.sample_p) {
+          print_confidence (acc, sc, &(args.sampling),
+                            n_comps > 1 ? c + 1 : 0);
+        }
+        accum_free (acc);
       }
-      /* FIXME: check for EOF? */
-      close_file (fp);
-    }
-
-    /* print the result */
-    #define PRINTF_RANGE_CAST(fs, dtype, type) \
-        fprintf (output, "%" fs " %" fs "\n", \
-                 (dtype)*((type *)minp), \
-                 (dtype)*((type *)maxp))
-    #define PRINTF_INT_RANGE_CAST(type) \
-        PRINTF_RANGE_CAST ("lld", long long int, type)
-    #define PRINTF_UINT_RANGE_CAST(type) \
-        PRINTF_RANGE_CAST ("llu", unsigned long long int, type)
-    #define PRINTF_DOUBLE_RANGE_CAST(type) \
-        PRINTF_RANGE_CAST ("g", double, type)
-    switch (t) {
-    case FORMAT_INT8:   PRINTF_INT_RANGE_CAST   (int8_t);  break;
-    case FORMAT_INT16:  PRINTF_INT_RANGE_CAST   (int16_t); break;
-    case FORMAT_INT32:  PRINTF_INT_RANGE_CAST   (int32_t); break;
-    case FORMAT_INT64:  PRINTF_INT_RANGE_CAST   (int64_t); break;
-    case FORMAT_UINT8:  PRINTF_UINT_RANGE_CAST  (uint8_t);  break;
-    case FORMAT_UINT16: PRINTF_UINT_RANGE_CAST  (uint16_t); break;
-    case FORMAT_UINT32: PRINTF_UINT_RANGE_CAST  (uint32_t); break;
-    case FORMAT_UINT64: PRINTF_UINT_RANGE_CAST  (uint64_t); break;
-    case FORMAT_FLOAT:  PRINTF_DOUBLE_RANGE_CAST (float);  break;
-    case FORMAT_DOUBLE: PRINTF_DOUBLE_RANGE_CAST (double); break;
-    default:
-      /* NB: shouldn't happen */
-      assert (0);
     }
+    record_free (&rec);
   }
 
   /* . */
@@ -4,7 +4,21 @@
 #include "gettext.h"
 #define _(string) gettext (string)
 #define N_(string) gettext_noop (string)
-static const char doc[] = N_("Apply table transformation");
+static const char doc[]
+= N_("Apply table transformation\v"
+     "FORMAT is TYPE[:FILL] or, for the integer types,"
+     " TYPE:SCALE:OFFSET[:FILL], meaning the values of"
+     " SCALE * DN + OFFSET, with DN equal to FILL read as,"
+     " and NaN written as, FILL.  Supported types are:"
+     " uint8, uint16, uint32, uint64,"
+     " int8, int16, int32, int64,"
+     " float, double\n\n"
+     "If there's a zone map (FILE.zmap, as written with"
+     " rawrange(1) --build-index) for the input file and format, the"
+     " blocks of a single value (or NaN's only) are transformed"
+     " without being read.  So are the holes of the sparse files"
+     " (read as zeros), and the zeros output to a regular file are"
+     " left as holes.");
 static const char args_doc[] = "[FILE]...";
 
 /*** Copyright (C) 2006, 2007 Ivan Shmakov */
@@ -48,10 +62,12 @@ program_copyright (void)
 #include <string.h>
 
 #include "numconv.h"
+#include "numfmt.h"
 #include "p_arg.h"
 #include "usemacro.h"
 #include "useutil.h"
 #include "xform.h"
+#include "zonemap.h"
 
 #define BUF_SZ  4096
 
@@ -70,18 +86,6 @@ program_copyright (void)
 
 /*** Utility */
 
-static void
-uint8s_from_doubles (uint8_t *dst, const double *src, size_t count)
-{
-  size_t rest;
-  uint8_t *dp;
-  const double *sp;
-  for (rest = count, dp = dst, sp = src;
-       rest > 0;
-       rest--, *(dp++) = BOUND (*sp, 0, 255), sp++)
-    ;
-}
-
 static int
 load_table (struct xform_table *table, FILE *fp,
             unsigned int *lineno)
@@ -122,67 +126,43 @@ load_table (struct xform_table *table, FILE *fp,
   return lno - 1;
 }
 
-enum flt_format {
-  FORMAT_UINT8 = 0,
-  FORMAT_FLOAT,
-  FORMAT_DOUBLE
-};
-
+/* NB: LIMIT elements are transformed at most */
 static int
 apply_table (FILE *out, struct xform_table *table,
-             enum flt_format fmt, enum flt_format out_fmt,
-             FILE *in)
+             const struct numfmt *fmt, const struct numfmt *out_fmt,
+             enum nconv_rounding rounding,
+             FILE *in, uint64_t limit)
 {
-  float   buf_1[BUF_SZ];
+  const size_t
+    in_elt_sz  = numfmt_size (fmt),
+    out_elt_sz = numfmt_size (out_fmt);
   double  buf_inter[BUF_SZ];
-  void    *buf_in
-    = (fmt == FORMAT_FLOAT) ?  (void *)buf_1  :  (void *)buf_inter;
-  size_t  in_elt_sz
-    = (fmt == FORMAT_FLOAT) ? sizeof (*buf_1) : sizeof (*buf_inter);
+  char    buf_in[BUF_SZ * in_elt_sz];
+  char    buf_out[BUF_SZ * out_elt_sz];
   size_t  count;
 
-  assert (fmt == FORMAT_FLOAT || fmt == FORMAT_DOUBLE);
-  assert (out_fmt == FORMAT_UINT8
-          || out_fmt == FORMAT_FLOAT || out_fmt == FORMAT_DOUBLE);
-  while ((count = fread (buf_in, in_elt_sz, BUF_SZ, in))
+  while (limit > 0
+         && (count = fread (buf_in, in_elt_sz,
+                            MIN ((uint64_t)BUF_SZ, limit), in))
          > 0) {
     size_t count_w;
-    if (fmt == FORMAT_FLOAT) {
-      nconv_double_from_float (buf_inter, buf_1, count);
-    }
+    numfmt_to_doubles (buf_inter, buf_in, count, fmt);
     xform_table_apply (table, buf_inter, buf_inter, count);
-    switch (out_fmt) {
-    case FORMAT_UINT8:
-      {
-        uint8_t obuf[BUF_SZ];
-        uint8s_from_doubles (obuf, buf_inter, count);
-        count_w = fwrite ((void *)obuf, sizeof (*obuf), count, out);
-      }
-      break;
-    case FORMAT_FLOAT:
-      {
-        float obuf[BUF_SZ];
-        nconv_float_from_double (obuf, buf_inter, count);
-        count_w = fwrite ((void *)obuf, sizeof (*obuf), count, out);
-      }
-      break;
-    case FORMAT_DOUBLE:
+    if (numfmt_plain_double_p (out_fmt)) {
       count_w = fwrite ((void *)buf_inter, sizeof (*buf_inter), count,
                         out);
-      break;
-    default:
-      /* NB: should not happen */
-      error (1, 0, "%s:%d: unhandled output format",
-             __FUNCTION__, out_fmt);
-      break;
+    } else {
+      numfmt_from_doubles (buf_out, buf_inter, count, out_fmt, rounding);
+      count_w = fwrite ((void *)buf_out, out_elt_sz, count, out);
     }
     if (count_w != count) {
       /* . */
       return -1;
     }
+    limit -= count;
   }
 
-  if (! feof (in)) {
+  if (limit > 0 && ! feof (in)) {
     /* . */
     return -1;
   }
@@ -191,6 +171,125 @@ apply_table (FILE *out, struct xform_table *table,
   return 0;
 }
 
+/* NB: COUNT elements of VALUE; the zeros are output as a hole if
+   possible */
+static int
+apply_table_constant (FILE *out, struct xform_table *table,
+                      const struct numfmt *out_fmt,
+                      enum nconv_rounding rounding,
+                      double value, uint64_t count)
+{
+  const size_t out_elt_sz = numfmt_size (out_fmt);
+  double  buf_inter[BUF_SZ];
+  char    buf_out[BUF_SZ * out_elt_sz];
+  size_t  i;
+
+  xform_table_apply (table, &value, &value, 1);
+  for (i = 0; i < BUF_SZ; i++) {
+    buf_inter[i] = value;
+  }
+  numfmt_from_doubles (buf_out, buf_inter, BUF_SZ, out_fmt, rounding);
+  for (i = 0; i < out_elt_sz && buf_out[i] == 0; i++)
+    ;
+  if (i == out_elt_sz) {
+    /* . */
+    return sparse_write_zeros (out, (off_t)(count * out_elt_sz));
+  }
+  while (count > 0) {
+    const size_t n = MIN ((uint64_t)BUF_SZ, count);
+    if (fwrite (buf_out, out_elt_sz, n, out) != n) {
+      /* . */
+      return -1;
+    }
+    count -= n;
+  }
+
+  /* . */
+  return 0;
+}
+
+/* NB: the blocks of a single value are skipped over */
+static int
+apply_table_indexed (FILE *out, struct xform_table *table,
+                     const struct numfmt *fmt,
+                     const struct numfmt *out_fmt,
+                     enum nconv_rounding rounding,
+                     FILE *in, const struct zmap *z)
+{
+  const size_t in_elt_sz = numfmt_size (fmt);
+  size_t i;
+
+  for (i = 0; i < z->count; i++) {
+    const uint64_t len = zmap_block_length (z, i);
+    double value;
+    if (! zmap_block_constant_p (z, i, &value)) {
+      if (apply_table (out, table, fmt, out_fmt, rounding,
+                       in, len) < 0) {
+        /* . */
+        return -1;
+      }
+      continue;
+    }
+    if (apply_table_constant (out, table, out_fmt, rounding,
+                              value, len) < 0
+        || fseeko (in, (off_t)(len * in_elt_sz), SEEK_CUR) != 0) {
+      /* . */
+      return -1;
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
+/* NB: the holes of the input file are transformed as the runs of
+   zeros, without being read */
+static int
+apply_table_sparse (FILE *out, struct xform_table *table,
+                    const struct numfmt *fmt,
+                    const struct numfmt *out_fmt,
+                    enum nconv_rounding rounding,
+                    FILE *in)
+{
+  const size_t in_elt_sz = numfmt_size (fmt);
+  const union numfmt_value zero = { .u64 = 0 };
+  double value;
+
+  numfmt_to_doubles (&value, &zero, 1, fmt);
+  while (! feof (in)) {
+    const off_t pos = ftello (in);
+    off_t end;
+    int r;
+    if (pos < 0) {
+      /* NB: a stream */
+      /* . */
+      return apply_table (out, table, fmt, out_fmt, rounding,
+                          in, UINT64_MAX);
+    }
+    if ((r = sparse_extent (fileno (in), pos, in_elt_sz, &end)) < 0) {
+      /* . */
+      return -1;
+    }
+    if (r != 0) {
+      if (apply_table (out, table, fmt, out_fmt, rounding, in,
+                       (uint64_t)(end - pos) / in_elt_sz) < 0) {
+        /* . */
+        return -1;
+      }
+      continue;
+    }
+    if (apply_table_constant (out, table, out_fmt, rounding, value,
+                              (uint64_t)(end - pos) / in_elt_sz) < 0
+        || fseeko (in, end, SEEK_SET) != 0) {
+      /* . */
+      return -1;
+    }
+  }
+
+  /* . */
+  return 0;
+}
+
 /*** Parsing the Command Line */
 
 const char *
@@ -214,6 +313,9 @@ void (*argp_program_version_hook)(FILE *, struct argp_state *) = p_vers;
 
 enum opts {
   opt_offset = 256,
+  opt_rounding,
+  opt_nan_output,
+  opt_no_index,
   opt_max
 };
 
@@ -229,12 +331,6 @@ const char *interp_opts[] = {
   [INTERP_MAX]    = 0
 };
 
-const char *format_opts[] = {
-  [FORMAT_UINT8]  = "uint8",
-  [FORMAT_FLOAT]  = "float",
-  [FORMAT_DOUBLE] = "double"
-};
-
 static struct argp_option p_opts[] = {
   { 0, 0, 0, 0, /***/ N_("specifying the transformation table") },
 #if 0
@@ -251,15 +347,23 @@ static struct argp_option p_opts[] = {
     N_("append ENTRY to the transformation table;"
        " ENTRY is a pair of floats separated by a comma") },
   { 0, 0, 0, 0, /***/ N_("miscellaneous") },
-  { "format",           't', "TYPE", 0,
-    N_("select input format, which may be"
-       " `float' or `double' (default)") },
-  { "output-format",    'T', "TYPE", 0,
-    N_("select output format, which may be `uint8',"
-       " `float' or `double' (default)") },
+  { "format",           't', "FORMAT", 0,
+    N_("select input format (`double' by default)") },
+  { "output-format",    'T', "FORMAT", 0,
+    N_("select output format (`double' by default)") },
+  { "rounding",         opt_rounding, "MODE", 0,
+    N_("round to integer output formats using MODE, which may be"
+       " `nearest' (to even), `trunc' (default) or `floor';"
+       " out-of-range values saturate") },
+  { "nan-output",       opt_nan_output, "NUMBER", 0,
+    N_("map NaN to NUMBER on output, unless the output format"
+       " specifies the fill value (default is the largest value"
+       " of the integer type, e. g., 255 for `uint8')") },
   { "interpolate",      'I', "TYPE", 0,
     N_("use interpolation TYPE, which may be `none' (default)"
        " or `linear'") },
+  { "no-index",         opt_no_index, 0, 0,
+    N_("don't use the zone maps of the input files") },
   { "output",           'o', "FILE", 0,
     N_("output the result to this file instead of stdout") },
   { "verbose",          'v', 0, 0,
@@ -273,8 +377,11 @@ struct p_args {
   double input_mult, output_mult;
 #endif
   int interpolation;
-  int input_format;
-  int output_format;
+  struct numfmt input_format;
+  struct numfmt output_format;
+  int rounding;
+  int nan_output_p;
+  double nan_output;
   const char *output_file;
   struct strings table_files;
   struct xform_table *x_table;
@@ -286,6 +393,7 @@ struct p_args {
   double range_value;
 #endif
   struct strings input_files;
+  int no_index_p;
 };
 
 static int
@@ -376,34 +484,48 @@ p_opt (int key, char *arg, struct argp_state *state)
     }
     break;
   case 't':
-    {
-      int i;
-      if ((i = p_arg_string (arg, format_opts, 0)) < 0
-          && i != FORMAT_DOUBLE && i != FORMAT_FLOAT) {
-        argp_error (state,
-                    N_("invalid argument `%s' for `--format';"
-                       " should be `float' or `double'"),
-                    arg);
-        /* . */
-        return EINVAL;
-      }
-      args->input_format = i;
+  case 'T':
+    if (numfmt_parse ((key == 't'
+                       ? &(args->input_format)
+                       : &(args->output_format)),
+                      arg) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `%s';"
+                     " should be `TYPE[:FILL]'"
+                     " or `TYPE:SCALE:OFFSET[:FILL]'"),
+                  arg, (key == 't' ? "--format" : "--output-format"));
+      /* . */
+      return EINVAL;
     }
     break;
-  case 'T':
+  case opt_rounding:
     {
       int i;
-      if ((i = p_arg_string (arg, format_opts, 0)) < 0) {
+      if ((i = p_arg_string (arg, numfmt_rounding_names, 0)) < 0) {
         argp_error (state,
-                    N_("invalid argument `%s' for `--format';"
-                       " should be `uint8', `float' or `double'"),
+                    N_("invalid argument `%s' for `--rounding';"
+                       " should be `nearest', `trunc' or `floor'"),
                     arg);
         /* . */
         return EINVAL;
       }
-      args->output_format = i;
+      args->rounding = i;
     }
     break;
+  case opt_nan_output:
+    if (p_arg_double (arg, &(args->nan_output)) < 0) {
+      argp_error (state,
+                  N_("invalid argument `%s' for `--nan-output';"
+                     " should be a number"),
+                  arg);
+      /* . */
+      return EINVAL;
+    }
+    args->nan_output_p = 1;
+    break;
+  case opt_no_index:
+    args->no_index_p = 1;
+    break;
   case 'o':
     args->output_file = arg;
     break;
@@ -455,8 +577,11 @@ main (int argc, char **argv)
     DFL_OUTPUT_MULT,
 #endif
     INTERP_NONE,
-    FORMAT_DOUBLE,
-    FORMAT_DOUBLE,
+    { NUMFMT_DOUBLE, 0, 1, 0 },
+    { NUMFMT_DOUBLE, 0, 1, 0 },
+    NCONV_ROUND_TRUNC,
+    0,
+    0,
     "-",
     { 0, 0, 0 },
     0,
@@ -466,7 +591,8 @@ main (int argc, char **argv)
 #endif
     - INFINITY,
 #endif
-    { 0, 0, 0 }
+    { 0, 0, 0 },
+    0
   };
   FILE *output;
 
@@ -521,6 +647,17 @@ main (int argc, char **argv)
   /* NB: these file names aren't needed any longer */
   strings_clear (&(args.table_files));
 
+  /* NB: --nan-output is the default fill value for the output; lacking
+     both, NaN is written as the largest value of an integer type, as
+     the uint8 output always did */
+  if (args.output_format.fill_p) {
+    /* do nothing */
+  } else if (args.nan_output_p) {
+    numfmt_set_fill (&(args.output_format), args.nan_output);
+  } else if (numfmt_integer_p (&(args.output_format))) {
+    numfmt_set_fill (&(args.output_format), HUGE_VAL);
+  }
+
   /* prepare the coefficients if needed */
   if (args.interpolation == INTERP_LINEAR) {
     xform_table_linear_interp (args.x_table);
@@ -541,27 +678,46 @@ main (int argc, char **argv)
          rest > 0;
          rest--, np++) {
       FILE *fp;
+      struct zmap z;
+      int index_p;
 
       if ((fp = open_file (*np, 1)) == 0) {
         error (1, errno, "%s", *np);
       }
+      index_p = (fp != stdin && ! args.no_index_p
+                 && zmap_load (&z, *np, &(args.input_format)) > 0);
       if (args.verbose_p) {
         if (fp == stdin)
           fputs (_("processing standard input...\n"), stderr);
+        else if (index_p)
+          fprintf (stderr, _("processing `%s' with its zone map...\n"),
+                   *np);
         else
           fprintf (stderr, _("processing `%s'...\n"), *np);
       }
-      if (apply_table (output, table,
-                       args.input_format, args.output_format,
-                       fp) < 0) {
+      if ((index_p
+           ? apply_table_indexed (output, table,
+                                  &(args.input_format),
+                                  &(args.output_format),
+                                  args.rounding, fp, &z)
+           : apply_table_sparse (output, table,
+                                 &(args.input_format),
+                                 &(args.output_format),
+                                 args.rounding, fp)) < 0) {
         error (1, errno, "%s", *np);
       }
+      if (index_p) {
+        zmap_free (&z);
+      }
       if (fp != stdin)
         fclose (fp);
     }
   }
 
   /* close output */
+  if (sparse_finish (output) < 0) {
+    error (1, errno, "%s", args.output_file);
+  }
   close_file (output);
 
   /* . */